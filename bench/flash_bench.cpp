@@ -0,0 +1,222 @@
+// Host benchmark: flash every HEX image in the SD root into a simulated
+// ATmega32U4 through the full ArduboyController::flash() path and report
+// the flash times. A sample .arduboy package is flashed without unpacking,
+// as are raw and ELF builds of the same game, then a flashed device is
+// dumped back to the SD root. Reads cost simulated SD card time, so the
+// pipelined flash has SD latency to hide. Exits
+// non-zero if a flash or dump fails or the simulated target saw a protocol
+// error.
+#include <Arduino.h>
+#include <HostHAL.h>
+#include <MacroLogger.h>
+#include <SD.h>
+
+#include <ArduboyController.h>
+#include <AvrIspSim.h>
+
+#include "config.h"
+
+static const char* kImages[] = {"/ardu.hex", "/ark.hex", "/arkanoid.hex",
+                                "/blink.hex", "/testl.hex"};
+
+// Simulated read time of one SD sector: command, access and 512 bytes at
+// the 20 MHz SPI clock of the card
+static const uint32_t kSdSectorUs = 400;
+
+static const AvrDevice& kTarget = *findAvrDevice(0x1E, 0x95, 0x87);
+
+static bool targetClean(const AvrIspSim& target) {
+  const AvrSimStats& stats = target.getStats();
+  return stats.busy_violations == 0 && stats.unerased_writes == 0;
+}
+
+static bool benchImage(const char* path) {
+  AvrIspSim target(kTarget);
+  ArduboyController controller;
+  controller.begin(target, HEX_BUFFER_SIZE);
+  controller.setImageCache(&SD);
+  SD.remove(ImageCache::pathFor(path));
+
+  File file = SD.open(path);
+  if (!file) {
+    Serial.printf("%-14s missing\n", path);
+    return false;
+  }
+
+  // Cold flash into an empty device, then the same image again
+  bool ok = controller.flash(file);
+  FlashStats cold = controller.getLastFlashStats();
+  AvrSimStats bus = target.getStats();
+  ok = ok && targetClean(target);
+
+  file.seek(0);
+  ok = controller.flash(file) && ok;
+  FlashStats warm = controller.getLastFlashStats();
+  ok = ok && warm.skipped && warm.cached;
+
+  // A fresh device flashed from the image cache written by the cold flash
+  AvrIspSim fresh(kTarget);
+  ArduboyController cachedController;
+  cachedController.begin(fresh, HEX_BUFFER_SIZE);
+  cachedController.setImageCache(&SD);
+  file.seek(0);
+  ok = cachedController.flash(file) && ok;
+  FlashStats cached = cachedController.getLastFlashStats();
+  ok = ok && cached.cached && cached.pages == cold.pages && targetClean(fresh) &&
+       memcmp(fresh.getFlash(), target.getFlash(), kTarget.flash_size) == 0;
+  file.close();
+  SD.remove(ImageCache::pathFor(path));
+
+  uint32_t hidden_pct = cold.sd_us ? cold.hidden_us * 100 / cold.sd_us : 0;
+  Serial.printf("%-14s %4u pages %6u ms  bus %5u ms  sd %4u ms  hidden %3u%%  skip %4u ms  cached %6u ms  sd %4u ms  %s\n",
+                path, cold.pages, cold.elapsed_ms, bus.bus_us / 1000,
+                cold.sd_us / 1000, hidden_pct, warm.elapsed_ms, cached.elapsed_ms,
+                cached.sd_us / 1000, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Flash over a bootloader in the boot section with lock bits set, both
+// must survive
+static bool benchBootloader(const char* path) {
+  AvrIspSim target(kTarget);
+  uint8_t* boot = target.getFlash() + 0x7000;
+  for (uint32_t i = 0; i < 0x1000; i++) boot[i] = (uint8_t)(i * 7 + 1);
+  target.setLockBits(0x2F);
+
+  ArduboyController controller;
+  controller.begin(target, HEX_BUFFER_SIZE);
+  controller.setPreserveBootloader(true);
+
+  File file = SD.open(path);
+  bool ok = file && controller.flash(file);
+  FlashStats stats = controller.getLastFlashStats();
+  file.close();
+
+  for (uint32_t i = 0; i < 0x1000 && ok; i++) ok = boot[i] == (uint8_t)(i * 7 + 1);
+  ok = ok && (target.getLockBits() & 0x3F) == 0x2F && targetClean(target);
+
+  Serial.printf("%-14s %4u pages %6u ms  bootloader preserved           %s\n", path,
+                stats.pages, stats.elapsed_ms, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Flash a package straight from its HEX entry, or a raw or ELF build; the
+// device must match a flash of the same HEX file, a second flash must come
+// from the cache
+static bool benchFormat(const char* path, const char* hex_path) {
+  AvrIspSim reference(kTarget);
+  ArduboyController referenceController;
+  referenceController.begin(reference, HEX_BUFFER_SIZE);
+  File hex = SD.open(hex_path);
+  bool ok = hex && referenceController.flash(hex);
+  hex.close();
+
+  AvrIspSim target(kTarget);
+  ArduboyController controller;
+  controller.begin(target, HEX_BUFFER_SIZE);
+  controller.setImageCache(&SD);
+  SD.remove(ImageCache::pathFor(path));
+
+  File file = SD.open(path);
+  ok = file && controller.flash(file) && ok;
+  FlashStats cold = controller.getLastFlashStats();
+  ok = ok && targetClean(target) &&
+       memcmp(target.getFlash(), reference.getFlash(), kTarget.flash_size) == 0;
+
+  file.seek(0);
+  ok = controller.flash(file) && ok;
+  FlashStats warm = controller.getLastFlashStats();
+  ok = ok && warm.skipped && warm.cached;
+  file.close();
+  SD.remove(ImageCache::pathFor(path));
+
+  Serial.printf("%-18s %4u pages %6u ms  sd %4u ms  %-18s skip %4u ms  %s\n",
+                path, cold.pages, cold.elapsed_ms, cold.sd_us / 1000, strrchr(path, '.') + 1,
+                warm.elapsed_ms,
+                ok ? "ok" : "FAIL");
+  return ok;
+}
+
+static bool fileEquals(const char* path, const uint8_t* data, uint32_t size) {
+  File file = SD.open(path);
+  bool ok = file && file.size() == size;
+  uint8_t chunk[256];
+  for (uint32_t offset = 0; offset < size && ok; offset += sizeof(chunk)) {
+    uint32_t length = size - offset < sizeof(chunk) ? size - offset : sizeof(chunk);
+    ok = file.read(chunk, length) == length && memcmp(chunk, data + offset, length) == 0;
+  }
+  file.close();
+  return ok;
+}
+
+// Dump a flashed device with EEPROM contents as BIN and as HEX; the BIN
+// files must match the target and the HEX dump must parse back to the same
+// flash image
+static bool benchDump(const char* path) {
+  AvrIspSim target(kTarget);
+  ArduboyController controller;
+  controller.begin(target, HEX_BUFFER_SIZE);
+  for (uint32_t i = 0; i < kTarget.eeprom_size; i++) {
+    target.getEeprom()[i] = i % 3 ? (uint8_t)(i * 13) : 0xFF;
+  }
+
+  File file = SD.open(path);
+  bool ok = file && controller.flash(file);
+  file.close();
+
+  AvrSimStats before = target.getStats();
+  uint32_t start = millis();
+  ok = ok && controller.dump(SD, "/dump_bench.bin");
+  uint32_t bin_ms = millis() - start;
+  uint32_t bus_ms = (target.getStats().bus_us - before.bus_us) / 1000;
+  ok = ok && fileEquals("/dump_bench.bin", target.getFlash(), kTarget.flash_size) &&
+       fileEquals("/dump_bench.eep.bin", target.getEeprom(), kTarget.eeprom_size);
+
+  start = millis();
+  ok = ok && controller.dump(SD, "/dump_bench.hex");
+  uint32_t hex_ms = millis() - start;
+
+  HexParser parser(kTarget.flash_size);
+  static uint8_t image[HEX_BUFFER_SIZE];
+  file = SD.open("/dump_bench.hex");
+  ok = ok && file && parser.parseFile(file);
+  parser.readImage(0, image, kTarget.flash_size);
+  ok = ok && memcmp(image, target.getFlash(), kTarget.flash_size) == 0;
+  uint32_t hex_size = file ? file.size() : 0;
+  file.close();
+  ok = ok && targetClean(target);
+
+  for (const char* dump : {"/dump_bench.bin", "/dump_bench.eep.bin", "/dump_bench.fuses",
+                           "/dump_bench.hex", "/dump_bench.eep"}) {
+    SD.remove(dump);
+  }
+
+  Serial.printf("%-14s dump bin %6u ms  bus %5u ms  hex %6u ms  %6u bytes          %s\n",
+                path, bin_ms, bus_ms, hex_ms, hex_size, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+void setup() {
+  Serial.begin(SERIAL_BAUD_RATE);
+  Logger::set_level(Logger::Level::WARNING);
+
+  if (!SD.begin()) {
+    Serial.println("SD root not available");
+    exit(1);
+  }
+  hostSetSdSectorTime(kSdSectorUs);
+
+  uint32_t failures = 0;
+  for (const char* path : kImages) {
+    if (!benchImage(path)) failures++;
+  }
+  if (!benchBootloader(kImages[0])) failures++;
+  if (!benchDump(kImages[1])) failures++;
+  if (!benchFormat("/arkanoid.arduboy", "/arkanoid.hex")) failures++;
+  if (!benchFormat("/arkanoid.bin", "/arkanoid.hex")) failures++;
+  if (!benchFormat("/arkanoid.elf", "/arkanoid.hex")) failures++;
+
+  exit(failures ? 1 : 0);
+}
+
+void loop() {}
@@ -0,0 +1,202 @@
+// Host benchmark: HEX decoder throughput on every image in the SD root.
+// Each image is parsed repeatedly into the flash buffer and checked against
+// a plain line-by-line reference decode, packages are inflated and parsed
+// in the same way, raw and ELF builds are loaded without decoding. Exits non-zero on a mismatch.
+#include <Arduino.h>
+#include <MacroLogger.h>
+#include <SD.h>
+
+#include <Crc32.h>
+#include <HexParser.h>
+#include <ArduboyPackage.h>
+
+#include "config.h"
+
+#define HEX_BENCH_ROUNDS 200
+
+static const char* kImages[] = {"/ardu.hex", "/ark.hex", "/arkanoid.hex",
+                                "/blink.hex", "/testl.hex"};
+
+// Packages and the HEX file they contain
+static const char* kPackages[][2] = {{"/arkanoid.arduboy", "/arkanoid.hex"}};
+// Raw and ELF builds of a HEX file
+static const char* kBinaries[][2] = {{"/arkanoid.bin", "/arkanoid.hex"},
+                                     {"/arkanoid.elf", "/arkanoid.hex"}};
+
+static uint8_t referenceImage[HEX_BUFFER_SIZE];
+static uint8_t parsedImage[HEX_BUFFER_SIZE];
+
+// Straightforward decode with strtoul, one line at a time. Returns the image
+// size or 0 on a malformed file.
+static uint32_t referenceDecode(File& file) {
+  memset(referenceImage, 0xFF, sizeof(referenceImage));
+  uint32_t segment = 0;
+  uint32_t size = 0;
+  while (file.available()) {
+    String line = file.readStringUntil('\n');
+    line.trim();
+    if (line.length() < 11 || line[0] != ':') continue;
+
+    char hex[3] = {0, 0, 0};
+    uint8_t bytes[5 + 255];
+    uint32_t count = (line.length() - 1) / 2;
+    uint8_t sum = 0;
+    for (uint32_t i = 0; i < count && i < sizeof(bytes); i++) {
+      hex[0] = line[1 + i * 2];
+      hex[1] = line[2 + i * 2];
+      bytes[i] = (uint8_t)strtoul(hex, nullptr, 16);
+      sum += bytes[i];
+    }
+    uint8_t length = bytes[0];
+    if (sum != 0 || count != 5u + length) return 0;
+
+    uint32_t address = (segment << 16) | (bytes[1] << 8) | bytes[2];
+    if (bytes[3] == IHEX_DATA_RECORD) {
+      if (address + length > sizeof(referenceImage)) return 0;
+      memcpy(referenceImage + address, bytes + 4, length);
+      if (address + length > size) size = address + length;
+    } else if (bytes[3] == IHEX_EXTENDED_LINEAR_ADDRESS_RECORD) {
+      segment = (bytes[4] << 8) | bytes[5];
+    } else if (bytes[3] == IHEX_END_OF_FILE_RECORD) {
+      break;
+    }
+  }
+  return size;
+}
+
+static bool benchImage(HexParser& parser, const char* path) {
+  File file = SD.open(path);
+  if (!file) {
+    Serial.printf("%-14s missing\n", path);
+    return false;
+  }
+  uint32_t file_size = file.size();
+
+  bool ok = true;
+  uint32_t start = micros();
+  for (uint32_t round = 0; round < HEX_BENCH_ROUNDS && ok; round++) {
+    file.seek(0);
+    ok = parser.parseFile(file);
+  }
+  uint32_t elapsed_us = micros() - start;
+
+  file.seek(0);
+  uint32_t reference_size = referenceDecode(file);
+  file.close();
+
+  uint32_t size = parser.getFlashSize();
+  parser.readImage(0, parsedImage, size);
+  uint32_t crc = crc32Final(crc32Update(CRC32_INIT, parsedImage, size));
+  uint32_t reference_crc = crc32Final(crc32Update(CRC32_INIT, referenceImage, reference_size));
+  ok = ok && size == reference_size && crc == reference_crc;
+
+  uint32_t per_parse_us = elapsed_us / HEX_BENCH_ROUNDS;
+  uint32_t kb_per_s = per_parse_us ? (uint64_t)file_size * 1000000 / 1024 / per_parse_us : 0;
+  Serial.printf("%-14s %6u bytes  image %5u  crc %08x  %6u us/parse  %7u KB/s  ram %5u  %s\n",
+                path, file_size, size, crc, per_parse_us, kb_per_s,
+                parser.getMemoryUsage(), ok ? "ok" : "FAIL");
+  parser.releaseBuffer();
+  return ok;
+}
+
+// Inflate and parse the HEX entry of a package, checked against the
+// reference decode of the plain HEX file
+static bool benchPackage(HexParser& parser, const char* path, const char* hex_path) {
+  File file = SD.open(path);
+  ArduboyPackage package;
+  if (!file || !package.open(file) || !package.hasHex()) {
+    Serial.printf("%-18s missing\n", path);
+    return false;
+  }
+  uint32_t file_size = file.size();
+
+  bool ok = true;
+  uint32_t start = micros();
+  for (uint32_t round = 0; round < HEX_BENCH_ROUNDS && ok; round++) {
+    ok = package.rewind() && parser.parse(package);
+  }
+  uint32_t elapsed_us = micros() - start;
+  file.close();
+
+  File hex = SD.open(hex_path);
+  uint32_t reference_size = hex ? referenceDecode(hex) : 0;
+  hex.close();
+
+  uint32_t size = parser.getFlashSize();
+  parser.readImage(0, parsedImage, size);
+  uint32_t crc = crc32Final(crc32Update(CRC32_INIT, parsedImage, size));
+  uint32_t reference_crc = crc32Final(crc32Update(CRC32_INIT, referenceImage, reference_size));
+  ok = ok && size == reference_size && crc == reference_crc;
+
+  uint32_t per_parse_us = elapsed_us / HEX_BENCH_ROUNDS;
+  uint32_t kb_per_s = per_parse_us ? (uint64_t)package.size() * 1000000 / 1024 / per_parse_us : 0;
+  Serial.printf("%-18s %6u bytes  image %5u  crc %08x  %6u us/parse  %7u KB/s  hex text  %s\n",
+                path, file_size, size, crc, per_parse_us, kb_per_s, ok ? "ok" : "FAIL");
+  parser.releaseBuffer();
+  return ok;
+}
+
+// Load a raw or ELF image, checked against the reference decode of the
+// HEX file it was built from
+static bool benchBinary(HexParser& parser, const char* path, const char* hex_path) {
+  File file = SD.open(path);
+  if (!file) {
+    Serial.printf("%-18s missing\n", path);
+    return false;
+  }
+  BinLoader bin(file);
+  ElfLoader elf(file);
+  ImageLoader& loader = BinLoader::isBinImage(path) ? static_cast<ImageLoader&>(bin) : elf;
+  uint32_t file_size = file.size();
+
+  bool ok = true;
+  uint32_t start = micros();
+  for (uint32_t round = 0; round < HEX_BENCH_ROUNDS && ok; round++) {
+    ok = loader.rewind() && parser.parse(loader);
+  }
+  uint32_t elapsed_us = micros() - start;
+  file.close();
+
+  File hex = SD.open(hex_path);
+  uint32_t reference_size = hex ? referenceDecode(hex) : 0;
+  hex.close();
+
+  uint32_t size = parser.getFlashSize();
+  parser.readImage(0, parsedImage, reference_size);
+  uint32_t crc = crc32Final(crc32Update(CRC32_INIT, parsedImage, reference_size));
+  uint32_t reference_crc = crc32Final(crc32Update(CRC32_INIT, referenceImage, reference_size));
+  ok = ok && size <= reference_size && crc == reference_crc;
+
+  uint32_t per_parse_us = elapsed_us / HEX_BENCH_ROUNDS;
+  uint32_t kb_per_s = per_parse_us ? (uint64_t)file_size * 1000000 / 1024 / per_parse_us : 0;
+  Serial.printf("%-18s %6u bytes  image %5u  crc %08x  %6u us/parse  %7u KB/s  %s\n",
+                path, file_size, size, crc, per_parse_us, kb_per_s, ok ? "ok" : "FAIL");
+  parser.releaseBuffer();
+  return ok;
+}
+
+void setup() {
+  Serial.begin(SERIAL_BAUD_RATE);
+  Logger::set_level(Logger::Level::WARNING);
+
+  if (!SD.begin()) {
+    Serial.println("SD root not available");
+    exit(1);
+  }
+
+  HexParser parser(HEX_BUFFER_SIZE);
+  uint32_t failures = 0;
+  for (const char* path : kImages) {
+    if (!benchImage(parser, path)) failures++;
+  }
+  for (const auto& package : kPackages) {
+    if (!benchPackage(parser, package[0], package[1])) failures++;
+  }
+  for (const auto& binary : kBinaries) {
+    if (!benchBinary(parser, binary[0], binary[1])) failures++;
+  }
+
+  exit(failures ? 1 : 0);
+}
+
+void loop() {}
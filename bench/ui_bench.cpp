@@ -0,0 +1,58 @@
+// Host benchmark: bring FxManager up on the host HAL and time how long
+// each UI screen takes to draw a frame into the headless display. Set
+// HOST_OLED_PBM to a path to capture the frames as PBM images.
+#include <Arduino.h>
+#include <MacroLogger.h>
+
+#include "FxManager.h"
+#include "UI.h"
+#include "config.h"
+
+static const uint32_t kUpdates = 5000;
+
+static const struct {
+  Screen screen;
+  const char* name;
+} kScreens[] = {
+    {Screen::HOME, "home"},
+    {Screen::GAME_LIST, "game list"},
+    {Screen::BUTTONS_TEST, "buttons test"},
+    {Screen::SETTINGS, "settings"},
+    {Screen::FLASH_GAME, "flash game"},
+};
+
+void setup() {
+  Serial.begin(SERIAL_BAUD_RATE);
+  Logger::set_level(Logger::Level::ERROR);
+
+  uint32_t start = millis();
+  FxManager* fxManager = new FxManager();
+  if (!fxManager->begin()) {
+    Serial.println("FxManager failed to start");
+    exit(1);
+  }
+  while (!fxManager->gameLibrary->loaded) {
+    yield();
+  }
+  Serial.printf("Startup and library scan: %lu ms, %u categories\n", millis() - start,
+                fxManager->gameLibrary->getCategoryCount());
+
+  U8G2& display = fxManager->oled->u8g2;
+  for (const auto& entry : kScreens) {
+    fxManager->ui->setScreen(entry.screen);
+    uint32_t frames = display.getFrameCount();
+
+    uint32_t screen_start = micros();
+    for (uint32_t i = 0; i < kUpdates; i++) {
+      fxManager->ui->update();
+    }
+    uint32_t elapsed = micros() - screen_start;
+
+    Serial.printf("%-14s %6u updates %6u frames %8.2f us/update\n", entry.name, kUpdates,
+                  display.getFrameCount() - frames, (double)elapsed / kUpdates);
+  }
+
+  exit(0);
+}
+
+void loop() {}
@@ -35,6 +35,8 @@ public:
   bool writeFile(const String& path, const String& content);
   bool appendFile(const String& path, const String& content);
   bool deleteFile(const String& path);
+  // Fails if toPath exists, see the .cpp
+  bool renameFile(const String& fromPath, const String& toPath);
   bool copyFile(const String& sourcePath, const String& destPath);
 
   // System operations
@@ -46,6 +48,9 @@ public:
 
   // Hex file specific operations
   bool isValidHexFile(const String& path);
+  bool isValidPackageFile(const String& path);
+  // Any game image ArduboyController can flash: HEX, package, BIN or ELF
+  bool isValidImageFile(const String& path);
   void listHexFiles();
 };
 
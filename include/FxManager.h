@@ -28,9 +28,13 @@ class FxManager {
   void update();
   void setMode(FxMode mode);
   FxMode getMode() const { return currentMode; }
-  void flashGame(const GameInfo& game);
+  void flashGame(const GameView& game);
+  // Save flash, EEPROM and fuses of the connected device to the SD card
+  void dumpDevice(const String& path);
   void reset() const;
   void printInfo();
+  // Free heap, largest free block and where the game library lives
+  void printHeap() const;
 
   FileSystemManager* fileSystem;
   FxMode currentMode;
@@ -5,34 +5,111 @@
 #include <Arduino.h>
 #include <MacroLogger.h>
 #include "FileSystemManager.h"
-#include <vector>
-
-struct GameInfo {
-  String filePath;
-  String title;
-  String date;
-  String author;
-  String description;
-  String license;
+#include "LibrarySnapshot.h"
+#include <atomic>
+
+class GameLibrary;
+
+// Reference to the snapshot that was current when the view was made. The
+// snapshot stays valid for the life of the view, even if a rescan publishes
+// a newer one meanwhile. Empty before the first load. Copies share the
+// reference.
+class LibraryView {
+private:
+  LibrarySnapshot* snapshot;
+
+public:
+  LibraryView() : snapshot(nullptr) {}
+  explicit LibraryView(const GameLibrary& library);
+  LibraryView(const LibraryView& other);
+  LibraryView& operator=(const LibraryView& other);
+  ~LibraryView();
+
+  bool valid() const { return snapshot != nullptr; }
+  const LibrarySnapshot* get() const { return snapshot; }
+  uint32_t categoryCount() const { return snapshot ? snapshot->category_count : 0; }
+  // false past the end
+  bool category(uint32_t index, LibraryCategoryRecord& record) const;
+  bool game(uint32_t category_index, uint32_t game_index, LibraryGameRecord& record) const;
 };
 
-struct GameCategory {
-  String categoryName;
-  String categoryPath;
+// A category copied out of a snapshot into a buffer of its own, without a
+// heap allocation
+class CategoryView {
+private:
+  char text[LIBRARY_CATEGORY_TEXT];
+  uint16_t pathAt = 0;
+  uint32_t games = 0;
+  bool present = false;
+
+public:
+  CategoryView() {}
+  CategoryView(const LibrarySnapshot& library, const LibraryCategoryRecord& record);
+
+  bool valid() const { return present; }
+  const char* name() const { return present ? text : ""; }
+  const char* path() const { return present ? text + pathAt : ""; }
+  uint32_t gameCount() const { return games; }
 };
 
-struct Games : GameCategory {
-  std::vector<GameInfo> games;
+// A game copied out of a snapshot into a buffer of its own, without a heap
+// allocation. The strings are copied in field order and share the buffer,
+// so the path always fits and the description is the first to be cut
+// short. An invalid view has only the title it was given.
+class GameView {
+private:
+  enum Field { PATH, TITLE, DATE, AUTHOR, LICENSE, DESCRIPTION, FIELDS };
+
+  char text[LIBRARY_VIEW_TEXT];
+  uint16_t at[FIELDS] = {};
+  uint32_t stamp = 0;
+  bool present = false;
+  const char* missing = "";
+
+  const char* field(Field which) const { return present ? text + at[which] : ""; }
+
+public:
+  GameView() {}
+  explicit GameView(const char* missing) : missing(missing) {}
+  GameView(const LibrarySnapshot& library, const LibraryGameRecord& record);
+
+  bool valid() const { return present; }
+  const char* filePath() const { return field(PATH); }
+  const char* title() const { return valid() ? field(TITLE) : missing; }
+  const char* date() const { return field(DATE); }
+  const char* author() const { return field(AUTHOR); }
+  const char* description() const { return field(DESCRIPTION); }
+  const char* license() const { return field(LICENSE); }
+  GameInfo toInfo() const;
 };
 
 class GameLibrary {
 private:
-  std::vector<Games> games = {};
+  friend class LibraryView;
+
+  // Readers load the pointer and take a reference in between incrementing
+  // and decrementing readers, never blocking. A publisher swaps the pointer
+  // and waits for readers to drop to zero once before it lets go of the
+  // old snapshot, after that nobody can take a new reference to it.
+  std::atomic<LibrarySnapshot*> current{nullptr};
+  mutable std::atomic<uint32_t> readers{0};
+  std::atomic<bool> scanning{false};
+  bool deepScan = false;  // of the scan that is running
   FileSystemManager* fileSystemManager = nullptr;
 
-  void loadLibraryFromFolder();
-  GameInfo findGameInFolder(const File& folder) const;
-  void extractCategoryMetadata(const File &folder, GameCategory &outCategory);
+  LibrarySnapshot* acquire() const;
+  static void release(LibrarySnapshot* snapshot);
+  void publish(LibrarySnapshot* snapshot);
+  void retire(LibrarySnapshot* snapshot);
+
+  void loadLibrary(bool deep);
+  bool rescanLibrary(bool deep);
+  uint32_t scanCategory(File& folder, uint32_t stamp, bool deep, const LibrarySnapshot* known,
+                        const LibraryCategoryRecord* knownCategory, LibraryBuilder& builder);
+  GameInfo readGame(const String& path, bool directory) const;
+  GameInfo findGameInFolder(const String& path) const;
+  GameInfo readPackage(const String& path, const String& fallbackTitle) const;
+  void extractCategoryMetadata(const File &folder, String &name, String &path);
 
 public:
   GameLibrary();
@@ -42,18 +119,21 @@ public:
   void begin(FileSystemManager& fs);
   void end();
 
-  // load games from filesystem
-  void loadGames();
-  bool loading = true;
-  bool loaded = false;
+  // load games from filesystem in a background task. The previous
+  // library stays readable until the new one is published. A deep scan
+  // also looks into the game folders of categories whose listing did not
+  // change.
+  void loadGames(bool deep = false);
+  std::atomic<bool> loading{true};  // no library to show yet
+  std::atomic<bool> loaded{false};
 
   // get category
-  GameCategory getCategory(uint8_t index) const;
-  uint8_t getCategoryCount() const;
+  CategoryView getCategory(uint32_t index) const;
+  uint32_t getCategoryCount() const;
 
   // get games in category
-  uint8_t getGamesCount(uint8_t category_index) const;
-  GameInfo getGameInfo(uint8_t category_index, uint8_t game_index) const;
+  uint32_t getGamesCount(uint32_t category_index) const;
+  GameView getGameInfo(uint32_t category_index, uint32_t game_index) const;
 
 };
 
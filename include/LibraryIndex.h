@@ -0,0 +1,49 @@
+
+#ifndef ARDUBOY_FX_WIFI_LIBRARYINDEX_H
+#define ARDUBOY_FX_WIFI_LIBRARYINDEX_H
+
+#include <Arduino.h>
+#include <MacroLogger.h>
+#include "FileSystemManager.h"
+#include "LibrarySnapshot.h"
+
+#define LIBRARY_INDEX_MAGIC     0x494C5846UL  // "FXLI"
+#define LIBRARY_INDEX_VERSION   4
+#define LIBRARY_INDEX_EXTENSION ".idx"
+
+// Game library as found by the last folder scan, stored in the library
+// folder so the next boot does not have to walk every game folder again.
+// The folder stamps of the categories and games are kept with them, a
+// rescan compares them to find what changed.
+//
+// Every rescan that changes the library writes a new generation,
+// <base>.<generation>.idx, and the snapshot reading an older one removes
+// it when it goes. At boot the newest generation that checks out is used.
+//
+// File layout: this header, category_count category records, game_count
+// game records (grouped by category, in category order) and strings_size
+// bytes of string pool. Snapshots read it in place, page by page. The CRC
+// covers everything after the header.
+struct LibraryIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t category_count;
+  uint32_t game_count;
+  uint32_t strings_size;
+  uint32_t crc;
+};
+
+static_assert(sizeof(LibraryIndexHeader) == 24, "library index header must not be padded");
+
+class LibraryIndex {
+ public:
+  static String pathFor(const char* base, uint32_t generation);
+  // Snapshot of the index at path, nullptr for a missing or corrupt index
+  static LibrarySnapshot* open(FileSystemManager& fs, const String& path, uint32_t generation);
+  // Snapshot of the newest index generation next to base. Older
+  // generations and leftovers of an interrupted write are removed.
+  static LibrarySnapshot* openLatest(FileSystemManager& fs, const char* base);
+};
+
+#endif // ARDUBOY_FX_WIFI_LIBRARYINDEX_H
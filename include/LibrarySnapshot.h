@@ -0,0 +1,205 @@
+
+#ifndef ARDUBOY_FX_WIFI_LIBRARYSNAPSHOT_H
+#define ARDUBOY_FX_WIFI_LIBRARYSNAPSHOT_H
+
+#include <Arduino.h>
+#include <MacroLogger.h>
+#include "FileSystemManager.h"
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <atomic>
+#include <vector>
+
+// Window of the index file a snapshot keeps in memory, whatever the size
+// of the library
+#define LIBRARY_PAGE_SIZE    512
+#define LIBRARY_PAGE_COUNT   8
+// Strings up to this length are remembered while building, so repeated
+// authors, dates and licenses are stored once
+#define LIBRARY_INTERN_SLOTS 64
+#define LIBRARY_INTERN_TEXT  32
+// Longest string text() copies out of the pool
+#define LIBRARY_TEXT_MAX     1024
+// Buffers of the game and category views, all strings of one entry
+#define LIBRARY_VIEW_TEXT    512
+#define LIBRARY_CATEGORY_TEXT 256
+// Game records and strings are written to the temporary file of a build in
+// chunks of up to this many bytes
+#define LIBRARY_BUILD_CHUNK  512
+
+// Game entry as read from a folder or package, before it goes into a
+// snapshot
+struct GameInfo {
+  String filePath;
+  String title;
+  String date;
+  String author;
+  String description;
+  String license;
+  uint32_t stamp = 0;  // category entry the game was read from
+};
+
+// Records refer to their strings by byte offset into the string pool,
+// offset 0 is the empty string
+struct LibraryCategoryRecord {
+  uint32_t name;
+  uint32_t path;
+  uint32_t first_game;  // games of a category are stored one after another
+  uint32_t game_count;
+  uint32_t stamp;       // listing of the category folder
+};
+
+struct LibraryGameRecord {
+  uint32_t path;
+  uint32_t title;
+  uint32_t date;
+  uint32_t author;
+  uint32_t description;
+  uint32_t license;
+  uint32_t stamp;
+};
+
+static_assert(sizeof(LibraryCategoryRecord) == 20, "library records must not be padded");
+static_assert(sizeof(LibraryGameRecord) == 28, "library records must not be padded");
+
+// Memory for library data, in PSRAM when the board has it. external tells
+// which one it came from.
+void* libraryAlloc(size_t size, bool* external = nullptr);
+void libraryFree(void* data);
+
+// One published state of the library, read from its index file. Only a
+// window of LIBRARY_PAGE_COUNT pages of the file is resident; records and
+// strings are faulted in as they are read and the least recently used page
+// makes room. The file is never changed while the snapshot is open; a
+// rescan writes a new one and swaps it in.
+// Readers that find their page resident only wait for the page table, never
+// for the SD card: a page fault reads into a spare page outside the cache
+// lock and installs it under the lock afterwards.
+class LibrarySnapshot {
+private:
+  struct Page {
+    uint32_t index = UINT32_MAX;  // page of the file it holds
+    uint32_t used = 0;
+  };
+
+  FileSystemManager* fs;
+  String path;
+  mutable File file;
+  uint8_t* cache = nullptr;  // the resident pages, then the spare one
+  mutable Page pages[LIBRARY_PAGE_COUNT];
+  mutable uint32_t clock = 0;
+  SemaphoreHandle_t cache_lock = nullptr;  // pages, clock and the resident data
+  SemaphoreHandle_t file_lock = nullptr;   // file and the spare page
+
+  LibrarySnapshot(FileSystemManager& fs, const String& path) : fs(&fs), path(path) {}
+  bool copyResident(uint32_t index, uint32_t within, uint8_t* out, size_t length) const;
+  bool fault(uint32_t index, uint32_t within, uint8_t* out, size_t length) const;
+
+public:
+  uint32_t generation = 0;
+  uint32_t category_count = 0;
+  uint32_t game_count = 0;
+  uint32_t strings_size = 0;
+  uint32_t body_offset = 0;  // the category records start here
+  bool external = false;     // page cache is in PSRAM
+  mutable std::atomic<uint32_t> faults{0};
+  std::atomic<uint32_t> references{1};  // the published pointer holds one
+  // A newer snapshot was published, the index file goes with this one
+  std::atomic<bool> superseded{false};
+
+  // Snapshot over an index file that was checked already. nullptr when the
+  // file cannot be opened or there is not enough memory.
+  static LibrarySnapshot* open(FileSystemManager& fs, const String& path, uint32_t generation,
+                               uint32_t category_count, uint32_t game_count,
+                               uint32_t strings_size, uint32_t body_offset);
+  ~LibrarySnapshot();
+  LibrarySnapshot(const LibrarySnapshot&) = delete;
+  LibrarySnapshot& operator=(const LibrarySnapshot&) = delete;
+
+  const String& filePath() const { return path; }
+  size_t fileSize() const {
+    return body_offset + category_count * sizeof(LibraryCategoryRecord) +
+           game_count * sizeof(LibraryGameRecord) + strings_size;
+  }
+  static size_t cacheSize() { return LIBRARY_PAGE_SIZE * (LIBRARY_PAGE_COUNT + 1); }
+
+  // Copy length bytes at offset of the index file, false on a read error
+  bool read(uint32_t offset, void* data, size_t length) const;
+  // false past the end
+  bool category(uint32_t index, LibraryCategoryRecord& record) const;
+  bool game(uint32_t index, LibraryGameRecord& record) const;
+  // Copy the string at offset to out, cut short to size - 1 bytes, and
+  // return its length. Offsets outside the pool read as the empty string.
+  size_t copyText(uint32_t offset, char* out, size_t size) const;
+  String text(uint32_t offset) const;
+};
+
+// Collects categories and games in order and writes them out as an index
+// file. Game records and strings go to one temporary file next to the
+// index as they come in, in chunks tagged with their kind, so building
+// takes the same memory for any library size and one open file. Category
+// records are few and stay in memory.
+class LibraryBuilder {
+private:
+  struct InternSlot {
+    uint32_t offset = 0;
+    char text[LIBRARY_INTERN_TEXT];
+  };
+  enum ChunkKind : uint8_t { GAMES, STRINGS, CHUNK_KINDS };
+  struct ChunkHeader {
+    uint8_t kind;
+    uint8_t reserved;
+    uint16_t length;
+  };
+  // Bytes of one kind waiting to be written as a chunk
+  struct Chunk {
+    uint16_t length = 0;
+    uint8_t data[LIBRARY_BUILD_CHUNK];
+  };
+
+  FileSystemManager& fs;
+  String base;
+  File records;
+  std::vector<LibraryCategoryRecord> categories;
+  uint32_t game_count = 0;
+  uint32_t strings_size = 0;
+  LibraryCategoryRecord category = {};
+  InternSlot* interned = nullptr;
+  Chunk* chunks = nullptr;  // one per kind
+  bool started = false;
+  bool failed = false;
+
+  String tempPath(const char* part) const { return base + "." + part + ".tmp"; }
+  bool start();
+  void close();
+  void write(File& file, const void* data, size_t length);
+  void append(ChunkKind kind, const void* data, size_t length);
+  void flush(ChunkKind kind);
+  bool copyChunks(File& in, File& out, ChunkKind kind, uint32_t& crc);
+  uint32_t intern(const char* text);
+  uint32_t intern(const String& text) { return intern(text.c_str()); }
+  void addGame(const char* path, const char* title, const char* date, const char* author,
+               const char* description, const char* license, uint32_t stamp);
+
+public:
+  // base is the index path without generation and extension
+  LibraryBuilder(FileSystemManager& fs, const char* base);
+  ~LibraryBuilder();
+  LibraryBuilder(const LibraryBuilder&) = delete;
+  LibraryBuilder& operator=(const LibraryBuilder&) = delete;
+
+  void beginCategory(const String& name, const String& path);
+  void addGame(const GameInfo& game);
+  // Take over a game or a whole category of an earlier snapshot
+  void addGame(const LibrarySnapshot& from, const LibraryGameRecord& game);
+  void addCategory(const LibrarySnapshot& from, const LibraryCategoryRecord& category);
+  void endCategory(uint32_t stamp);
+
+  uint32_t categoryCount() const { return categories.size(); }
+  // Write the index of the given generation and open it. The temporary
+  // files are removed either way. nullptr on a write error or when there is
+  // not enough memory.
+  LibrarySnapshot* finish(uint32_t generation);
+};
+
+#endif // ARDUBOY_FX_WIFI_LIBRARYSNAPSHOT_H
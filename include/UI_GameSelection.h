@@ -26,17 +26,17 @@ class UI_GameSelection {
     bool handleHid();
     void loadCurrentSelection();
 
-    uint8_t currentCategoryIndex = 0;
-    uint8_t categoriesCount = 0;
-    uint8_t currentGameIndex = 0;
-    uint8_t gamesInCategory = 0;
+    uint32_t currentCategoryIndex = 0;
+    uint32_t categoriesCount = 0;
+    uint32_t currentGameIndex = 0;
+    uint32_t gamesInCategory = 0;
     bool inCategoryScreen = true;
     bool needsReload = true;
-    GameInfo currentGame = GameInfo();
-    GameCategory currentCategory = GameCategory();
+    GameView currentGame = GameView();
+    CategoryView currentCategory = CategoryView();
 
-    void drawGameSplashScreen(const GameInfo& game, int8_t x_offset = 0, int8_t y_offset = 0) const;
-    void drawCategoryScreen(const GameCategory& category, int8_t x_offset = 0, int8_t y_offset = 0) const;
+    void drawGameSplashScreen(const GameView& game, int8_t x_offset = 0, int8_t y_offset = 0) const;
+    void drawCategoryScreen(const CategoryView& category, int8_t x_offset = 0, int8_t y_offset = 0) const;
 
     void drawNavbar() const;
 
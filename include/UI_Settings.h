@@ -6,6 +6,7 @@
 #define ARDUBOY_FX_WIFI_UI_SETTINGS_H
 
 #include <Arduino.h>
+#include <array>
 #include <U8g2lib.h>
 #include "FxManager.h"
 #include <Sprites.h>
@@ -26,6 +26,16 @@
 // Uses default SPI pins (GPIO7=SCK, GPIO11=MOSI, GPIO9=MISO)
 // Flash buffer size for ATmega32U4 (Arduboy)
 #define HEX_BUFFER_SIZE   32768  // 32KB for ATmega32U4
+// Restore the bootloader after the chip erase of every flash. Off by
+// default: flashing then behaves like a plain ISP programmer and never
+// reads back or rewrites the boot section.
+#define PRESERVE_BOOTLOADER  false
+// Optional bootloader image, otherwise it is read back from the Arduboy
+#define BOOTLOADER_HEX_PATH  "/bootloader.hex"
+// Keep a decoded <game>.fximg next to each HEX file for faster reflashing
+#define IMAGE_CACHE_ENABLED  true
+// Binary patches applied to every game, the built-in SSD1309 fix if missing
+#define PATCH_CONFIG_PATH    "/patches.cfg"
 
 // ==========================================
 // OLED CONFIGURATION
@@ -43,7 +53,14 @@
 #define SD_MOSI_PIN      2
 #define SD_MISO_PIN      4
 #define SD_SCK_PIN       3
+#define SD_FREQUENCY     4000000
+// Files open at once, directories do not count. The worst case is a rescan
+// during a flash: two library index files (the published one and one a
+// reader still holds), the rescan's temporary file and the game it reads,
+// the image and its cache file being flashed.
+#define SD_MAX_FILES     8
 #define GAME_LIBRARY_PATH   "/arduboy"
+#define GAME_LIBRARY_INDEX  GAME_LIBRARY_PATH "/library"
 
 // ==========================================
 // Buttons pins
@@ -1,32 +1,130 @@
 #include "ArduboyController.h"
 
-static bool oledSSD1309Patch(uint8_t* buf, uint32_t buf_size, uint32_t flash_size, void* ctx) {
-  if (!buf) return false;
-  static const uint8_t default_lcdBootProgram[] = {
-    0xD5, 0xF0, 0x8D, 0x14, 0xA1, 0xC8, 0x81, 0xCF, 0xD9, 0xF1, 0xAF, 0x20, 0x00
+#include <Crc32.h>
+#include <new>
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+// Stage between the page source and the page consumer: keeps the image out
+// of the boot section and records the pages for the image cache. Patches
+// are already applied by the parser.
+struct PageStage {
+  HexParser::page_sink_t next;
+  void* next_ctx;
+  uint32_t limit;        // first address that belongs to the boot section
+  ImageCache* capture;   // records the pages when set
+  bool overlap;
 };
-  static constexpr size_t default_lcdBootProgram_len =
-      sizeof(default_lcdBootProgram) / sizeof(default_lcdBootProgram[0]);
-  for (uint32_t i = 0; i + default_lcdBootProgram_len <= buf_size; ++i) {
-    bool ok = true;
-    for (size_t j = 0; j < default_lcdBootProgram_len; ++j) {
-      if (buf[i + j] != default_lcdBootProgram[j]) { ok = false; break; }
-    }
-    if (ok) {
-      if ((size_t)i + 3 < buf_size) {
-        buf[i + 2] = 0xE3;
-        buf[i + 3] = 0xE3;
-        return true;
-      }
-      return false;
-    }
+
+static void initPageStage(PageStage& stage, HexParser::page_sink_t next,
+                          void* next_ctx, uint32_t limit) {
+  stage.next = next;
+  stage.next_ctx = next_ctx;
+  stage.limit = limit;
+  stage.capture = nullptr;
+  stage.overlap = false;
+}
+
+static bool pageStageSink(uint32_t address, const uint8_t* page,
+                          uint32_t page_size, void* user) {
+  PageStage& stage = *static_cast<PageStage*>(user);
+  if (address + page_size > stage.limit) {
+    Logger::error("Image page 0x%05X overlaps the bootloader\n", address);
+    stage.overlap = true;
+    return false;
+  }
+  if (stage.capture) {
+    stage.capture->capturePage(address, page);
+  }
+  return stage.next(address, page, page_size, stage.next_ctx);
+}
+
+// Consumer that writes every page, pages are verified as they are written
+struct ProgramContext {
+  ISPProgrammer* isp;
+  uint32_t pages_written;
+};
+
+static bool programPageSink(uint32_t address, const uint8_t* page,
+                            uint32_t page_size, void* user) {
+  ProgramContext& ctx = *static_cast<ProgramContext*>(user);
+  // writePage() takes a page of the device's size
+  if (page_size != ctx.isp->getPageSize()) {
+    Logger::error("Page of %d bytes, the device takes %d\n", page_size,
+                  ctx.isp->getPageSize());
+    return false;
+  }
+  if (!ctx.isp->writePage(address, page)) {
+    return false;
   }
-  return false;
+  ctx.pages_written++;
+  return true;
+}
+
+// Page handed from the parser task to the programming loop. The last item
+// only carries the parse result.
+struct PipelinePage {
+  uint32_t address;
+  bool last;
+  bool ok;
+  uint8_t data[HEX_PARSER_MAX_PAGE_SIZE];
+};
+
+struct PipelineContext {
+  ArduboyController* controller;
+  ImageLoader* loader;
+  QueueHandle_t queue;
+  PipelinePage page;          // producer scratch page
+  volatile bool abort;        // set by the programmer after a failed write
+  uint32_t patches;
+  uint32_t busy_us;           // producer time spent reading and parsing
+  uint32_t blocked_us;        // producer time spent waiting for queue space
+};
+
+static bool pipelinePageSink(uint32_t address, const uint8_t* page,
+                             uint32_t page_size, void* user) {
+  PipelineContext& ctx = *static_cast<PipelineContext*>(user);
+  if (ctx.abort) return false;
+
+  ctx.page.address = address;
+  ctx.page.last = false;
+  ctx.page.ok = true;
+  memcpy(ctx.page.data, page, page_size);
+
+  uint32_t start = micros();
+  xQueueSend(ctx.queue, &ctx.page, portMAX_DELAY);
+  ctx.blocked_us += micros() - start;
+  return !ctx.abort;
+}
+
+// Consumer that fingerprints the image and the same pages on the device
+struct FingerprintContext {
+  ISPProgrammer* isp;
+  uint32_t image_crc;
+  uint32_t device_crc;
+  uint32_t pages;
+  uint8_t readback[HEX_PARSER_MAX_PAGE_SIZE];
+};
+
+static bool fingerprintPageSink(uint32_t address, const uint8_t* page,
+                                uint32_t page_size, void* user) {
+  FingerprintContext& ctx = *static_cast<FingerprintContext*>(user);
+  if (!ctx.isp->readFlash(address, ctx.readback, page_size)) {
+    return false;
+  }
+  ctx.image_crc = crc32Update(ctx.image_crc, page, page_size);
+  ctx.device_crc = crc32Update(ctx.device_crc, ctx.readback, page_size);
+  ctx.pages++;
+  return true;
 }
 
 ArduboyController::ArduboyController() {}
 
-ArduboyController::~ArduboyController() { end(); }
+ArduboyController::~ArduboyController() {
+  end();
+  clearBootloader();
+}
 
 bool ArduboyController::begin(uint8_t pinReset, uint32_t hexBufferSize) {
   if (initialized) {
@@ -37,21 +135,38 @@ bool ArduboyController::begin(uint8_t pinReset, uint32_t hexBufferSize) {
 
   pinMode(this->pinReset, OUTPUT);
 
+  // Initialize ISP programmer (using default hardware SPI pins)
+  return begin(new ISPProgrammer(this->pinReset), hexBufferSize);
+}
+
+bool ArduboyController::begin(ISPBus& bus, uint32_t hexBufferSize) {
+  if (initialized) {
+    return true;
+  }
+
+  this->bus = &bus;
+  return begin(new ISPProgrammer(bus), hexBufferSize);
+}
+
+bool ArduboyController::begin(ISPProgrammer* programmer, uint32_t hexBufferSize) {
+  ispProgrammer = programmer;
+  if (!ispProgrammer) {
+    Logger::error("Failed to create ISP programmer");
+    return false;
+  }
+
   // Initialize HEX parser
   hexParser = new HexParser(hexBufferSize);
   if (!hexParser) {
     Logger::error("Failed to create HEX parser");
+    delete ispProgrammer;
+    ispProgrammer = nullptr;
     return false;
   }
 
-  // Initialize ISP programmer (using default hardware SPI pins)
-  ispProgrammer = new ISPProgrammer(this->pinReset);
-  if (!ispProgrammer) {
-    Logger::error("Failed to create ISP programmer");
-    delete hexParser;
-    hexParser = nullptr;
-    return false;
-  }
+  // Built-in patches until a patch set file is loaded
+  patchEngine.loadDefaults();
+  hexParser->setPatchEngine(&patchEngine);
 
   initialized = true;
   return true;
@@ -75,21 +190,13 @@ bool ArduboyController::checkConnection() {
     return false;
   }
 
-  if (!ispProgrammer->begin()) {
-    Logger::error("Failed to initialize ISP programmer");
-    return false;
-  }
-
-  bool connected = ispProgrammer->enterProgrammingMode();
-  if (connected) {
+  ISPSession session(*ispProgrammer);
+  if (session) {
     Logger::info("Arduboy connected successfully");
-    ispProgrammer->exitProgrammingMode();
   } else {
     Logger::error("Failed to connect to Arduboy device");
   }
-
-  ispProgrammer->end();
-  return connected;
+  return session.isActive();
 }
 
 bool ArduboyController::flash(File& file) {
@@ -101,47 +208,110 @@ bool ArduboyController::flash(File& file) {
   Logger::info("Flashing Arduboy with: %s\n", file.name());
 
   if (!file) {
-    Logger::error("Failed to open HEX file");
+    Logger::error("Failed to open image file");
     return false;
   }
 
-  // Parse HEX file
-  if (!hexParser->parseFile(file)) {
-    Logger::error("Failed to parse HEX file");
-    return false;
+  // Packages are flashed straight from their HEX entry, nothing is unpacked
+  if (ArduboyPackage::isPackage(file.name())) {
+    ArduboyPackage package;
+    if (!package.open(file) || !package.hasHex()) {
+      Logger::error("No HEX file in package %s\n", file.name());
+      return false;
+    }
+    HexLoader loader(package);
+    return flashImage(loader, file);
   }
-
-  // Apply OLED patch if needed
-  if (!hexParser->modifyBuffer(oledSSD1309Patch, nullptr)) {
-    Logger::error("Failed to apply OLED patch to HEX file");
+  if (BinLoader::isBinImage(file.name())) {
+    BinLoader loader(file);
+    return flashImage(loader, file);
   }
+  if (ElfLoader::isElfImage(file.name())) {
+    ElfLoader loader(file);
+    return flashImage(loader, file);
+  }
+  FileHexSource source(file);
+  HexLoader loader(source);
+  return flashImage(loader, file);
+}
 
-  // Initialize ISP programmer
-  if (!ispProgrammer->begin()) {
-    Logger::error("Failed to initialize ISP programmer");
+// The loader supplies the image, the file it came from keys the image
+// cache
+bool ArduboyController::flashImage(ImageLoader& loader, File& file) {
+  uint32_t start = millis();
+  lastFlash = FlashStats();
+
+  // One session covers the connection check, fingerprint, erase and program
+  ISPSession session(*ispProgrammer);
+  if (!session) {
+    Logger::error("Arduboy not connected");
     return false;
   }
 
-  // Enter programming mode
-  if (!ispProgrammer->enterProgrammingMode()) {
-    Logger::error("Failed to enter programming mode");
-    ispProgrammer->end();
+  // Show device info
+  session.printDeviceInfo();
+
+  appLimit = ispProgrammer->getDevice().flash_size;
+  bootActive = false;
+  if (preserveBootloader && !prepareBootloader(session.getFuses())) {
     return false;
   }
 
-  // Show device info
-  ispProgrammer->printDeviceInfo();
+  if (imageCacheFs) {
+    imageCache.open(*imageCacheFs, file, ispProgrammer->getPageSize(),
+                    patchEngine.getSetId());
+  }
+
+  // Nothing to do if the same image is already on the device. A bootloader
+  // that is already correct is only verified, never rewritten.
+  if (skipIdentical && isImageOnDevice(loader) && (!bootActive || verifyBootloader())) {
+    Logger::info("Image already on device, skipping flash");
+    lastFlash.skipped = true;
+    lastFlash.cached = imageCache.isOpen();
+    finishImageCache(file, true);
+    lastFlash.elapsed_ms = millis() - start;
+    printFlashStats();
+    return true;
+  }
 
-  // Erase and program
+  // Erase, then program pages while the image is being loaded
   bool success = false;
-  if (ispProgrammer->eraseChip()) {
-    success = ispProgrammer->programFlash(hexParser->getFlashBuffer(),
-                                          hexParser->getFlashSize());
+  if (loader.rewind() && ispProgrammer->eraseChip()) {
+    bool cached = imageCache.isOpen();
+    success = pipelined ? flashPipelined(loader) : flashStreaming(loader);
+    if (!success && appOverlap) {
+      // Retrying cannot help, the image does not fit next to the bootloader
+    } else if (!success && cached) {
+      // A corrupt cache was removed, the retry loads the image file instead
+      Logger::info("Flash from image cache failed, erasing and retrying once");
+      success = loader.rewind() && ispProgrammer->eraseChip() && flashStreaming(loader);
+    } else if (!success && hexParser->getLastError() == HexParseError::OUT_OF_ORDER) {
+      Logger::info("Image data out of order, retrying with buffered parse");
+      success = flashBuffered(loader);
+    } else if (!success && hexParser->getLastError() == HexParseError::SINK) {
+      // A page could not be repaired in place, erase and write it all once more
+      Logger::info("Page write failed, erasing and retrying once");
+      success = loader.rewind() && ispProgrammer->eraseChip() && flashStreaming(loader);
+    }
+  }
+
+  // The chip erase also removed the bootloader: put it back, then fix up
+  // fuses and lock bits once every page is verified
+  if (bootActive) {
+    if (success) {
+      success = writeBootloader() && finishBootSection(session.getFuses());
+    } else if (!writeBootloader()) {
+      Logger::error("Failed to restore bootloader, device may not be bootable");
+    }
   }
 
-  // Exit programming mode
-  ispProgrammer->exitProgrammingMode();
-  ispProgrammer->end();
+  // A cache that is still open was read without errors
+  lastFlash.cached = imageCache.isOpen();
+  finishImageCache(file, success);
+
+  lastFlash.elapsed_ms = millis() - start;
+  ispProgrammer->printWaitStats();
+  printFlashStats();
 
   if (success) {
     Logger::info("Flashing successful!");
@@ -152,6 +322,501 @@ bool ArduboyController::flash(File& file) {
   return success;
 }
 
+// Load the image and pass the patched pages on to a consumer
+bool ArduboyController::streamPages(ImageLoader& loader, HexParser::page_sink_t sink,
+                                    void* ctx, uint32_t* patches) {
+  if (imageCache.isOpen()) {
+    return streamCachedPages(sink, ctx, patches);
+  }
+
+  PageStage stage;
+  initPageStage(stage, sink, ctx, appLimit);
+  uint32_t page_size = ispProgrammer->getPageSize();
+  stage.capture = imageCacheFs && imageCache.beginCapture(appLimit, page_size)
+                      ? &imageCache
+                      : nullptr;
+
+  bool success = hexParser->parse(loader, page_size, pageStageSink, &stage);
+  if (patches) {
+    *patches = patchEngine.getApplied();
+  }
+  if (stage.capture) {
+    imageCache.endCapture(success, patchEngine.getSetId(), patchEngine.getApplied());
+  }
+  appOverlap = stage.overlap;
+  return success;
+}
+
+// Cached pages are already patched, only the boot section limit is checked
+bool ArduboyController::streamCachedPages(HexParser::page_sink_t sink, void* ctx,
+                                          uint32_t* patches) {
+  appOverlap = imageCache.getImageEnd() > appLimit;
+  if (appOverlap) {
+    Logger::error("Image page 0x%05X overlaps the bootloader\n",
+                  imageCache.getImageEnd() - ispProgrammer->getPageSize());
+    return false;
+  }
+  if (patches) {
+    *patches = imageCache.getPatches();
+  }
+  return imageCache.readPages(sink, ctx);
+}
+
+// Write the image captured from the image file as the new cache, then drop
+// the cache state of this flash
+void ArduboyController::finishImageCache(File& file, bool commit) {
+  if (commit && imageCacheFs && imageCache.hasCapture()) {
+    imageCache.commit(*imageCacheFs, file);
+  }
+  imageCache.close();
+  imageCache.releaseCapture();
+}
+
+bool ArduboyController::flashStreaming(ImageLoader& loader) {
+  ProgramContext ctx;
+  ctx.isp = ispProgrammer;
+  ctx.pages_written = 0;
+
+  uint32_t patches = 0;
+  bool success = streamPages(loader, programPageSink, &ctx, &patches);
+
+  if (success) {
+    lastFlash.patches = patches;
+    patchEngine.printResults(patches);
+    Logger::info("Streamed %d pages to flash\n", ctx.pages_written);
+  }
+  lastFlash.pages += ctx.pages_written;
+  return success;
+}
+
+// Parser task: reads and decodes the file and queues patched pages
+void ArduboyController::pipelineProducer(void* param) {
+  PipelineContext& ctx = *static_cast<PipelineContext*>(param);
+
+  uint32_t start = micros();
+  bool ok = ctx.controller->streamPages(*ctx.loader, pipelinePageSink, &ctx,
+                                        &ctx.patches);
+  ctx.busy_us = micros() - start - ctx.blocked_us;
+
+  ctx.page.last = true;
+  ctx.page.ok = ok;
+  xQueueSend(ctx.queue, &ctx.page, portMAX_DELAY);
+  vTaskDelete(nullptr);
+}
+
+// Double buffered flash: the parser task decodes page N+1 from SD while
+// page N is being written, so SD latency hides behind the page write time.
+// The programmer yields while it polls RDY/BSY, which lets the parser run.
+bool ArduboyController::flashPipelined(ImageLoader& loader) {
+  PipelineContext ctx;
+  ctx.controller = this;
+  ctx.loader = &loader;
+  ctx.abort = false;
+  ctx.patches = 0;
+  ctx.busy_us = 0;
+  ctx.blocked_us = 0;
+  ctx.queue = xQueueCreate(FLASH_PIPELINE_DEPTH, sizeof(PipelinePage));
+  if (!ctx.queue) {
+    Logger::error("Failed to create flash pipeline queue");
+    return flashStreaming(loader);
+  }
+
+  TaskHandle_t producer = nullptr;
+  if (xTaskCreate(pipelineProducer, "HexProducer", FLASH_PIPELINE_STACK, &ctx,
+                  uxTaskPriorityGet(nullptr), &producer) != pdPASS) {
+    Logger::error("Failed to start flash pipeline task");
+    vQueueDelete(ctx.queue);
+    return flashStreaming(loader);
+  }
+
+  PipelinePage page;
+  bool write_ok = true;
+  uint32_t pages = 0;
+  uint32_t stall_us = 0;
+
+  // Keep draining after a failed write so the parser task can finish
+  while (true) {
+    uint32_t start = micros();
+    xQueueReceive(ctx.queue, &page, portMAX_DELAY);
+    stall_us += micros() - start;
+
+    if (page.last) break;
+    if (!write_ok) continue;
+
+    if (ispProgrammer->writePage(page.address, page.data)) {
+      pages++;
+    } else {
+      write_ok = false;
+      ctx.abort = true;
+    }
+  }
+  vQueueDelete(ctx.queue);
+
+  lastFlash.pages += pages;
+  lastFlash.sd_us += ctx.busy_us;
+  lastFlash.stall_us += stall_us;
+  lastFlash.hidden_us += ctx.busy_us > stall_us ? ctx.busy_us - stall_us : 0;
+
+  bool success = page.ok && write_ok;
+  if (success) {
+    lastFlash.patches = ctx.patches;
+    patchEngine.printResults(ctx.patches);
+    Logger::info("Pipelined %d pages to flash\n", pages);
+  }
+  return success;
+}
+
+void ArduboyController::printFlashStats() const {
+  if (lastFlash.skipped) {
+    Logger::info("Flash skipped, image already on device (%d ms)\n",
+                 lastFlash.elapsed_ms);
+    return;
+  }
+  uint32_t hidden_pct = lastFlash.sd_us ? lastFlash.hidden_us * 100 / lastFlash.sd_us : 0;
+  Logger::info("Flash: %d pages in %d ms%s\n", lastFlash.pages, lastFlash.elapsed_ms,
+               lastFlash.cached ? " from image cache" : "");
+  Logger::info("SD read/parse: %d ms, programmer stalled: %d ms, hidden: %d ms (%d%%)\n",
+               lastFlash.sd_us / 1000, lastFlash.stall_us / 1000,
+               lastFlash.hidden_us / 1000, hidden_pct);
+}
+
+// Compare a CRC32 over the patched image pages with a CRC32 over the same
+// pages read back from the device. Only pages present in the file are read.
+bool ArduboyController::isImageOnDevice(ImageLoader& loader) {
+  uint32_t start = millis();
+
+  FingerprintContext ctx;
+  ctx.isp = ispProgrammer;
+  ctx.image_crc = CRC32_INIT;
+  ctx.device_crc = CRC32_INIT;
+  ctx.pages = 0;
+
+  if (!streamPages(loader, fingerprintPageSink, &ctx, nullptr) || ctx.pages == 0) {
+    return false;
+  }
+
+  uint32_t image_crc = crc32Final(ctx.image_crc);
+  uint32_t device_crc = crc32Final(ctx.device_crc);
+  Logger::info("Fingerprint: image 0x%08X, device 0x%08X (%d pages, %d ms)\n",
+               image_crc, device_crc, ctx.pages, millis() - start);
+  return image_crc == device_crc;
+}
+
+// Fallback for files whose records jump back to pages that were already
+// written: parse the whole image first, then erase and program again.
+bool ArduboyController::flashBuffered(ImageLoader& loader) {
+  if (!loader.rewind() || !hexParser->parse(loader)) {
+    Logger::error("Failed to load image");
+    hexParser->releaseBuffer();
+    return false;
+  }
+
+  if (hexParser->getFlashSize() > appLimit) {
+    Logger::error("Image overlaps the bootloader");
+    hexParser->releaseBuffer();
+    return false;
+  }
+
+  // The parse already applied the patches, program the used pages
+  ProgramContext ctx;
+  ctx.isp = ispProgrammer;
+  ctx.pages_written = 0;
+  PageStage stage;
+  initPageStage(stage, programPageSink, &ctx, appLimit);
+  uint32_t page_size = ispProgrammer->getPageSize();
+  stage.capture = imageCacheFs && imageCache.beginCapture(appLimit, page_size)
+                      ? &imageCache
+                      : nullptr;
+
+  bool success = ispProgrammer->eraseChip() &&
+                 hexParser->forEachPage(page_size, pageStageSink, &stage);
+  if (success) {
+    lastFlash.patches = patchEngine.getApplied();
+    patchEngine.printResults(lastFlash.patches);
+  }
+  if (stage.capture) {
+    imageCache.endCapture(success, patchEngine.getSetId(), patchEngine.getApplied());
+  }
+  lastFlash.pages += ctx.pages_written;
+
+  hexParser->releaseBuffer();
+  return success;
+}
+
+// Load a bootloader HEX file into the cache. It takes the place of the
+// bootloader read back from the device.
+bool ArduboyController::loadBootloader(File& file) {
+  if (!initialized || !hexParser) {
+    Logger::error("ArduboyController not initialized");
+    return false;
+  }
+  // The patch set is for games, the bootloader is taken as it is
+  hexParser->setPatchEngine(nullptr);
+  bool parsed = file && file.seek(0) && hexParser->parseFile(file);
+  hexParser->setPatchEngine(&patchEngine);
+  if (!parsed) {
+    Logger::error("Failed to parse bootloader HEX file");
+    hexParser->releaseBuffer();
+    return false;
+  }
+
+  uint32_t end = hexParser->getFlashSize();
+  uint32_t first = hexParser->getImageStart();
+
+  uint32_t start = first & ~(uint32_t)(HEX_PARSER_MAX_PAGE_SIZE - 1);
+  end = (end + HEX_PARSER_MAX_PAGE_SIZE - 1) & ~(uint32_t)(HEX_PARSER_MAX_PAGE_SIZE - 1);
+  if (first >= end || end - start > BOOTLOADER_MAX_SIZE ||
+      end > hexParser->getBufferSize()) {
+    Logger::error("HEX file is not a bootloader image");
+    hexParser->releaseBuffer();
+    return false;
+  }
+
+  clearBootloader();
+  bootloader.data = new (std::nothrow) uint8_t[end - start];
+  if (!bootloader.data) {
+    Logger::error("Not enough memory for bootloader cache");
+    hexParser->releaseBuffer();
+    return false;
+  }
+  hexParser->readImage(start, bootloader.data, end - start);
+  bootloader.start = start;
+  bootloader.size = end - start;
+  hexParser->releaseBuffer();
+
+  Logger::info("Loaded bootloader 0x%05X-0x%05X\n", bootloader.start,
+               bootloader.start + bootloader.size - 1);
+  return true;
+}
+
+bool ArduboyController::loadPatches(File& file) {
+  if (!patchEngine.load(file)) {
+    Logger::error("Patch set file has errors, using the valid patches only");
+    return false;
+  }
+  return true;
+}
+
+void ArduboyController::clearBootloader() {
+  delete[] bootloader.data;
+  bootloader = BootloaderImage();
+}
+
+// Make sure the cache holds a bootloader for the connected device and that
+// it fits the boot section selected by the fuses. Without a bootloader on
+// the device or in the cache there is nothing to preserve.
+bool ArduboyController::prepareBootloader(const FuseInfo& fuses) {
+  DeviceInfo info = ispProgrammer->getDeviceInfo();
+  uint32_t boot_start = ispProgrammer->getBootStart(fuses);
+  uint32_t flash_size = ispProgrammer->getDevice().flash_size;
+
+  // A bootloader read from another device type is of no use here
+  static const uint8_t kNoSignature[3] = {0, 0, 0};
+  if (bootloader.data && memcmp(bootloader.signature, kNoSignature, 3) != 0 &&
+      memcmp(bootloader.signature, info.signature, 3) != 0) {
+    clearBootloader();
+  }
+
+  if (!bootloader.data) {
+    // Lock bits LB1/LB2 disable flash readback over ISP
+    if ((fuses.lock & 0x03) != 0x03) {
+      Logger::error("Flash is read protected, load a bootloader file first");
+      return false;
+    }
+
+    uint32_t size = flash_size - boot_start;
+    uint8_t* data = new (std::nothrow) uint8_t[size];
+    if (!data) {
+      Logger::error("Not enough memory for bootloader cache");
+      return false;
+    }
+    if (!ispProgrammer->readFlash(boot_start, data, size)) {
+      delete[] data;
+      return false;
+    }
+
+    bool blank = true;
+    for (uint32_t i = 0; i < size && blank; i++) {
+      blank = data[i] == 0xFF;
+    }
+    if (blank) {
+      delete[] data;
+      Logger::info("No bootloader on device, nothing to preserve");
+      return true;
+    }
+
+    memcpy(bootloader.signature, info.signature, 3);
+    bootloader.start = boot_start;
+    bootloader.size = size;
+    bootloader.data = data;
+    Logger::info("Cached bootloader 0x%05X-0x%05X from device\n", boot_start,
+                 flash_size - 1);
+  }
+
+  if (bootloader.start < boot_start || bootloader.start + bootloader.size > flash_size) {
+    Logger::error("Bootloader 0x%05X-0x%05X does not fit the boot section at 0x%05X\n",
+                  bootloader.start, bootloader.start + bootloader.size - 1, boot_start);
+    return false;
+  }
+
+  appLimit = bootloader.start;
+  bootActive = true;
+  return true;
+}
+
+bool ArduboyController::verifyBootloader() {
+  uint8_t readback[HEX_PARSER_MAX_PAGE_SIZE];
+  for (uint32_t offset = 0; offset < bootloader.size; offset += sizeof(readback)) {
+    if (!ispProgrammer->readFlash(bootloader.start + offset, readback, sizeof(readback)) ||
+        memcmp(readback, bootloader.data + offset, sizeof(readback)) != 0) {
+      Logger::info("Bootloader differs at 0x%05X\n", bootloader.start + offset);
+      return false;
+    }
+  }
+  Logger::info("Bootloader verified");
+  return true;
+}
+
+bool ArduboyController::writeBootloader() {
+  uint32_t page_size = ispProgrammer->getPageSize();
+  for (uint32_t offset = 0; offset < bootloader.size; offset += page_size) {
+    if (!ispProgrammer->writePage(bootloader.start + offset, bootloader.data + offset)) {
+      Logger::error("Failed to write bootloader page 0x%05X\n", bootloader.start + offset);
+      return false;
+    }
+  }
+  Logger::info("Restored bootloader (%d bytes)\n", bootloader.size);
+  return true;
+}
+
+// Fuses survive a chip erase, lock bits do not. BOOTRST is programmed so
+// reset enters the bootloader, then the lock bits read before the erase are
+// restored as the very last step.
+bool ArduboyController::finishBootSection(const FuseInfo& fuses) {
+  if (!ispProgrammer->isBootResetEnabled(fuses)) {
+    FuseInfo updated = fuses;
+    uint8_t& boot_fuse = ispProgrammer->getDevice().boot_fuse_extended
+                             ? updated.extended
+                             : updated.high;
+    boot_fuse &= ~0x01;
+    Logger::info("Enabling BOOTRST so reset starts the bootloader");
+    if (!ispProgrammer->writeFuses(updated)) {
+      return false;
+    }
+  }
+
+  if ((fuses.lock & 0x3F) != 0x3F) {
+    return ispProgrammer->writeLockBits(fuses.lock);
+  }
+  return true;
+}
+
+// Replace the extension of a path, e.g. for the EEPROM file of a dump
+static String withExtension(const char* path, const char* extension) {
+  String result(path);
+  int dot = result.lastIndexOf('.');
+  if (dot > result.lastIndexOf('/')) {
+    result.remove(dot);
+  }
+  return result + extension;
+}
+
+// Copy one memory of the target into a file, DUMP_CHUNK_SIZE bytes per
+// batched read
+bool ArduboyController::dumpMemory(fs::FS& fs, const String& path, ImageFormat format,
+                                   bool eeprom, uint32_t size, uint8_t* chunk) {
+  File file = fs.open(path, FILE_WRITE);
+  if (!file) {
+    Logger::error("Failed to create %s\n", path.c_str());
+    return false;
+  }
+  ImageWriter writer(file, format);
+  bool ok = writer.begin();
+  writer.setSkipBlank(true);
+
+  uint32_t start = millis();
+  for (uint32_t address = 0; address < size && ok; address += DUMP_CHUNK_SIZE) {
+    uint32_t length = size - address < DUMP_CHUNK_SIZE ? size - address : DUMP_CHUNK_SIZE;
+    ok = (eeprom ? ispProgrammer->readEeprom(address, chunk, length)
+                 : ispProgrammer->readFlash(address, chunk, length)) &&
+         writer.write(address, chunk, length);
+  }
+  ok = ok && writer.finish();
+  file.close();
+
+  if (ok) {
+    Logger::info("Dumped %d bytes of %s to %s (%d bytes) in %d ms\n", size,
+                 eeprom ? "EEPROM" : "flash", path.c_str(), writer.getBytesWritten(),
+                 millis() - start);
+  } else {
+    // A partial image would pass for a full one when flashed back
+    Logger::error("Dump to %s failed\n", path.c_str());
+    fs.remove(path);
+  }
+  return ok;
+}
+
+bool ArduboyController::dump(fs::FS& fs, const char* path) {
+  if (!initialized || !ispProgrammer) {
+    Logger::error("ArduboyController not initialized");
+    return false;
+  }
+
+  ISPSession session(*ispProgrammer);
+  if (!session) {
+    Logger::error("Arduboy not connected");
+    return false;
+  }
+  session.printDeviceInfo();
+
+  uint8_t* chunk = new (std::nothrow) uint8_t[DUMP_CHUNK_SIZE];
+  if (!chunk) {
+    Logger::error("Not enough memory for the dump buffer");
+    return false;
+  }
+
+  ImageFormat format = ImageWriter::formatFor(path);
+  const AvrDevice& device = ispProgrammer->getDevice();
+  String eeprom_path = withExtension(path, format == ImageFormat::BIN ? ".eep.bin" : ".eep");
+  bool ok = dumpMemory(fs, path, format, false, device.flash_size, chunk);
+  if (ok && !dumpMemory(fs, eeprom_path, format, true, device.eeprom_size, chunk)) {
+    fs.remove(path);
+    ok = false;
+  }
+  delete[] chunk;
+  if (!ok) {
+    return false;
+  }
+
+  // Fuses as text, they are only a few bytes
+  String fuse_path = withExtension(path, ".fuses");
+  File file = fs.open(fuse_path, FILE_WRITE);
+  if (file) {
+    const DeviceInfo info = session.getDeviceInfo();
+    const FuseInfo& fuses = session.getFuses();
+    ok = file.printf("device=%s\nsignature=%02X%02X%02X\n", device.name, info.signature[0],
+                     info.signature[1], info.signature[2]) > 0 &&
+         file.printf("lfuse=0x%02X\nhfuse=0x%02X\nefuse=0x%02X\nlock=0x%02X\ncal=0x%02X\n",
+                     fuses.low, fuses.high, fuses.extended, fuses.lock, fuses.calibration) > 0;
+    file.close();
+    if (!ok) {
+      fs.remove(fuse_path);
+    }
+  } else {
+    ok = false;
+  }
+
+  // Leave either a complete dump or none
+  if (!ok) {
+    Logger::error("Failed to write %s\n", fuse_path.c_str());
+    fs.remove(eeprom_path);
+    fs.remove(path);
+    return false;
+  }
+  Logger::info("Fuses written to %s\n", fuse_path.c_str());
+  return true;
+}
+
 bool ArduboyController::reset() {
   // Trigger reset by toggling reset pin
   Logger::info("Resetting Arduboy...");
@@ -171,26 +836,18 @@ void ArduboyController::printDeviceInfo() {
     return;
   }
 
-  if (!ispProgrammer->begin()) {
-    Logger::error("Failed to initialize ISP programmer");
-    return;
-  }
-
-  if (ispProgrammer->enterProgrammingMode()) {
-    ispProgrammer->printDeviceInfo();
-    ispProgrammer->printFuses();
-    ispProgrammer->exitProgrammingMode();
-  } else {
-    Logger::error("Failed to enter programming mode");
-  }
-
-  ispProgrammer->end();
+  ISPSession session(*ispProgrammer);
+  session.printDeviceInfo();
 }
 
 bool ArduboyController::powerOn() {
   Logger::info("Powering on Arduboy...");
 
-  digitalWrite(this->pinReset, HIGH);
+  if (bus) {
+    bus->setReset(false);
+  } else {
+    digitalWrite(this->pinReset, HIGH);
+  }
 
   // Give some time for power to stabilize
   delay(100);
@@ -202,7 +859,11 @@ bool ArduboyController::powerOn() {
 bool ArduboyController::powerOff() {
   Logger::info("Powering off Arduboy...");
 
-  digitalWrite(this->pinReset, LOW);
+  if (bus) {
+    bus->setReset(true);
+  } else {
+    digitalWrite(this->pinReset, LOW);
+  }
 
   Logger::info("Arduboy powered off");
   return true;
@@ -4,8 +4,43 @@
 #include <Arduino.h>
 #include <MacroLogger.h>
 #include <HexParser.h>
+#include <ArduboyPackage.h>
 #include <ISPProgrammer.h>
+#include <ISPSession.h>
 #include <FS.h>
+#include "ImageCache.h"
+
+// Depth of the parser to programmer page queue; two pages double buffer
+// the page being written and the page being parsed
+#define FLASH_PIPELINE_DEPTH 2
+#define FLASH_PIPELINE_STACK 6144
+
+// Bytes per read while dumping the target to a file
+#define DUMP_CHUNK_SIZE 1024
+
+// Largest boot section of the supported devices
+#define BOOTLOADER_MAX_SIZE 8192
+
+// Bootloader image kept across chip erases. Start and size are multiples
+// of HEX_PARSER_MAX_PAGE_SIZE, so they are page aligned on every device.
+struct BootloaderImage {
+  uint8_t signature[3];  // device it was read from, zero if loaded from a file
+  uint32_t start;
+  uint32_t size;
+  uint8_t* data;
+};
+
+// Timing of the last flash() call
+struct FlashStats {
+  uint32_t pages;       // pages written
+  uint32_t elapsed_ms;  // whole flash, including erase
+  uint32_t sd_us;       // SD read and HEX decode time of the parser task
+  uint32_t stall_us;    // programmer waiting for the parser
+  uint32_t hidden_us;   // SD time overlapped with page writes
+  bool skipped;         // image was already on the device
+  bool cached;          // pages came from the image cache
+  uint32_t patches;     // bit n: patch n of the patch set was applied
+};
 
 class ArduboyController {
  private:
@@ -13,6 +48,36 @@ class ArduboyController {
   ISPProgrammer* ispProgrammer = nullptr;
   bool initialized = false;
   uint8_t pinReset = 0;
+  ISPBus* bus = nullptr;  // set when not using the hardware SPI bus
+  bool skipIdentical = true;
+  bool pipelined = true;
+  FlashStats lastFlash = {};
+  bool preserveBootloader = false;
+  bool bootActive = false;      // bootloader is merged into this flash
+  BootloaderImage bootloader = {};
+  uint32_t appLimit = 0;        // application pages must lie below this
+  bool appOverlap = false;      // last parse hit the boot section
+  fs::FS* imageCacheFs = nullptr;
+  ImageCache imageCache;
+  PatchEngine patchEngine;
+
+  bool begin(ISPProgrammer* programmer, uint32_t hexBufferSize);
+  bool flashImage(ImageLoader& loader, File& file);
+  bool streamPages(ImageLoader& loader, HexParser::page_sink_t sink, void* ctx,
+                   uint32_t* patches);
+  bool streamCachedPages(HexParser::page_sink_t sink, void* ctx, uint32_t* patches);
+  void finishImageCache(File& file, bool commit);
+  bool isImageOnDevice(ImageLoader& loader);
+  bool flashStreaming(ImageLoader& loader);
+  bool flashPipelined(ImageLoader& loader);
+  static void pipelineProducer(void* param);
+  bool flashBuffered(ImageLoader& loader);
+  bool prepareBootloader(const FuseInfo& fuses);
+  bool verifyBootloader();
+  bool writeBootloader();
+  bool finishBootSection(const FuseInfo& fuses);
+  bool dumpMemory(fs::FS& fs, const String& path, ImageFormat format, bool eeprom,
+                  uint32_t size, uint8_t* chunk);
 
  public:
   ArduboyController();
@@ -22,11 +87,43 @@ class ArduboyController {
   bool begin(uint8_t pinReset) {
     return begin(pinReset, 32768); // 32KB for ATmega32U4
   }
+  // Drive the target through another bus, e.g. a simulated target
+  bool begin(ISPBus& bus, uint32_t hexBufferSize);
 
   void end();
 
+  // Skip erase and programming when the device already holds the image
+  void setSkipIdentical(bool enabled) { skipIdentical = enabled; }
+  // Parse the next page in a separate task while the current one is written
+  void setPipelined(bool enabled) { pipelined = enabled; }
+  const FlashStats& getLastFlashStats() const { return lastFlash; }
+  void printFlashStats() const;
+
+  // Keep the bootloader when flashing: the image is merged with a cached
+  // bootloader, which is read from the device on first use unless one was
+  // loaded from a HEX file.
+  void setPreserveBootloader(bool enabled) { preserveBootloader = enabled; }
+  bool loadBootloader(File& file);
+  void clearBootloader();
+  bool hasBootloader() const { return bootloader.data != nullptr; }
+
+  // Keep the decoded image next to each image file on this filesystem and
+  // flash from it while the file is unchanged. nullptr turns it off.
+  void setImageCache(fs::FS* fs) { imageCacheFs = fs; }
+
+  // Replace the built-in patch set with the patches of a patch set file
+  bool loadPatches(File& file);
+  const PatchEngine& getPatchEngine() const { return patchEngine; }
+
   bool checkConnection();
+  // Flash a HEX, raw ".bin" or ".elf" file, or the HEX entry of an
+  // .arduboy package. Runs in a single programming session, so a separate
+  // checkConnection() beforehand is not needed.
   bool flash(File& file);
+  // Back up the target: flash to path as Intel HEX, or raw if it ends in
+  // ".bin", the EEPROM next to it as ".eep" (".eep.bin") and the fuses as
+  // text in ".fuses"
+  bool dump(fs::FS& fs, const char* path);
   bool reset();
   bool powerOn();
   bool powerOff();
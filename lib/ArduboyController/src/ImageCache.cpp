@@ -0,0 +1,244 @@
+#include "ImageCache.h"
+
+#include <Crc32.h>
+#include <new>
+#include <stddef.h>
+
+ImageCache::~ImageCache() {
+  close();
+  releaseCapture();
+}
+
+String ImageCache::pathFor(const char* hex_path) {
+  String path(hex_path);
+  if (path.endsWith(".hex")) {
+    path.remove(path.length() - 4);
+  }
+  return path + IMAGE_CACHE_EXTENSION;
+}
+
+uint32_t ImageCache::headerCrc(uint32_t crc, const ImageCacheHeader& header) {
+  return crc32Update(crc, reinterpret_cast<const uint8_t*>(&header),
+                     offsetof(ImageCacheHeader, crc));
+}
+
+bool ImageCache::open(fs::FS& fs, File& hex, uint16_t page_size,
+                      uint32_t patch_set) {
+  close();
+
+  // A capture of this flash goes next to the image, whether or not there
+  // is a cache yet
+  this->fs = &fs;
+  cache_path = pathFor(hex.path());
+  String path = cache_path;
+  if (!fs.exists(path)) {
+    return false;
+  }
+  file = fs.open(path, FILE_READ);
+  if (!file) {
+    return false;
+  }
+
+  if (file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) ||
+      header.magic != IMAGE_CACHE_MAGIC || header.version != IMAGE_CACHE_VERSION) {
+    return invalidate("unknown format");
+  }
+  if (header.source_size != hex.size() ||
+      header.source_mtime != (uint32_t)hex.getLastWrite()) {
+    return invalidate("HEX file changed");
+  }
+  if (header.patch_set != patch_set) {
+    return invalidate("patch set changed");
+  }
+  if (header.page_size != page_size) {
+    // Made for another device, keep it
+    Logger::info("Image cache page size %d does not match, not used\n", header.page_size);
+    close();
+    return false;
+  }
+
+  uint32_t table_size = header.page_count * sizeof(uint16_t);
+  uint32_t pages_size = header.page_count * page_size;
+  if (header.page_count > 0x10000 || file.size() != sizeof(header) + pages_size + table_size) {
+    return invalidate("truncated");
+  }
+  page_table = new (std::nothrow) uint16_t[header.page_count ? header.page_count : 1];
+  if (!page_table) {
+    Logger::error("Not enough memory for image cache page table");
+    close();
+    return false;
+  }
+  if (!file.seek(sizeof(header) + pages_size) ||
+      file.read(reinterpret_cast<uint8_t*>(page_table), table_size) != table_size) {
+    return invalidate("truncated");
+  }
+
+  Logger::info("Using image cache %s (%d pages)\n", path.c_str(), header.page_count);
+  return true;
+}
+
+void ImageCache::close() {
+  if (file) {
+    file.close();
+  }
+  delete[] page_table;
+  page_table = nullptr;
+  header = ImageCacheHeader();
+}
+
+// Remove a cache that cannot be used, the next HEX flash writes a new one
+bool ImageCache::invalidate(const char* reason) {
+  String path = file ? String(file.path()) : String();
+  Logger::info("Image cache %s %s, removing it\n", path.c_str(), reason);
+  close();
+  if (fs && path.length() > 0) {
+    fs->remove(path);
+  }
+  return false;
+}
+
+uint32_t ImageCache::getImageEnd() const {
+  if (!page_table) return 0;
+  uint32_t end = 0;
+  for (uint32_t i = 0; i < header.page_count; i++) {
+    if (page_table[i] + 1U > end) end = page_table[i] + 1U;
+  }
+  return end * header.page_size;
+}
+
+bool ImageCache::readPages(HexParser::page_sink_t sink, void* ctx) {
+  if (!page_table || !file.seek(sizeof(header))) {
+    return false;
+  }
+
+  uint32_t crc = CRC32_INIT;
+  for (uint32_t i = 0; i < header.page_count; i++) {
+    if (file.read(page, header.page_size) != header.page_size) {
+      return invalidate("truncated");
+    }
+    crc = crc32Update(crc, page, header.page_size);
+    if (!sink(page_table[i] * header.page_size, page, header.page_size, ctx)) {
+      return false;
+    }
+  }
+
+  crc = headerCrc(crc, header);
+  crc = crc32Update(crc, reinterpret_cast<const uint8_t*>(page_table),
+                    header.page_count * sizeof(uint16_t));
+  if (crc32Final(crc) != header.crc) {
+    return invalidate("CRC mismatch");
+  }
+  return true;
+}
+
+// Only the page table is kept in memory, the pages are written to the
+// temporary file as they come
+bool ImageCache::beginCapture(uint32_t limit, uint16_t page_size) {
+  if (capture_complete && limit == capture_limit && page_size == capture_page_size) {
+    return false;
+  }
+  releaseCapture();
+  if (!fs || cache_path.length() == 0) {
+    return false;
+  }
+  uint32_t page_count = limit / page_size;
+  capture_table = new (std::nothrow) uint16_t[page_count ? page_count : 1];
+  capture_file = fs->open(tempPath(), FILE_WRITE);
+  if (!capture_table || !capture_file) {
+    Logger::info("Cannot capture the image cache %s\n", tempPath().c_str());
+    releaseCapture();
+    return false;
+  }
+  // The header is filled in by commit()
+  ImageCacheHeader blank = {};
+  capture_ok = capture_file.write(reinterpret_cast<const uint8_t*>(&blank), sizeof(blank)) ==
+               sizeof(blank);
+  capture_pages = 0;
+  capture_limit = limit;
+  capture_page_size = page_size;
+  capture_crc = CRC32_INIT;
+  return true;
+}
+
+void ImageCache::capturePage(uint32_t address, const uint8_t* data) {
+  if (!capture_ok) {
+    return;
+  }
+  if (address % capture_page_size != 0 || address + capture_page_size > capture_limit ||
+      capture_pages >= capture_limit / capture_page_size ||
+      capture_file.write(data, capture_page_size) != capture_page_size) {
+    capture_ok = false;
+    return;
+  }
+  capture_table[capture_pages++] = address / capture_page_size;
+  capture_crc = crc32Update(capture_crc, data, capture_page_size);
+}
+
+void ImageCache::endCapture(bool complete, uint32_t patch_set, uint32_t patches) {
+  capture_complete = capture_table && capture_ok && complete;
+  capture_patch_set = patch_set;
+  capture_patches = patches;
+}
+
+// The pages are in the temporary file already, so a power loss never
+// leaves a truncated cache under the real name
+bool ImageCache::commit(fs::FS& fs, File& hex) {
+  if (!capture_complete) {
+    return false;
+  }
+  capture_complete = false;
+
+  ImageCacheHeader out = {};
+  out.magic = IMAGE_CACHE_MAGIC;
+  out.version = IMAGE_CACHE_VERSION;
+  out.page_size = capture_page_size;
+  out.source_size = hex.size();
+  out.source_mtime = (uint32_t)hex.getLastWrite();
+  out.page_count = capture_pages;
+  out.patch_set = capture_patch_set;
+  out.patches = capture_patches;
+  const uint8_t* table = reinterpret_cast<const uint8_t*>(capture_table);
+  uint32_t table_size = capture_pages * sizeof(uint16_t);
+
+  uint32_t crc = headerCrc(capture_crc, out);
+  crc = crc32Update(crc, table, table_size);
+  out.crc = crc32Final(crc);
+
+  bool ok = capture_file.write(table, table_size) == table_size && capture_file.seek(0) &&
+            capture_file.write(reinterpret_cast<const uint8_t*>(&out), sizeof(out)) == sizeof(out);
+  capture_file.close();
+
+  // Not atomic: FAT cannot rename over a file, so the old cache goes first.
+  // A power loss in between leaves no cache and a complete .tmp, which only
+  // costs a full parse and is overwritten by the next commit. Fine for a
+  // cache, not for files that must always exist.
+  String path = cache_path;
+  String temp = tempPath();
+  if (ok && fs.exists(path)) {
+    ok = fs.remove(path);
+  }
+  if (!ok || !fs.rename(temp, path)) {
+    Logger::error("Failed to write image cache %s\n", path.c_str());
+    fs.remove(temp);
+    return false;
+  }
+  Logger::info("Wrote image cache %s (%d pages)\n", path.c_str(), capture_pages);
+  return true;
+}
+
+// A capture that was not committed leaves no file behind
+void ImageCache::releaseCapture() {
+  if (capture_file) {
+    capture_file.close();
+    if (fs) {
+      fs->remove(tempPath());
+    }
+  }
+  delete[] capture_table;
+  capture_table = nullptr;
+  capture_pages = 0;
+  capture_limit = 0;
+  capture_page_size = 0;
+  capture_ok = false;
+  capture_complete = false;
+}
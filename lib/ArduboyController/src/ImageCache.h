@@ -0,0 +1,101 @@
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <MacroLogger.h>
+#include <HexParser.h>
+
+// Decoded and patched flash image stored next to its HEX file, so later
+// flashes read only the used pages instead of parsing the HEX file again.
+#define IMAGE_CACHE_EXTENSION ".fximg"
+#define IMAGE_CACHE_MAGIC     0x474D4946UL  // "FIMG"
+#define IMAGE_CACHE_VERSION   3
+
+// File layout: this header, page_count pages of page_size bytes in the
+// order they were parsed, then the table of their page numbers, one
+// uint16_t per page. The CRC covers the pages, then the header up to the
+// crc field and the table, so the pages can be written as they are parsed
+// and the header and table filled in last.
+struct ImageCacheHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t page_size;
+  uint32_t source_size;   // HEX file the image was decoded from
+  uint32_t source_mtime;
+  uint32_t page_count;    // pages stored
+  uint32_t patch_set;     // PatchEngine set id the image was patched with
+  uint32_t patches;       // patches of that set that were applied
+  uint32_t crc;
+};
+
+static_assert(sizeof(ImageCacheHeader) == 32, "image cache header must not be padded");
+
+class ImageCache {
+ private:
+  fs::FS* fs = nullptr;
+  File file;
+  ImageCacheHeader header = {};
+  uint16_t* page_table = nullptr;  // page number of every stored page
+  uint8_t page[HEX_PARSER_MAX_PAGE_SIZE];
+
+  String cache_path;  // of the image file last passed to open()
+
+  // Image captured from a HEX parse. The pages go straight to the
+  // temporary cache file, commit() appends the table and fills in the
+  // header.
+  File capture_file;
+  uint16_t* capture_table = nullptr;
+  uint32_t capture_pages = 0;
+  uint32_t capture_limit = 0;
+  uint16_t capture_page_size = 0;
+  uint32_t capture_crc = 0;
+  bool capture_ok = false;
+  bool capture_complete = false;
+  uint32_t capture_patch_set = 0;
+  uint32_t capture_patches = 0;
+
+  static uint32_t headerCrc(uint32_t crc, const ImageCacheHeader& header);
+  String tempPath() const { return cache_path + ".tmp"; }
+  bool invalidate(const char* reason);
+
+ public:
+  ImageCache() {}
+  ~ImageCache();
+
+  // Cache path of a HEX file or package: ".hex" is replaced, other names
+  // keep their extension so a package and a HEX file of the same name do
+  // not share a cache
+  static String pathFor(const char* hex_path);
+
+  // Open the cache of a HEX file. Fails if there is none or it was made
+  // from another version of the file, for another page size or with
+  // another patch set.
+  bool open(fs::FS& fs, File& hex, uint16_t page_size, uint32_t patch_set);
+  void close();
+  bool isOpen() const { return page_table != nullptr; }
+  uint32_t getPatches() const { return header.patches; }
+  uint32_t getUsedPages() const { return header.page_count; }
+  // First address after the last cached page
+  uint32_t getImageEnd() const;
+
+  // Hand every cached page to the sink in the order it was parsed, as a
+  // streaming parse of the image would. The CRC is checked
+  // after the last page; a corrupt cache is removed and closed, so callers
+  // can tell it from a sink failure with isOpen().
+  bool readPages(HexParser::page_sink_t sink, void* ctx);
+
+  // Record the pages of a HEX parse below limit into a temporary cache file
+  // next to the image last passed to open(). Only the page table is kept in
+  // memory. A complete capture of an earlier parse in the same flash is
+  // kept and false returned. Call endCapture() when the parse is over and
+  // commit() to keep the file.
+  bool beginCapture(uint32_t limit, uint16_t page_size);
+  void capturePage(uint32_t address, const uint8_t* data);
+  void endCapture(bool complete, uint32_t patch_set, uint32_t patches);
+  bool hasCapture() const { return capture_complete; }
+  bool commit(fs::FS& fs, File& hex);
+  void releaseCapture();
+};
+
+#endif  // IMAGE_CACHE_H
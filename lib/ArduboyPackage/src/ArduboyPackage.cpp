@@ -0,0 +1,199 @@
+#include "ArduboyPackage.h"
+
+#include <new>
+#include <strings.h>
+
+static const char* baseName(const char* path) {
+  const char* slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+static bool endsWithIgnoreCase(const char* text, const char* suffix) {
+  size_t text_length = strlen(text);
+  size_t suffix_length = strlen(suffix);
+  return text_length >= suffix_length &&
+         strcasecmp(text + text_length - suffix_length, suffix) == 0;
+}
+
+bool ArduboyPackage::isPackage(const char* path) {
+  return endsWithIgnoreCase(path, PACKAGE_EXTENSION);
+}
+
+bool ArduboyPackage::collectEntry(const ZipEntry& entry, void* ctx) {
+  ArduboyPackage& package = *static_cast<ArduboyPackage*>(ctx);
+  const char* name = baseName(entry.name);
+  if (strcasecmp(name, PACKAGE_INFO_NAME) == 0 && !package.has_info) {
+    package.info_entry = entry;
+    package.has_info = true;
+  } else if (endsWithIgnoreCase(name, ".hex") &&
+             package.binary_count < PACKAGE_MAX_BINARIES) {
+    package.binaries[package.binary_count++] = entry;
+  }
+  return true;
+}
+
+// Read a JSON string starting at the opening quote. Escapes are decoded,
+// \u escapes to UTF-8.
+static String readJsonString(const char* json, size_t length, size_t& pos) {
+  String value;
+  for (pos++; pos < length && json[pos] != '"'; pos++) {
+    char c = json[pos];
+    if (c != '\\' || pos + 1 >= length) {
+      value += c;
+      continue;
+    }
+    c = json[++pos];
+    switch (c) {
+      case 'n': value += '\n'; break;
+      case 'r': value += '\r'; break;
+      case 't': value += '\t'; break;
+      case 'b': value += '\b'; break;
+      case 'f': value += '\f'; break;
+      case 'u': {
+        if (pos + 4 >= length) break;
+        char hex[5] = {json[pos + 1], json[pos + 2], json[pos + 3], json[pos + 4], 0};
+        uint16_t code = strtoul(hex, nullptr, 16);
+        pos += 4;
+        if (code < 0x80) {
+          value += (char)code;
+        } else if (code < 0x800) {
+          value += (char)(0xC0 | (code >> 6));
+          value += (char)(0x80 | (code & 0x3F));
+        } else {
+          value += (char)(0xE0 | (code >> 12));
+          value += (char)(0x80 | ((code >> 6) & 0x3F));
+          value += (char)(0x80 | (code & 0x3F));
+        }
+        break;
+      }
+      default: value += c; break;
+    }
+  }
+  return value;
+}
+
+// Pick the top level string fields and the file name of the first binary
+// out of info.json. Anything else is skipped without building a tree.
+static void parseInfo(const char* json, size_t length, PackageInfo& info, String& binary) {
+  uint8_t depth = 0;
+  String key;
+  String container;  // top level key of the array or object being read
+  bool value = false;
+
+  for (size_t pos = 0; pos < length; pos++) {
+    char c = json[pos];
+    if (c == '"') {
+      String text = readJsonString(json, length, pos);
+      if (!value) {
+        key = text;
+        continue;
+      }
+      value = false;
+      if (depth == 1) {
+        if (key == "title") info.title = text;
+        else if (key == "author") info.author = text;
+        else if (key == "date") info.date = text;
+        else if (key == "description") info.description = text;
+        else if (key == "license") info.license = text;
+        else if (key == "version") info.version = text;
+      } else if (depth == 3 && container == "binaries" && key == "filename" &&
+                 binary.length() == 0) {
+        binary = text;
+      }
+    } else if (c == ':') {
+      value = true;
+    } else if (c == '{' || c == '[') {
+      if (depth == 1) container = key;
+      depth++;
+      value = false;
+    } else if (c == '}' || c == ']') {
+      if (depth > 0) depth--;
+      value = false;
+    } else if (c == ',') {
+      value = false;
+    }
+  }
+}
+
+bool ArduboyPackage::readInfo(String& binary) {
+  if (!stream.open(*file, info_entry)) {
+    return false;
+  }
+  uint32_t length = info_entry.size < PACKAGE_INFO_MAX ? info_entry.size : PACKAGE_INFO_MAX;
+  char* json = new (std::nothrow) char[length + 1];
+  if (!json) {
+    Logger::error("Not enough memory for %s\n", PACKAGE_INFO_NAME);
+    stream.close();
+    return false;
+  }
+
+  uint32_t filled = 0;
+  while (filled < length) {
+    int count = stream.read(reinterpret_cast<uint8_t*>(json) + filled, length - filled);
+    if (count <= 0) break;
+    filled += count;
+  }
+  stream.close();
+
+  bool ok = filled == length;
+  if (ok) {
+    parseInfo(json, length, info, binary);
+  }
+  delete[] json;
+  return ok;
+}
+
+bool ArduboyPackage::open(File& file) {
+  close();
+  this->file = &file;
+
+  if (!zip.open(file) || !zip.forEachEntry(collectEntry, this)) {
+    return false;
+  }
+
+  String binary;
+  if (has_info && !readInfo(binary)) {
+    Logger::error("Failed to read %s from %s\n", PACKAGE_INFO_NAME, file.name());
+  }
+
+  // The binary named in info.json, otherwise the first HEX file
+  for (uint8_t i = 0; i < binary_count && !hex_entry; i++) {
+    if (binary.length() > 0 && strcasecmp(baseName(binaries[i].name), baseName(binary.c_str())) == 0) {
+      hex_entry = &binaries[i];
+    }
+  }
+  if (!hex_entry && binary_count > 0) {
+    hex_entry = &binaries[0];
+  }
+
+  if (hex_entry) {
+    Logger::info("Package %s: %s, %s (%d bytes)\n", file.name(), info.title.c_str(),
+                 hex_entry->name, hex_entry->size);
+  } else {
+    Logger::info("Package %s has no HEX file\n", file.name());
+  }
+  return true;
+}
+
+void ArduboyPackage::close() {
+  stream.close();
+  file = nullptr;
+  binary_count = 0;
+  has_info = false;
+  hex_entry = nullptr;
+  info = PackageInfo();
+}
+
+const char* ArduboyPackage::name() const { return hex_entry ? hex_entry->name : ""; }
+
+uint32_t ArduboyPackage::size() const { return hex_entry ? hex_entry->size : 0; }
+
+bool ArduboyPackage::rewind() {
+  if (!hex_entry) return false;
+  return stream.isOpen() ? stream.rewind() : stream.open(*file, *hex_entry);
+}
+
+int ArduboyPackage::read(uint8_t* buffer, size_t length) {
+  if (!stream.isOpen() && !rewind()) return -1;
+  return stream.read(buffer, length);
+}
@@ -0,0 +1,63 @@
+#ifndef ARDUBOY_PACKAGE_H
+#define ARDUBOY_PACKAGE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <MacroLogger.h>
+#include <HexSource.h>
+#include "ZipReader.h"
+
+#define PACKAGE_EXTENSION ".arduboy"
+#define PACKAGE_INFO_NAME "info.json"
+// Larger info.json files are cut, the fields of interest come first
+#define PACKAGE_INFO_MAX  4096
+// HEX entries remembered while the directory is scanned
+#define PACKAGE_MAX_BINARIES 4
+
+// Fields of info.json shown in the game library
+struct PackageInfo {
+  String title;
+  String author;
+  String date;
+  String description;
+  String license;
+  String version;
+};
+
+// An .arduboy package: a zip file with info.json, one or more HEX files, FX
+// data and screenshots. open() reads the directory and info.json; the HEX
+// entry of the first binary in info.json is then read as a HexSource,
+// inflated on the fly, without unpacking anything to the card.
+class ArduboyPackage : public HexSource {
+ private:
+  File* file = nullptr;
+  ZipReader zip;
+  ZipEntry binaries[PACKAGE_MAX_BINARIES];
+  uint8_t binary_count = 0;
+  ZipEntry info_entry = {};
+  bool has_info = false;
+  const ZipEntry* hex_entry = nullptr;
+  ZipEntryStream stream;
+  PackageInfo info;
+
+  static bool collectEntry(const ZipEntry& entry, void* ctx);
+  bool readInfo(String& binary);
+
+ public:
+  ArduboyPackage() {}
+
+  static bool isPackage(const char* path);
+
+  bool open(File& file);
+  void close();
+  const PackageInfo& getInfo() const { return info; }
+  bool hasHex() const { return hex_entry != nullptr; }
+
+  // HexSource over the HEX entry
+  const char* name() const override;
+  uint32_t size() const override;
+  bool rewind() override;
+  int read(uint8_t* buffer, size_t length) override;
+};
+
+#endif  // ARDUBOY_PACKAGE_H
@@ -0,0 +1,359 @@
+#include "Inflate.h"
+
+#include <new>
+
+// Base values and extra bits of the length and distance symbols
+static const uint16_t kLengthBase[29] = {3,  4,  5,  6,  7,  8,  9,  10, 11,  13,
+                                         15, 17, 19, 23, 27, 31, 35, 43, 51,  59,
+                                         67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2,
+                                         2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t kDistanceBase[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,    97,    129,
+    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,  4,  4,  5,  5,  6,
+                                           6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+// Order of the code length code lengths in a dynamic block header
+static const uint8_t kCodeLengthOrder[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                             11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+Inflater::~Inflater() { end(); }
+
+bool Inflater::begin(uint32_t output_size, input_fn input, void* ctx) {
+  // Distances never reach back before the first byte, so the window only
+  // has to cover the whole output when that is smaller than 32 KB
+  uint32_t size = 1;
+  while (size < output_size && size < INFLATE_MAX_WINDOW) size <<= 1;
+  if (size != window_size) {
+    end();
+    window = new (std::nothrow) uint8_t[size];
+    if (!window) {
+      Logger::error("Not enough memory for the inflate window");
+      return false;
+    }
+    window_size = size;
+  }
+
+  this->input = input;
+  input_ctx = ctx;
+  in_pos = 0;
+  in_len = 0;
+  input_end = false;
+  bit_buffer = 0;
+  bit_count = 0;
+  total_out = 0;
+  mode = Mode::HEADER;
+  last_block = false;
+  stored_left = 0;
+  copy_left = 0;
+  copy_distance = 0;
+  return true;
+}
+
+void Inflater::end() {
+  delete[] window;
+  window = nullptr;
+  window_size = 0;
+}
+
+bool Inflater::fail(const char* reason) {
+  if (mode != Mode::FAILED) {
+    Logger::error("Inflate failed: %s\n", reason);
+  }
+  mode = Mode::FAILED;
+  return false;
+}
+
+bool Inflater::refill() {
+  int count = input_end ? 0 : input(in, sizeof(in), input_ctx);
+  if (count <= 0) {
+    input_end = true;
+    return fail(count < 0 ? "read error" : "unexpected end of data");
+  }
+  in_pos = 0;
+  in_len = count;
+  return true;
+}
+
+bool Inflater::needBits(uint8_t count) {
+  while (bit_count < count) {
+    if (in_pos == in_len && !refill()) return false;
+    bit_buffer |= (uint32_t)in[in_pos++] << bit_count;
+    bit_count += 8;
+  }
+  return true;
+}
+
+uint32_t Inflater::takeBits(uint8_t count) {
+  uint32_t bits = bit_buffer & ((1UL << count) - 1);
+  bit_buffer >>= count;
+  bit_count -= count;
+  return bits;
+}
+
+// Table lookup for short codes. Longer codes and the last few bits of the
+// stream go the canonical way, one bit at a time.
+int Inflater::decode(const Huffman& table) {
+  while (bit_count < INFLATE_FAST_BITS) {
+    if (in_pos == in_len) {
+      if (input_end) break;
+      int count = input(in, sizeof(in), input_ctx);
+      if (count < 0) {
+        fail("read error");
+        return -1;
+      }
+      if (count == 0) {
+        input_end = true;
+        break;
+      }
+      in_pos = 0;
+      in_len = count;
+    }
+    bit_buffer |= (uint32_t)in[in_pos++] << bit_count;
+    bit_count += 8;
+  }
+  uint16_t entry = table.fast[bit_buffer & ((1 << INFLATE_FAST_BITS) - 1)];
+  if (entry && (entry & 0x0F) <= bit_count) {
+    takeBits(entry & 0x0F);
+    return entry >> 4;
+  }
+
+  int code = 0;
+  int first = 0;
+  int index = 0;
+  for (uint8_t length = 1; length < 16; length++) {
+    if (!needBits(1)) return -1;
+    code |= takeBits(1);
+    int count = table.count[length];
+    if (code - count < first) {
+      return table.symbol[index + (code - first)];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  fail("invalid code");
+  return -1;
+}
+
+bool Inflater::build(Huffman& table, const uint8_t* code_lengths, uint16_t count) {
+  memset(table.count, 0, sizeof(table.count));
+  for (uint16_t i = 0; i < count; i++) table.count[code_lengths[i]]++;
+  table.count[0] = 0;
+
+  int left = 1;
+  for (uint8_t length = 1; length < 16; length++) {
+    left = (left << 1) - table.count[length];
+    if (left < 0) return false;  // over-subscribed
+  }
+
+  uint16_t offset[16];
+  uint16_t next_code[16];
+  offset[1] = 0;
+  next_code[1] = 0;
+  for (uint8_t length = 1; length < 15; length++) {
+    offset[length + 1] = offset[length] + table.count[length];
+    next_code[length + 1] = (next_code[length] + table.count[length]) << 1;
+  }
+
+  memset(table.fast, 0, sizeof(table.fast));
+  for (uint16_t symbol = 0; symbol < count; symbol++) {
+    uint8_t length = code_lengths[symbol];
+    if (!length) continue;
+    table.symbol[offset[length]++] = symbol;
+
+    uint16_t code = next_code[length]++;
+    if (length > INFLATE_FAST_BITS) continue;
+    // Codes are stored most significant bit first
+    uint16_t reversed = 0;
+    for (uint8_t bit = 0; bit < length; bit++) {
+      reversed = (reversed << 1) | ((code >> bit) & 1);
+    }
+    for (uint16_t i = reversed; i < (1 << INFLATE_FAST_BITS); i += 1 << length) {
+      table.fast[i] = (symbol << 4) | length;
+    }
+  }
+  return true;
+}
+
+bool Inflater::readDynamicTables() {
+  if (!needBits(14)) return false;
+  uint16_t literal_count = takeBits(5) + 257;
+  uint8_t distance_count = takeBits(5) + 1;
+  uint8_t code_length_count = takeBits(4) + 4;
+  if (literal_count > 286 || distance_count > 30) {
+    return fail("bad table sizes");
+  }
+
+  uint8_t code_lengths[286 + 30] = {};
+  for (uint8_t i = 0; i < code_length_count; i++) {
+    if (!needBits(3)) return false;
+    code_lengths[kCodeLengthOrder[i]] = takeBits(3);
+  }
+  if (!build(lengths, code_lengths, 19)) {
+    return fail("bad code length code");
+  }
+
+  uint16_t total = literal_count + distance_count;
+  uint16_t index = 0;
+  memset(code_lengths, 0, sizeof(code_lengths));
+  while (index < total) {
+    int symbol = decode(lengths);
+    if (symbol < 0) return false;
+    if (symbol < 16) {
+      code_lengths[index++] = symbol;
+      continue;
+    }
+
+    uint8_t length = 0;
+    uint8_t repeat;
+    if (symbol == 16) {
+      if (index == 0) return fail("repeat without a length");
+      length = code_lengths[index - 1];
+      if (!needBits(2)) return false;
+      repeat = 3 + takeBits(2);
+    } else if (symbol == 17) {
+      if (!needBits(3)) return false;
+      repeat = 3 + takeBits(3);
+    } else {
+      if (!needBits(7)) return false;
+      repeat = 11 + takeBits(7);
+    }
+    if (index + repeat > total) return fail("too many code lengths");
+    while (repeat--) code_lengths[index++] = length;
+  }
+
+  if (code_lengths[256] == 0) return fail("no end of block code");
+  if (!build(lengths, code_lengths, literal_count) ||
+      !build(distances, code_lengths + literal_count, distance_count)) {
+    return fail("bad code lengths");
+  }
+  return true;
+}
+
+bool Inflater::beginBlock() {
+  if (!needBits(3)) return false;
+  last_block = takeBits(1);
+  switch (takeBits(2)) {
+    case 0: {
+      takeBits(bit_count % 8);
+      if (!needBits(32)) return false;
+      uint16_t length = takeBits(16);
+      uint16_t inverted = takeBits(16);
+      if ((uint16_t)~length != inverted) return fail("bad stored block length");
+      stored_left = length;
+      mode = Mode::STORED;
+      return true;
+    }
+    case 1: {
+      uint8_t code_lengths[288];
+      memset(code_lengths, 8, 144);
+      memset(code_lengths + 144, 9, 112);
+      memset(code_lengths + 256, 7, 24);
+      memset(code_lengths + 280, 8, 8);
+      build(lengths, code_lengths, 288);
+      memset(code_lengths, 5, 30);
+      build(distances, code_lengths, 30);
+      mode = Mode::HUFFMAN;
+      return true;
+    }
+    case 2:
+      if (!readDynamicTables()) return false;
+      mode = Mode::HUFFMAN;
+      return true;
+    default:
+      return fail("bad block type");
+  }
+}
+
+int Inflater::read(uint8_t* out, size_t length) {
+  if (!window || mode == Mode::FAILED) return -1;
+  const uint32_t mask = window_size - 1;
+  size_t produced = 0;
+
+  while (produced < length) {
+    if (copy_left) {
+      uint32_t count = copy_left < length - produced ? copy_left : length - produced;
+      copy_left -= count;
+      while (count--) {
+        uint8_t byte = window[(total_out - copy_distance) & mask];
+        window[total_out++ & mask] = byte;
+        out[produced++] = byte;
+      }
+      continue;
+    }
+
+    switch (mode) {
+      case Mode::HEADER:
+        if (last_block) {
+          mode = Mode::DONE;
+        } else if (!beginBlock()) {
+          return -1;
+        }
+        break;
+
+      case Mode::STORED: {
+        if (stored_left == 0) {
+          mode = Mode::HEADER;
+          break;
+        }
+        uint8_t byte;
+        if (bit_count >= 8) {
+          byte = takeBits(8);
+        } else {
+          if (in_pos == in_len && !refill()) return -1;
+          byte = in[in_pos++];
+        }
+        window[total_out++ & mask] = byte;
+        out[produced++] = byte;
+        stored_left--;
+        break;
+      }
+
+      case Mode::HUFFMAN: {
+        int symbol = decode(lengths);
+        if (symbol < 0) return -1;
+        if (symbol < 256) {
+          window[total_out++ & mask] = symbol;
+          out[produced++] = symbol;
+          break;
+        }
+        if (symbol == 256) {
+          mode = Mode::HEADER;
+          break;
+        }
+
+        symbol -= 257;
+        if (symbol >= 29) {
+          fail("bad length symbol");
+          return -1;
+        }
+        if (!needBits(kLengthExtra[symbol])) return -1;
+        uint32_t copy_length = kLengthBase[symbol] + takeBits(kLengthExtra[symbol]);
+
+        symbol = decode(distances);
+        if (symbol < 0) return -1;
+        if (symbol >= 30) {
+          fail("bad distance symbol");
+          return -1;
+        }
+        if (!needBits(kDistanceExtra[symbol])) return -1;
+        uint32_t distance = kDistanceBase[symbol] + takeBits(kDistanceExtra[symbol]);
+        if (distance > total_out || distance > window_size) {
+          fail("distance too far back");
+          return -1;
+        }
+        copy_left = copy_length;
+        copy_distance = distance;
+        break;
+      }
+
+      case Mode::DONE:
+        return produced;
+
+      case Mode::FAILED:
+        return -1;
+    }
+  }
+  return produced;
+}
@@ -0,0 +1,76 @@
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include <Arduino.h>
+#include <MacroLogger.h>
+
+// Largest DEFLATE back reference distance
+#define INFLATE_MAX_WINDOW 32768
+// Compressed bytes fetched from the input per refill
+#define INFLATE_INPUT_CHUNK 512
+// Huffman codes up to this length are decoded with one table lookup,
+// longer ones bit by bit
+#define INFLATE_FAST_BITS 9
+
+// Streaming DEFLATE (RFC 1951) decoder. Output is produced on demand into
+// the caller's buffer, so a whole entry never has to be in memory. The
+// history window only needs to cover the output size, small entries get a
+// small window.
+class Inflater {
+ public:
+  // Supplies compressed bytes. Returns bytes read, 0 at the end of the
+  // input or -1 on a read error.
+  typedef int (*input_fn)(uint8_t* buffer, size_t length, void* ctx);
+
+ private:
+  struct Huffman {
+    uint16_t count[16];    // number of codes of each length
+    uint16_t symbol[288];  // symbols in canonical order
+    uint16_t fast[1 << INFLATE_FAST_BITS];  // symbol << 4 | length, 0 if longer
+  };
+
+  enum class Mode { HEADER, STORED, HUFFMAN, DONE, FAILED };
+
+  input_fn input = nullptr;
+  void* input_ctx = nullptr;
+  uint8_t in[INFLATE_INPUT_CHUNK];
+  uint16_t in_pos = 0;
+  uint16_t in_len = 0;
+  bool input_end = false;
+  uint32_t bit_buffer = 0;
+  uint8_t bit_count = 0;
+
+  uint8_t* window = nullptr;
+  uint32_t window_size = 0;
+  uint32_t total_out = 0;
+
+  Mode mode = Mode::HEADER;
+  bool last_block = false;
+  uint32_t stored_left = 0;
+  uint32_t copy_left = 0;
+  uint32_t copy_distance = 0;
+
+  Huffman lengths;
+  Huffman distances;
+
+  bool fail(const char* reason);
+  bool refill();
+  bool needBits(uint8_t count);
+  uint32_t takeBits(uint8_t count);
+  int decode(const Huffman& table);
+  static bool build(Huffman& table, const uint8_t* code_lengths, uint16_t count);
+  bool beginBlock();
+  bool readDynamicTables();
+
+ public:
+  Inflater() {}
+  ~Inflater();
+
+  // Start a stream that inflates to output_size bytes
+  bool begin(uint32_t output_size, input_fn input, void* ctx);
+  // Bytes inflated, 0 at the end of the stream, -1 on corrupt data
+  int read(uint8_t* out, size_t length);
+  void end();
+};
+
+#endif  // INFLATE_H
@@ -0,0 +1,189 @@
+#include "ZipReader.h"
+
+#include <Crc32.h>
+#include <new>
+
+#define ZIP_END_SIGNATURE       0x06054B50UL
+#define ZIP_DIRECTORY_SIGNATURE 0x02014B50UL
+#define ZIP_LOCAL_SIGNATURE     0x04034B50UL
+#define ZIP_END_SIZE            22
+#define ZIP_DIRECTORY_SIZE      46
+#define ZIP_LOCAL_SIZE          30
+#define ZIP_MAX_COMMENT         0xFFFF
+
+static inline uint16_t le16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static inline uint32_t le32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// The end record sits in front of an optional comment, search backwards
+// from the last place it can start
+bool ZipReader::findEndRecord(uint32_t& offset) {
+  uint32_t size = file->size();
+  if (size < ZIP_END_SIZE) return false;
+  uint32_t lowest = size > ZIP_END_SIZE + ZIP_MAX_COMMENT ? size - ZIP_END_SIZE - ZIP_MAX_COMMENT : 0;
+
+  uint8_t buffer[256];
+  uint32_t last = size - ZIP_END_SIZE;  // last possible start still to check
+  while (true) {
+    uint32_t first = last > lowest + sizeof(buffer) - 4 ? last - (sizeof(buffer) - 4) : lowest;
+    uint32_t length = last - first + 4;
+    if (!file->seek(first) || file->read(buffer, length) != length) return false;
+    for (uint32_t i = length - 4 + 1; i-- > 0;) {
+      if (le32(buffer + i) == ZIP_END_SIGNATURE) {
+        offset = first + i;
+        return true;
+      }
+    }
+    if (first == lowest) return false;
+    last = first - 1;
+  }
+}
+
+bool ZipReader::open(File& file) {
+  this->file = &file;
+  entry_count = 0;
+
+  uint32_t end_offset;
+  uint8_t end[ZIP_END_SIZE];
+  if (!findEndRecord(end_offset) || !file.seek(end_offset) ||
+      file.read(end, sizeof(end)) != sizeof(end)) {
+    Logger::error("%s is not a zip file\n", file.name());
+    return false;
+  }
+
+  // Single disk archives without ZIP64 records only
+  directory_size = le32(end + 12);
+  directory_offset = le32(end + 16);
+  if (le16(end + 4) != 0 || le16(end + 6) != 0 || le16(end + 8) != le16(end + 10) ||
+      directory_offset + directory_size > end_offset) {
+    Logger::error("Unsupported zip layout in %s\n", file.name());
+    return false;
+  }
+  entry_count = le16(end + 10);
+  return true;
+}
+
+bool ZipReader::forEachEntry(entry_fn fn, void* ctx) {
+  uint32_t offset = directory_offset;
+  uint8_t header[ZIP_DIRECTORY_SIZE];
+
+  for (uint16_t i = 0; i < entry_count; i++) {
+    if (!file->seek(offset) || file->read(header, sizeof(header)) != sizeof(header) ||
+        le32(header) != ZIP_DIRECTORY_SIGNATURE) {
+      Logger::error("Corrupt zip directory in %s\n", file->name());
+      return false;
+    }
+
+    ZipEntry entry;
+    entry.flags = le16(header + 8);
+    entry.method = le16(header + 10);
+    entry.crc = le32(header + 16);
+    entry.compressed_size = le32(header + 20);
+    entry.size = le32(header + 24);
+    entry.local_offset = le32(header + 42);
+    uint16_t name_length = le16(header + 28);
+    uint16_t stored = name_length < ZIP_NAME_LENGTH - 1 ? name_length : ZIP_NAME_LENGTH - 1;
+    if (file->read(reinterpret_cast<uint8_t*>(entry.name), stored) != stored) {
+      return false;
+    }
+    entry.name[stored] = '\0';
+
+    offset += ZIP_DIRECTORY_SIZE + name_length + le16(header + 30) + le16(header + 32);
+    if (!fn(entry, ctx)) break;
+  }
+  return true;
+}
+
+ZipEntryStream::~ZipEntryStream() { close(); }
+
+bool ZipEntryStream::open(File& file, const ZipEntry& entry) {
+  close();
+
+  if (entry.flags & 0x0001) {
+    Logger::error("Zip entry %s is encrypted\n", entry.name);
+    return false;
+  }
+  if (entry.method != ZIP_METHOD_STORED && entry.method != ZIP_METHOD_DEFLATE) {
+    Logger::error("Zip entry %s uses unsupported method %d\n", entry.name, entry.method);
+    return false;
+  }
+  if (entry.method == ZIP_METHOD_STORED && entry.compressed_size != entry.size) {
+    Logger::error("Zip entry %s has inconsistent sizes\n", entry.name);
+    return false;
+  }
+
+  uint8_t header[ZIP_LOCAL_SIZE];
+  if (!file.seek(entry.local_offset) || file.read(header, sizeof(header)) != sizeof(header) ||
+      le32(header) != ZIP_LOCAL_SIGNATURE) {
+    Logger::error("Corrupt zip entry %s\n", entry.name);
+    return false;
+  }
+
+  if (entry.method == ZIP_METHOD_DEFLATE) {
+    inflater = new (std::nothrow) Inflater();
+    if (!inflater) {
+      Logger::error("Not enough memory to inflate %s\n", entry.name);
+      return false;
+    }
+  }
+
+  this->file = &file;
+  this->entry = entry;
+  data_offset = entry.local_offset + ZIP_LOCAL_SIZE + le16(header + 26) + le16(header + 28);
+  return rewind();
+}
+
+bool ZipEntryStream::rewind() {
+  if (!file) return false;
+  input_offset = data_offset;
+  input_left = entry.compressed_size;
+  output_left = entry.size;
+  crc = CRC32_INIT;
+  failed = false;
+  return !inflater || inflater->begin(entry.size, readInput, this);
+}
+
+void ZipEntryStream::close() {
+  delete inflater;
+  inflater = nullptr;
+  file = nullptr;
+}
+
+int ZipEntryStream::fail(const char* reason) {
+  Logger::error("Zip entry %s: %s\n", entry.name, reason);
+  failed = true;
+  return -1;
+}
+
+// Compressed bytes of the entry. The file position is checked on every
+// read, so other readers of the same file do not get in the way.
+int ZipEntryStream::readInput(uint8_t* buffer, size_t length, void* ctx) {
+  ZipEntryStream& stream = *static_cast<ZipEntryStream*>(ctx);
+  uint32_t count = length < stream.input_left ? length : stream.input_left;
+  if (count == 0) return 0;
+  if (stream.file->position() != stream.input_offset && !stream.file->seek(stream.input_offset)) {
+    return -1;
+  }
+  if (stream.file->read(buffer, count) != count) return -1;
+  stream.input_offset += count;
+  stream.input_left -= count;
+  return count;
+}
+
+int ZipEntryStream::read(uint8_t* buffer, size_t length) {
+  if (!file || failed) return -1;
+  uint32_t count = length < output_left ? length : output_left;
+  if (count == 0) return 0;
+
+  int result = inflater ? inflater->read(buffer, count) : readInput(buffer, count, this);
+  if (result < 0) return fail("read error or corrupt data");
+  if ((uint32_t)result != count) return fail("data ends early");
+
+  crc = crc32Update(crc, buffer, count);
+  output_left -= count;
+  if (output_left == 0 && crc32Final(crc) != entry.crc) {
+    return fail("CRC mismatch");
+  }
+  return count;
+}
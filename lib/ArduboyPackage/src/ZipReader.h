@@ -0,0 +1,78 @@
+#ifndef ZIP_READER_H
+#define ZIP_READER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <MacroLogger.h>
+#include "Inflate.h"
+
+// Entry names longer than this are cut, enough for package file names
+#define ZIP_NAME_LENGTH 64
+
+#define ZIP_METHOD_STORED  0
+#define ZIP_METHOD_DEFLATE 8
+
+struct ZipEntry {
+  char name[ZIP_NAME_LENGTH];
+  uint16_t method;
+  uint16_t flags;
+  uint32_t crc;
+  uint32_t compressed_size;
+  uint32_t size;
+  uint32_t local_offset;  // local file header
+};
+
+// Reads the central directory at the end of a zip file. Entries are only
+// listed, their data is read through a ZipEntryStream.
+class ZipReader {
+ public:
+  // Called for every entry in directory order, return false to stop
+  typedef bool (*entry_fn)(const ZipEntry& entry, void* ctx);
+
+ private:
+  File* file = nullptr;
+  uint32_t directory_offset = 0;
+  uint32_t directory_size = 0;
+  uint16_t entry_count = 0;
+
+  bool findEndRecord(uint32_t& offset);
+
+ public:
+  bool open(File& file);
+  uint16_t getEntryCount() const { return entry_count; }
+  bool forEachEntry(entry_fn fn, void* ctx);
+};
+
+// Data of one entry, stored or deflated, inflated while it is read. The
+// CRC is checked once the last byte was read.
+class ZipEntryStream {
+ private:
+  File* file = nullptr;
+  ZipEntry entry = {};
+  uint32_t data_offset = 0;
+  uint32_t input_offset = 0;  // next compressed byte to read
+  uint32_t input_left = 0;
+  uint32_t output_left = 0;
+  uint32_t crc = 0;
+  Inflater* inflater = nullptr;
+  bool failed = false;
+
+  static int readInput(uint8_t* buffer, size_t length, void* ctx);
+  int fail(const char* reason);
+
+ public:
+  ZipEntryStream() {}
+  ~ZipEntryStream();
+
+  bool open(File& file, const ZipEntry& entry);
+  bool isOpen() const { return file != nullptr; }
+  const ZipEntry& getEntry() const { return entry; }
+  // Start over at the first byte of the entry
+  bool rewind();
+  // Bytes read, 0 at the end, -1 on a read error, corrupt data or a CRC
+  // mismatch
+  int read(uint8_t* buffer, size_t length);
+  void close();
+};
+
+#endif  // ZIP_READER_H
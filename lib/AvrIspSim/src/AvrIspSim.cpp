@@ -0,0 +1,240 @@
+#include "AvrIspSim.h"
+
+#include <MacroLogger.h>
+#include <new>
+
+AvrIspSim::AvrIspSim(const AvrDevice& device)
+    : device(device),
+      fuse_low(0xFF),
+      fuse_high(0xD0),  // BOOTRST, 4 KB boot section, EESAVE
+      fuse_extended(0xCB),
+      lock(0xFF),
+      calibration(0x6E),
+      in_reset(false),
+      programming(false),
+      position(0),
+      result(0),
+      extended_address(0),
+      busy_until(0),
+      clock_hz(100000),
+      max_clock_hz(0xFFFFFFFF),
+      bit_time_ns(0),
+      poll_supported(true) {
+  flash = new (std::nothrow) uint8_t[device.flash_size];
+  eeprom = new (std::nothrow) uint8_t[device.eeprom_size];
+  if (flash) memset(flash, 0xFF, device.flash_size);
+  if (eeprom) memset(eeprom, 0xFF, device.eeprom_size);
+  memset(page_buffer, 0xFF, sizeof(page_buffer));
+  memset(frame, 0, sizeof(frame));
+  resetStats();
+}
+
+AvrIspSim::~AvrIspSim() {
+  delete[] flash;
+  delete[] eeprom;
+}
+
+void AvrIspSim::setReset(bool asserted) {
+  if (asserted != in_reset) {
+    // Leaving reset ends programming mode, entering it starts a new frame
+    programming = false;
+    position = 0;
+  }
+  in_reset = asserted;
+}
+
+void AvrIspSim::pulseClock() { delayMicroseconds(20); }
+
+void AvrIspSim::setFuses(uint8_t low, uint8_t high, uint8_t extended) {
+  fuse_low = low;
+  fuse_high = high;
+  fuse_extended = extended;
+}
+
+void AvrIspSim::resetStats() { memset(&stats, 0, sizeof(stats)); }
+
+bool AvrIspSim::isBusy() const { return (int32_t)(busy_until - micros()) > 0; }
+
+void AvrIspSim::setBusy(uint32_t us) { busy_until = micros() + us; }
+
+uint32_t AvrIspSim::wordAddress() const {
+  return ((uint32_t)extended_address << 16) | ((uint32_t)frame[1] << 8) | frame[2];
+}
+
+uint8_t AvrIspSim::transfer(uint8_t data) {
+  // Eight SCK periods per byte
+  bit_time_ns += 8000000000ULL / clock_hz;
+  if (bit_time_ns >= 1000) {
+    stats.bus_us += bit_time_ns / 1000;
+    delayMicroseconds(bit_time_ns / 1000);
+    bit_time_ns %= 1000;
+  }
+  stats.bytes++;
+
+  // A running target does not drive MISO
+  if (!in_reset || !flash || !eeprom) return 0xFF;
+
+  // The serial interface echoes the previous byte, the fourth byte of a
+  // read instruction shifts out the result instead
+  uint8_t out = position == 0 ? 0x00 : position == 3 ? result : frame[position - 1];
+  if (!programming && !(frame[0] == 0xAC && position > 0)) out = 0x00;
+
+  frame[position++] = data;
+  if (position == 3) {
+    decodeResult();
+  } else if (position == 4) {
+    execute();
+    position = 0;
+  }
+  return out;
+}
+
+void AvrIspSim::transferBytes(uint8_t* buffer, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    buffer[i] = transfer(buffer[i]);
+  }
+}
+
+// Result of the instruction in frame[0..2], shifted out with the fourth byte
+void AvrIspSim::decodeResult() {
+  bool read_locked = (lock & 0x03) == 0x00;
+  uint32_t flash_index = wordAddress() * 2 + (frame[0] == 0x28 ? 1 : 0);
+
+  switch (frame[0]) {
+    case 0x30:
+      result = (frame[2] & 0x03) < 3 ? device.signature[frame[2] & 0x03] : 0xFF;
+      break;
+    case 0x50:
+      result = frame[1] == 0x08 ? fuse_extended : fuse_low;
+      break;
+    case 0x58:
+      result = frame[1] == 0x08 ? fuse_high : lock;
+      break;
+    case 0x38:
+      result = calibration;
+      break;
+    case 0xF0:
+      // Targets without polling support leave RDY/BSY floating high
+      result = !poll_supported ? 0xFF : isBusy() ? 0x01 : 0x00;
+      break;
+    case 0x20:
+    case 0x28:
+      result = read_locked || flash_index >= device.flash_size ? 0xFF : flash[flash_index];
+      break;
+    case 0xA0:
+      result = read_locked ? 0xFF
+                           : eeprom[(((uint32_t)frame[1] << 8) | frame[2]) % device.eeprom_size];
+      break;
+    default:
+      result = frame[2];
+      return;
+  }
+
+  // Above the clock the target can follow, reads come back corrupted
+  if (clock_hz > max_clock_hz) {
+    result ^= 0x5A;
+  }
+}
+
+void AvrIspSim::execute() {
+  stats.instructions++;
+
+  if (frame[0] == 0xAC && frame[1] == 0x53) {
+    programming = true;
+    return;
+  }
+  if (!programming) return;
+
+  if (frame[0] == 0xF0) {
+    stats.polls++;
+    return;
+  }
+  // The target ignores instructions while a write or erase is running
+  if (isBusy()) {
+    stats.busy_violations++;
+    return;
+  }
+
+  bool write_locked = (lock & 0x01) == 0x00;
+  uint32_t page_words = device.page_size / 2;
+
+  switch (frame[0]) {
+    case 0x40:
+    case 0x48: {
+      uint32_t index = (wordAddress() % page_words) * 2 + (frame[0] == 0x48 ? 1 : 0);
+      page_buffer[index] = frame[3];
+      stats.page_loads++;
+      break;
+    }
+    case 0x4C: {
+      uint32_t address = (wordAddress() & ~(page_words - 1)) * 2;
+      if (!write_locked && address + device.page_size <= device.flash_size) {
+        // Without an erase, a page write can only clear bits
+        bool unerased = false;
+        for (uint32_t i = 0; i < device.page_size; i++) {
+          unerased |= (page_buffer[i] & ~flash[address + i]) != 0;
+          flash[address + i] &= page_buffer[i];
+        }
+        if (unerased) stats.unerased_writes++;
+      }
+      memset(page_buffer, 0xFF, sizeof(page_buffer));
+      stats.page_writes++;
+      setBusy(AVR_SIM_FLASH_WRITE_US);
+      break;
+    }
+    case 0x4D:
+      extended_address = frame[2];
+      break;
+    case 0x20:
+    case 0x28:
+      stats.flash_reads++;
+      break;
+    case 0xC0:
+      if (!write_locked) {
+        eeprom[(((uint32_t)frame[1] << 8) | frame[2]) % device.eeprom_size] = frame[3];
+      }
+      setBusy(AVR_SIM_EEPROM_WRITE_US);
+      break;
+    case 0xAC:
+      switch (frame[1]) {
+        case 0x80:
+          memset(flash, 0xFF, device.flash_size);
+          // EESAVE (high fuse bit 3) keeps the EEPROM
+          if (fuse_high & 0x08) memset(eeprom, 0xFF, device.eeprom_size);
+          lock = 0xFF;
+          stats.erases++;
+          setBusy(AVR_SIM_ERASE_US);
+          break;
+        case 0xE0:
+          // Lock bits can only be programmed, an erase clears them
+          lock &= frame[3] | 0xC0;
+          setBusy(AVR_SIM_FUSE_WRITE_US);
+          break;
+        case 0xA0:
+          fuse_low = frame[3];
+          setBusy(AVR_SIM_FUSE_WRITE_US);
+          break;
+        case 0xA8:
+          fuse_high = frame[3];
+          setBusy(AVR_SIM_FUSE_WRITE_US);
+          break;
+        case 0xA4:
+          fuse_extended = frame[3];
+          setBusy(AVR_SIM_FUSE_WRITE_US);
+          break;
+      }
+      break;
+  }
+}
+
+void AvrIspSim::printStats() const {
+  Logger::info("Simulated %s: %d instructions, %d bytes, %d ms on the bus\n",
+               device.name, stats.instructions, stats.bytes, stats.bus_us / 1000);
+  Logger::info("  page loads %d, page writes %d, flash reads %d, polls %d, erases %d\n",
+               stats.page_loads, stats.page_writes, stats.flash_reads, stats.polls,
+               stats.erases);
+  if (stats.busy_violations || stats.unerased_writes) {
+    Logger::error("  %d instructions while busy, %d writes to unerased pages\n",
+                  stats.busy_violations, stats.unerased_writes);
+  }
+}
@@ -0,0 +1,103 @@
+#ifndef AVR_ISP_SIM_H
+#define AVR_ISP_SIM_H
+
+#include <Arduino.h>
+#include <AvrDevices.h>
+#include <ISPBus.h>
+
+// Datasheet programming times of the simulated target (ATmega32U4 t_WD)
+#define AVR_SIM_FLASH_WRITE_US   4500
+#define AVR_SIM_EEPROM_WRITE_US  9000
+#define AVR_SIM_ERASE_US         9000
+#define AVR_SIM_FUSE_WRITE_US    4500
+
+// What the simulated target saw, to catch programmer regressions
+struct AvrSimStats {
+  uint32_t instructions;   // complete 4-byte instructions
+  uint32_t bytes;          // bytes clocked over the bus
+  uint32_t page_loads;     // 0x40/0x48 page buffer loads
+  uint32_t page_writes;    // 0x4C page writes
+  uint32_t flash_reads;    // 0x20/0x28 reads
+  uint32_t polls;          // 0xF0 RDY/BSY polls
+  uint32_t erases;
+  uint32_t busy_violations;  // instructions other than polls sent while busy
+  uint32_t unerased_writes;  // page writes that needed a 0 to 1 transition
+  uint32_t bus_us;         // time spent shifting bits at the ISP clock
+};
+
+// Software model of an AVR in serial programming mode behind the ISP bus.
+// It follows the byte echo of the serial programming interface, keeps the
+// flash, EEPROM, page buffer, fuses and lock bits, and is busy for the
+// datasheet write times after page writes, erases and fuse writes.
+//
+// Time comes from micros(); shifting a byte takes 8 clock periods and is
+// spent with delayMicroseconds(), so flash times come out close to the real
+// bus on a host with a simulated clock.
+class AvrIspSim : public ISPBus {
+ private:
+  const AvrDevice& device;
+  uint8_t* flash;
+  uint8_t* eeprom;
+  uint8_t page_buffer[256];
+  uint8_t fuse_low;
+  uint8_t fuse_high;
+  uint8_t fuse_extended;
+  uint8_t lock;
+  uint8_t calibration;
+
+  bool in_reset;
+  bool programming;        // programming enable was accepted
+  uint8_t frame[4];        // bytes of the current instruction
+  uint8_t position;        // next byte within the frame
+  uint8_t result;          // byte shifted out with the fourth byte
+  uint8_t extended_address;
+  uint32_t busy_until;
+  uint32_t clock_hz;
+  uint32_t max_clock_hz;   // above this reads come back corrupted
+  uint32_t bit_time_ns;    // accumulated shift time below one microsecond
+  bool poll_supported;
+  AvrSimStats stats;
+
+  void decodeResult();
+  void execute();
+  bool isBusy() const;
+  void setBusy(uint32_t us);
+  uint32_t wordAddress() const;
+
+ public:
+  explicit AvrIspSim(const AvrDevice& device);
+  ~AvrIspSim() override;
+
+  AvrIspSim(const AvrIspSim&) = delete;
+  AvrIspSim& operator=(const AvrIspSim&) = delete;
+
+  // ISPBus
+  void begin() override {}
+  void end() override { setReset(false); }
+  void setReset(bool asserted) override;
+  void setClock(uint32_t hz) override { clock_hz = hz; }
+  void pulseClock() override;
+  uint8_t transfer(uint8_t data) override;
+  void transferBytes(uint8_t* buffer, uint32_t length) override;
+
+  // Fault injection
+  void setMaxClock(uint32_t hz) { max_clock_hz = hz; }
+  void setPollSupported(bool supported) { poll_supported = supported; }
+  void setFuses(uint8_t low, uint8_t high, uint8_t extended);
+  void setLockBits(uint8_t bits) { lock = bits | 0xC0; }
+
+  // Target memory, e.g. to preload a bootloader or check the result
+  uint8_t* getFlash() { return flash; }
+  const uint8_t* getFlash() const { return flash; }
+  uint32_t getFlashSize() const { return device.flash_size; }
+  uint8_t* getEeprom() { return eeprom; }
+  uint8_t getLockBits() const { return lock; }
+  uint8_t getHighFuse() const { return fuse_high; }
+  bool isProgramming() const { return programming; }
+
+  const AvrSimStats& getStats() const { return stats; }
+  void resetStats();
+  void printStats() const;
+};
+
+#endif  // AVR_ISP_SIM_H
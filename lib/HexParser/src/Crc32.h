@@ -0,0 +1,16 @@
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CRC32_INIT 0xFFFFFFFFUL
+
+// Standard CRC-32 (IEEE 802.3, reflected, poly 0xEDB88320).
+// Start with CRC32_INIT, feed data in any number of chunks and finish with
+// crc32Final().
+uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length);
+
+inline uint32_t crc32Final(uint32_t crc) { return crc ^ 0xFFFFFFFFUL; }
+
+#endif  // CRC32_H
@@ -1,83 +1,261 @@
 #include "HexParser.h"
 
-// ==========================================
-// IHEX CALLBACK FUNCTION
-// ==========================================
-// Global callback function required by kk_ihex library
-extern "C" ihex_bool_t ihex_data_read(struct ihex_state* ihex,
-                                      ihex_record_type_t type,
-                                      ihex_bool_t checksum_error) {
-  // Forward to HexParser static callback
-  return HexParser::ihex_data_callback(ihex, type, checksum_error);
-}
-
-// Static member initialization
-HexParser* HexParser::instance = nullptr;
+#include <new>
 
 HexParser::HexParser(uint32_t buffer_size)
-    : buffer_size(buffer_size), flash_size(0) {
-  flash_buffer = new uint8_t[buffer_size];
-  if (!flash_buffer) {
+    : page_map(nullptr),
+      page_slot(nullptr),
+      pool_chunks(nullptr),
+      used_pages(0),
+      buffer_size(buffer_size),
+      flash_size(0),
+      last_error(HexParseError::NONE),
+      page_sink(nullptr),
+      page_sink_ctx(nullptr),
+      page_size(0),
+      pending(nullptr),
+      streamed_pages(nullptr),
+      pages_streamed(0),
+      patch_engine(nullptr) {}
+
+HexParser::~HexParser() {
+  releaseBuffer();
+}
+
+// The image is only needed for whole-file parsing, so the page tables are
+// allocated on demand. Pool chunks follow as records arrive.
+bool HexParser::ensureBuffer() {
+  if (page_map) return true;
+  uint32_t pages = poolPageCount();
+  uint32_t chunks = (pages + HEX_PARSER_POOL_CHUNK - 1) / HEX_PARSER_POOL_CHUNK;
+  page_map = new (std::nothrow) uint8_t[(pages + 7) / 8];
+  page_slot = new (std::nothrow) uint16_t[pages];
+  pool_chunks = new (std::nothrow) uint8_t*[chunks];
+  if (!page_map || !page_slot || !pool_chunks) {
     Logger::error("Failed to allocate flash buffer");
-    return;
+    delete[] page_map;
+    delete[] page_slot;
+    delete[] pool_chunks;
+    page_map = nullptr;
+    page_slot = nullptr;
+    pool_chunks = nullptr;
+    last_error = HexParseError::NO_MEMORY;
+    return false;
   }
+  memset(pool_chunks, 0, chunks * sizeof(uint8_t*));
   clearBuffer();
-  instance = this;  // Set static instance for callback
+  return true;
 }
 
-HexParser::~HexParser() {
-  if (flash_buffer) {
-    delete[] flash_buffer;
-  }
-  if (instance == this) {
-    instance = nullptr;
+void HexParser::releaseBuffer() {
+  if (pool_chunks) {
+    uint32_t chunks = (poolPageCount() + HEX_PARSER_POOL_CHUNK - 1) / HEX_PARSER_POOL_CHUNK;
+    for (uint32_t i = 0; i < chunks; i++) {
+      delete[] pool_chunks[i];
+    }
   }
+  delete[] page_map;
+  delete[] page_slot;
+  delete[] pool_chunks;
+  page_map = nullptr;
+  page_slot = nullptr;
+  pool_chunks = nullptr;
+  used_pages = 0;
+  flash_size = 0;
 }
 
+// Allocated chunks are kept and reused by the next parse
 void HexParser::clearBuffer() {
-  if (flash_buffer) {
-    memset(flash_buffer, 0xFF, buffer_size);
-    flash_size = 0;
+  if (page_map) {
+    memset(page_map, 0, (poolPageCount() + 7) / 8);
   }
+  used_pages = 0;
+  flash_size = 0;
 }
 
-bool HexParser::parseFile(File& file) {
+uint8_t* HexParser::poolPage(uint32_t index) const {
+  uint16_t slot = page_slot[index];
+  return pool_chunks[slot / HEX_PARSER_POOL_CHUNK] +
+         (slot % HEX_PARSER_POOL_CHUNK) * HEX_PARSER_POOL_PAGE;
+}
 
-  if (!flash_buffer) {
-    Logger::error("Flash buffer not allocated");
-    return false;
+uint8_t HexParser::imageByte(uint32_t address) const {
+  return isPageUsed(address)
+             ? poolPage(address / HEX_PARSER_POOL_PAGE)[address % HEX_PARSER_POOL_PAGE]
+             : 0xFF;
+}
+
+// Copy a data record into the pool, taking a new pool page for every page
+// the record touches first
+bool HexParser::storeRecord(uint32_t address, const uint8_t* data,
+                            uint32_t length) {
+  while (length > 0) {
+    uint32_t index = address / HEX_PARSER_POOL_PAGE;
+    uint32_t offset = address % HEX_PARSER_POOL_PAGE;
+    uint32_t chunk = HEX_PARSER_POOL_PAGE - offset;
+    if (chunk > length) chunk = length;
+
+    if (!(page_map[index / 8] & (1 << (index % 8)))) {
+      uint8_t*& pool = pool_chunks[used_pages / HEX_PARSER_POOL_CHUNK];
+      if (!pool) {
+        pool = new (std::nothrow) uint8_t[HEX_PARSER_POOL_CHUNK * HEX_PARSER_POOL_PAGE];
+        if (!pool) {
+          Logger::error("Failed to allocate flash buffer");
+          last_error = HexParseError::NO_MEMORY;
+          return false;
+        }
+      }
+      page_slot[index] = used_pages++;
+      page_map[index / 8] |= (1 << (index % 8));
+      memset(poolPage(index), 0xFF, HEX_PARSER_POOL_PAGE);
+    }
+    memcpy(poolPage(index) + offset, data, chunk);
+
+    address += chunk;
+    data += chunk;
+    length -= chunk;
   }
+  return true;
+}
 
-  if (!file) {
-    Logger::error("Failed to open file");
-    return false;
+uint32_t HexParser::getMemoryUsage() const {
+  if (!page_map) return 0;
+  uint32_t pages = poolPageCount();
+  uint32_t chunks = (pages + HEX_PARSER_POOL_CHUNK - 1) / HEX_PARSER_POOL_CHUNK;
+  uint32_t bytes = (pages + 7) / 8 + pages * sizeof(uint16_t) + chunks * sizeof(uint8_t*);
+  for (uint32_t i = 0; i < chunks; i++) {
+    if (pool_chunks[i]) bytes += HEX_PARSER_POOL_CHUNK * HEX_PARSER_POOL_PAGE;
   }
+  return bytes;
+}
 
-  Logger::info("Parsing HEX file: %s (%d bytes)\n", file.name(), file.size());
+bool HexParser::isPageUsed(uint32_t address) const {
+  uint32_t index = address / HEX_PARSER_POOL_PAGE;
+  return page_map && index < poolPageCount() &&
+         (page_map[index / 8] & (1 << (index % 8)));
+}
 
-  // Initialize HEX parser
-  ihex_begin_read(&ihex_state);
-  clearBuffer();
+uint32_t HexParser::getImageStart() const {
+  for (uint32_t address = 0; address < flash_size; address += HEX_PARSER_POOL_PAGE) {
+    if (isPageUsed(address)) return address;
+  }
+  return flash_size;
+}
+
+void HexParser::readImage(uint32_t address, uint8_t* out, uint32_t length) const {
+  while (length > 0) {
+    uint32_t offset = address % HEX_PARSER_POOL_PAGE;
+    uint32_t chunk = HEX_PARSER_POOL_PAGE - offset;
+    if (chunk > length) chunk = length;
+    if (isPageUsed(address)) {
+      memcpy(out, poolPage(address / HEX_PARSER_POOL_PAGE) + offset, chunk);
+    } else {
+      memset(out, 0xFF, chunk);
+    }
+    address += chunk;
+    out += chunk;
+    length -= chunk;
+  }
+}
 
-  // Read and parse file in chunks
-  char buffer[256];
+bool HexParser::forEachPage(uint32_t page_size, page_sink_t sink, void* ctx) const {
+  if (!page_map || !sink || page_size == 0 || page_size > HEX_PARSER_MAX_PAGE_SIZE) {
+    return false;
+  }
+  uint8_t page[HEX_PARSER_MAX_PAGE_SIZE];
+  for (uint32_t address = 0; address < flash_size; address += page_size) {
+    bool used = false;
+    for (uint32_t a = address; a < address + page_size && !used; a += HEX_PARSER_POOL_PAGE) {
+      used = isPageUsed(a);
+    }
+    if (!used) continue;
+    readImage(address, page, page_size);
+    if (!sink(address, page, page_size, ctx)) return false;
+  }
+  return true;
+}
+
+// Feed the whole source through the kk_ihex state machine
+bool HexParser::readHex(HexSource& source) {
+  ihex_begin_read(&ihex_state, ihex_data_callback, this);
+
+  // Read and parse the source in chunks
+  char buffer[HEX_PARSER_READ_CHUNK];
   bool parse_success = true;
 
-  while (file.available() && parse_success) {
-    size_t bytes_read = file.readBytes(buffer, sizeof(buffer) - 1);
-    buffer[bytes_read] = '\0';
+  while (parse_success) {
+    int bytes_read = source.read(reinterpret_cast<uint8_t*>(buffer), sizeof(buffer));
+    if (bytes_read <= 0) {
+      if (bytes_read < 0) {
+        Logger::error("Failed to read %s\n", source.name());
+        if (last_error == HexParseError::NONE) {
+          last_error = HexParseError::FILE_ERROR;
+        }
+        parse_success = false;
+      }
+      break;
+    }
 
     if (!ihex_read_bytes(&ihex_state, buffer, bytes_read)) {
       Logger::error("HEX parsing error");
+      if (last_error == HexParseError::NONE) {
+        last_error = HexParseError::FORMAT;
+      }
       parse_success = false;
     }
   }
 
   ihex_end_read(&ihex_state);
-  file.close();
+  return parse_success;
+}
+
+bool HexParser::parseFile(File& file) {
+  if (!file) {
+    Logger::error("Failed to open file");
+    last_error = HexParseError::FILE_ERROR;
+    return false;
+  }
+  FileHexSource source(file);
+  return parse(source);
+}
+
+bool HexParser::parseFile(File& file, uint32_t page_size, page_sink_t sink,
+                          void* ctx) {
+  if (!file) {
+    Logger::error("Failed to open file");
+    last_error = HexParseError::FILE_ERROR;
+    return false;
+  }
+  FileHexSource source(file);
+  return parse(source, page_size, sink, ctx);
+}
+
+bool HexParser::parse(HexSource& source) {
+  HexLoader loader(source);
+  return parse(loader);
+}
+
+bool HexParser::parse(HexSource& source, uint32_t page_size, page_sink_t sink,
+                      void* ctx) {
+  HexLoader loader(source);
+  return parse(loader, page_size, sink, ctx);
+}
+
+bool HexParser::parse(ImageLoader& loader) {
+  last_error = HexParseError::NONE;
+
+  if (!ensureBuffer()) {
+    return false;
+  }
+
+  Logger::info("Parsing image: %s (%d bytes)\n", loader.name(), loader.size());
+
+  clearBuffer();
+  if (patch_engine) patch_engine->begin();
+  bool parse_success = loader.load(*this);
 
   if (parse_success) {
-    Logger::info("HEX file parsed successfully. Flash size: %d bytes\n",
+    Logger::info("Image parsed successfully. Flash size: %d bytes\n",
                    flash_size);
     printParseInfo();
   }
@@ -85,72 +263,310 @@ bool HexParser::parseFile(File& file) {
   return parse_success;
 }
 
+bool HexParser::parse(ImageLoader& loader, uint32_t page_size, page_sink_t sink,
+                      void* ctx) {
+  last_error = HexParseError::NONE;
+
+  if (!sink || page_size == 0 || page_size > HEX_PARSER_MAX_PAGE_SIZE ||
+      (page_size & (page_size - 1)) != 0) {
+    Logger::error("Invalid page size for streaming parse: %d\n", page_size);
+    return false;
+  }
+
+  uint32_t page_count = (buffer_size + page_size - 1) / page_size;
+  pending = new (std::nothrow) PendingPage[HEX_PARSER_PENDING_PAGES];
+  streamed_pages = new (std::nothrow) uint8_t[(page_count + 7) / 8];
+  if (!pending || !streamed_pages) {
+    Logger::error("Failed to allocate page assembler");
+    delete[] pending;
+    delete[] streamed_pages;
+    pending = nullptr;
+    streamed_pages = nullptr;
+    last_error = HexParseError::NO_MEMORY;
+    return false;
+  }
+  for (uint32_t i = 0; i < HEX_PARSER_PENDING_PAGES; i++) {
+    pending[i].used = false;
+  }
+  memset(streamed_pages, 0, (page_count + 7) / 8);
+
+  Logger::info("Streaming image: %s (%d bytes)\n", loader.name(), loader.size());
+
+  this->page_sink = sink;
+  this->page_sink_ctx = ctx;
+  this->page_size = page_size;
+  pages_streamed = 0;
+  flash_size = 0;
+  if (patch_engine) patch_engine->begin();
+
+  bool parse_success = loader.load(*this);
+  if (parse_success) {
+    parse_success = flushPendingPages();
+  }
+
+  delete[] pending;
+  delete[] streamed_pages;
+  pending = nullptr;
+  streamed_pages = nullptr;
+  this->page_sink = nullptr;
+  this->page_sink_ctx = nullptr;
+
+  if (parse_success) {
+    Logger::info("Image streamed successfully. %d pages, flash size: %d bytes\n",
+                 pages_streamed, flash_size);
+  }
+
+  return parse_success;
+}
+
+// ==========================================
+// STREAMING PAGE ASSEMBLER
+// ==========================================
+
+// Copy a data record into the pending pages. Full pages are committed by
+// commitReadyPages() once the patch engine has seen the record. Records
+// normally arrive in ascending order so only the last pages stay pending.
+bool HexParser::assembleRecord(uint32_t address, const uint8_t* data,
+                               uint32_t length) {
+  while (length > 0) {
+    uint32_t page_addr = address & ~(page_size - 1);
+    uint32_t offset = address - page_addr;
+    uint32_t chunk = page_size - offset;
+    if (chunk > length) chunk = length;
+
+    uint32_t page_index = page_addr / page_size;
+    if (streamed_pages[page_index / 8] & (1 << (page_index % 8))) {
+      Logger::error("Record at 0x%04X targets a page that was already written\n",
+                    address);
+      last_error = HexParseError::OUT_OF_ORDER;
+      return false;
+    }
+
+    // Find the pending page, or a free slot for it
+    PendingPage* page = nullptr;
+    PendingPage* free_slot = nullptr;
+    for (uint32_t i = 0; i < HEX_PARSER_PENDING_PAGES; i++) {
+      if (pending[i].used && pending[i].address == page_addr) {
+        page = &pending[i];
+        break;
+      }
+      if (!pending[i].used && !free_slot) {
+        free_slot = &pending[i];
+      }
+    }
+
+    if (!page) {
+      if (!free_slot) {
+        // All slots busy: the lowest page is the one the file has most
+        // likely moved past, so hand it to the sink early. Pages a pending
+        // patch match may still change stay; if every page is held the
+        // image goes the buffered way.
+        for (uint32_t i = 0; i < HEX_PARSER_PENDING_PAGES; i++) {
+          if (!(patch_engine && patch_engine->holds(pending[i].address, page_size)) &&
+              (!free_slot || pending[i].address < free_slot->address)) {
+            free_slot = &pending[i];
+          }
+        }
+        if (!free_slot) {
+          Logger::error("No page to make room for 0x%04X, all held by patches\n", address);
+          last_error = HexParseError::OUT_OF_ORDER;
+          return false;
+        }
+        if (!commitPage(*free_slot)) return false;
+      }
+      page = free_slot;
+      page->used = true;
+      page->address = page_addr;
+      page->filled = 0;
+      memset(page->mask, 0, sizeof(page->mask));
+      memset(page->data, 0xFF, page_size);
+    }
+
+    for (uint32_t i = 0; i < chunk; i++) {
+      uint32_t pos = offset + i;
+      page->data[pos] = data[i];
+      if (!(page->mask[pos / 8] & (1 << (pos % 8)))) {
+        page->mask[pos / 8] |= (1 << (pos % 8));
+        page->filled++;
+      }
+    }
+
+    address += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+bool HexParser::commitPage(PendingPage& page) {
+  uint32_t page_index = page.address / page_size;
+  streamed_pages[page_index / 8] |= (1 << (page_index % 8));
+  page.used = false;
+  pages_streamed++;
+
+  if (!page_sink(page.address, page.data, page_size, page_sink_ctx)) {
+    Logger::error("Page sink rejected page 0x%04X\n", page.address);
+    last_error = HexParseError::SINK;
+    return false;
+  }
+  return true;
+}
+
+// Commit the full pages that no pending patch match can change any more
+bool HexParser::commitReadyPages() {
+  while (true) {
+    PendingPage* lowest = nullptr;
+    for (uint32_t i = 0; i < HEX_PARSER_PENDING_PAGES; i++) {
+      PendingPage& page = pending[i];
+      if (page.used && page.filled == page_size &&
+          !(patch_engine && patch_engine->holds(page.address, page_size)) &&
+          (!lowest || page.address < lowest->address)) {
+        lowest = &page;
+      }
+    }
+    if (!lowest) return true;
+    if (!commitPage(*lowest)) return false;
+  }
+}
+
+HexParser::PendingPage* HexParser::findPending(uint32_t page_addr) {
+  for (uint32_t i = 0; i < HEX_PARSER_PENDING_PAGES; i++) {
+    if (pending[i].used && pending[i].address == page_addr) return &pending[i];
+  }
+  return nullptr;
+}
+
+// Write a patch into the image: the pending pages while streaming, the pool
+// otherwise. Nothing is written unless every byte is still in memory.
+bool HexParser::writePatch(uint32_t address, const uint8_t* data,
+                           const uint8_t* keep, uint32_t length) {
+  for (uint32_t i = 0; i < length; i++) {
+    uint32_t byte_addr = address + i;
+    bool present = page_sink ? findPending(byte_addr & ~(page_size - 1)) != nullptr
+                             : isPageUsed(byte_addr);
+    if (!present) return false;
+  }
+  for (uint32_t i = 0; i < length; i++) {
+    if (keep[i / 8] & (1 << (i % 8))) continue;
+    uint32_t byte_addr = address + i;
+    if (page_sink) {
+      uint32_t page_addr = byte_addr & ~(page_size - 1);
+      findPending(page_addr)->data[byte_addr - page_addr] = data[i];
+    } else {
+      poolPage(byte_addr / HEX_PARSER_POOL_PAGE)[byte_addr % HEX_PARSER_POOL_PAGE] = data[i];
+    }
+  }
+  return true;
+}
+
+bool HexParser::patchWriter(uint32_t address, const uint8_t* data,
+                            const uint8_t* keep, uint32_t length, void* ctx) {
+  return static_cast<HexParser*>(ctx)->writePatch(address, data, keep, length);
+}
+
+// Commit the remaining pages in address order
+bool HexParser::flushPendingPages() {
+  while (true) {
+    PendingPage* lowest = nullptr;
+    for (uint32_t i = 0; i < HEX_PARSER_PENDING_PAGES; i++) {
+      if (pending[i].used &&
+          (!lowest || pending[i].address < lowest->address)) {
+        lowest = &pending[i];
+      }
+    }
+    if (!lowest) return true;
+    if (!commitPage(*lowest)) return false;
+  }
+}
+
 void HexParser::printParseInfo() const {
   Logger::info("Parsed HEX Info:\n");
   Logger::info("  Buffer size: %d bytes\n", buffer_size);
   Logger::info("  Flash size: %d bytes\n", flash_size);
   Logger::info("  Usage: %.1f%%\n", (float)flash_size * 100.0 / buffer_size);
-
-  // Find first and last non-0xFF bytes
-  uint32_t first_byte = 0, last_byte = 0;
-  for (uint32_t i = 0; i < flash_size; i++) {
-    if (flash_buffer[i] != 0xFF) {
-      first_byte = i;
-      break;
-    }
-  }
-  for (uint32_t i = flash_size; i > 0; i--) {
-    if (flash_buffer[i - 1] != 0xFF) {
-      last_byte = i - 1;
+  if (!page_map || used_pages == 0) return;
+  Logger::info("  Pool: %d pages, %d bytes of RAM\n", used_pages, getMemoryUsage());
+
+  // Code range: first and last non-0xFF bytes of the first and last used page
+  uint32_t first_byte = getImageStart();
+  uint32_t last_byte = first_byte;
+  for (uint32_t address = flash_size; address > first_byte; address--) {
+    if (isPageUsed(address - 1)) {
+      last_byte = address - 1;
       break;
     }
   }
+  while (first_byte < last_byte && imageByte(first_byte) == 0xFF) first_byte++;
+  while (last_byte > first_byte && imageByte(last_byte) == 0xFF) last_byte--;
 
-  if (first_byte <= last_byte) {
+  if (imageByte(first_byte) != 0xFF) {
     Logger::info("  Code range: 0x%04X - 0x%04X\n", first_byte, last_byte);
   }
 }
 
-// Static callback method for global callback function
+// kk_ihex callback, the state carries the parser it belongs to
 ihex_bool_t HexParser::ihex_data_callback(struct ihex_state* ihex,
                                           ihex_record_type_t type,
                                           ihex_bool_t checksum_error) {
-  if (instance) {
-    return instance->handleParsedData(ihex, type, checksum_error);
+  HexParser* parser = static_cast<HexParser*>(ihex->context);
+  return parser->handleParsedData(ihex, type, checksum_error);
+}
+
+// Image data from any loader: range check, then the sparse image or the
+// page assembler, then the patch engine
+bool HexParser::addData(uint32_t address, const uint8_t* data, uint32_t length) {
+  // Check if address is within flash range
+  if (address + length > buffer_size || address + length < address) {
+    Logger::error("Address 0x%08X exceeds buffer size\n", address);
+    last_error = HexParseError::OUT_OF_RANGE;
+    return false;
+  }
+
+  // Update flash size
+  if (address + length > flash_size) {
+    flash_size = address + length;
+  }
+
+  if (page_sink) {
+    // Streaming: hand the bytes to the page assembler
+    if (!assembleRecord(address, data, length)) {
+      return false;
+    }
+  } else if (!storeRecord(address, data, length)) {
+    return false;
+  }
+
+  if (patch_engine) {
+    patch_engine->feed(address, data, length, patchWriter, this);
+  }
+  if (page_sink && !commitReadyPages()) {
+    return false;
+  }
+  return true;
+}
+
+bool HexParser::fail(HexParseError error) {
+  if (last_error == HexParseError::NONE) {
+    last_error = error;
   }
   return false;
 }
 
-// Instance method for handling parsed data
 ihex_bool_t HexParser::handleParsedData(struct ihex_state* ihex,
                                         ihex_record_type_t type,
                                         ihex_bool_t checksum_error) {
   if (checksum_error) {
     Logger::error("HEX checksum error!");
+    last_error = HexParseError::CHECKSUM;
     return false;
   }
 
   switch (type) {
-    case IHEX_DATA_RECORD: {
-      uint32_t address = IHEX_LINEAR_ADDRESS(ihex);
-
-      // Check if address is within flash range
-      if (address + ihex->length > buffer_size) {
-        Logger::error("Address 0x%08X exceeds buffer size\n", address);
+    case IHEX_DATA_RECORD:
+      if (!addData(IHEX_LINEAR_ADDRESS(ihex), ihex->data, ihex->length)) {
         return false;
       }
-
-      // Copy data to flash buffer
-      memcpy(&flash_buffer[address], ihex->data, ihex->length);
-
-      // Update flash size
-      if (address + ihex->length > flash_size) {
-        flash_size = address + ihex->length;
-      }
-
-      Logger::info("Data: 0x%08X, %d bytes\n", address, ihex->length);
       break;
-    }
 
     case IHEX_END_OF_FILE_RECORD:
       Logger::info("HEX file parsing complete");
@@ -171,61 +587,26 @@ ihex_bool_t HexParser::handleParsedData(struct ihex_state* ihex,
   return true;
 }
 
-// Apply a modifier callback to the internal flash buffer.
-bool HexParser::modifyBuffer(HexParser::buffer_modifier_t modifier, void* ctx) {
-  if (!flash_buffer || !modifier) return false;
-  // modifier can inspect buffer_size and flash_size
-  return modifier(flash_buffer, buffer_size, flash_size, ctx);
-}
-
-// Write the parser's internal flash buffer as Intel HEX to an Arduino File
+// Write the parsed image as Intel HEX to an Arduino File. Unused pool pages
+// are skipped without looking at their bytes, blank records are left out.
 bool HexParser::writeHexFile(File& file) const {
-  if (!file) {
-    Logger::error("Output file is not open");
+  if (!page_map) {
+    Logger::error("Flash buffer not allocated");
     return false;
   }
-  const uint32_t WRITE_RECORD_SIZE = 16;
-  char line[128];
-
-  uint32_t i = 0;
-  while (i < buffer_size) {
-    // skip 0xFF runs
-    while (i < buffer_size && flash_buffer[i] == 0xFF) ++i;
-    if (i >= buffer_size) break;
-    uint32_t runStart = i;
-    uint32_t runLen = 0;
-    while (i < buffer_size && flash_buffer[i] != 0xFF && runLen < 0xFFFF) { ++i; ++runLen; }
-
-    uint32_t written = 0;
-    while (written < runLen) {
-      uint32_t chunk = (runLen - written) > WRITE_RECORD_SIZE ? WRITE_RECORD_SIZE : (runLen - written);
-      uint16_t addr = (uint16_t)(runStart + written);
-      int hdrlen = snprintf(line, sizeof(line), ":%02X%04X%02X", (int)chunk, (int)addr, 0);
-      if (hdrlen < 0) return false;
-      size_t pos = (size_t)hdrlen;
-      // append data bytes
-      for (uint32_t k = 0; k < chunk; ++k) {
-        int w = snprintf(line + pos, sizeof(line) - pos, "%02X", (int)flash_buffer[runStart + written + k]);
-        if (w < 0) return false;
-        pos += (size_t)w;
-      }
-      // compute checksum
-      uint32_t sum = 0;
-      sum += (uint8_t)chunk;
-      sum += (uint8_t)((addr >> 8) & 0xFF);
-      sum += (uint8_t)(addr & 0xFF);
-      sum += 0x00; // record type
-      for (uint32_t k = 0; k < chunk; ++k) sum += flash_buffer[runStart + written + k];
-      uint8_t csum = (uint8_t)((~(sum & 0xFF) + 1) & 0xFF);
-      int w = snprintf(line + pos, sizeof(line) - pos, "%02X", (int)csum);
-      if (w < 0) return false;
-      // write line
-      file.print(line);
-      file.println();
-      written += chunk;
-    }
-  }
-  // EOF
-  file.println(":00000001FF");
-  return true;
+  ImageWriter writer(file, ImageFormat::HEX);
+  if (!writer.begin()) {
+    return false;
+  }
+  writer.setSkipBlank(true);
+
+  for (uint32_t address = 0; address < buffer_size; address += HEX_PARSER_POOL_PAGE) {
+    if (!isPageUsed(address)) continue;
+    uint32_t length = buffer_size - address;
+    if (length > HEX_PARSER_POOL_PAGE) length = HEX_PARSER_POOL_PAGE;
+    if (!writer.write(address, poolPage(address / HEX_PARSER_POOL_PAGE), length)) {
+      return false;
+    }
+  }
+  return writer.finish();
 }
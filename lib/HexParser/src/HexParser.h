@@ -5,47 +5,162 @@
 #include <FS.h>
 #include <MacroLogger.h>
 #include "kk_ihex_read.h"
+#include "HexSource.h"
+#include "ImageLoader.h"
+#include "ImageWriter.h"
+#include "PatchEngine.h"
+
+// Maximum flash page size handled by the streaming page assembler
+#define HEX_PARSER_MAX_PAGE_SIZE 256
+// Number of partially filled pages kept while streaming
+#define HEX_PARSER_PENDING_PAGES 4
+// File read size. Records that span two reads go through the slower
+// character state machine, larger reads split fewer of them.
+#define HEX_PARSER_READ_CHUNK 512
+// Granularity of the sparse image, the smallest flash page of the supported
+// devices. Only pool pages touched by a record get storage.
+#define HEX_PARSER_POOL_PAGE 64
+// Pool pages are allocated in chunks of this many pages
+#define HEX_PARSER_POOL_CHUNK 16
+
+enum class HexParseError {
+  NONE,
+  NO_MEMORY,
+  FILE_ERROR,
+  FORMAT,
+  CHECKSUM,
+  OUT_OF_RANGE,
+  OUT_OF_ORDER,  // record landed on a page that was already streamed out, or
+                 // no pending page could be streamed out to make room
+  SINK
+};
 
 class HexParser {
+ public:
+  // Page sink callback: receives one assembled flash page (page_size bytes,
+  // bytes not present in the file are 0xFF) and optional user context.
+  // Return false to abort the parse.
+  typedef bool (*page_sink_t)(uint32_t address, const uint8_t* page,
+                              uint32_t page_size, void* ctx);
+
  private:
-  uint8_t* flash_buffer;
+  struct PendingPage {
+    uint32_t address;
+    uint16_t filled;
+    bool used;
+    uint8_t mask[HEX_PARSER_MAX_PAGE_SIZE / 8];
+    uint8_t data[HEX_PARSER_MAX_PAGE_SIZE];
+  };
+
+  // Sparse image of buffer_size bytes: a bitmap of used pool pages and the
+  // pool slot of every used page. Slots are handed out in parse order.
+  uint8_t* page_map;
+  uint16_t* page_slot;
+  uint8_t** pool_chunks;
+  uint32_t used_pages;
   uint32_t buffer_size;
   uint32_t flash_size;
   struct ihex_state ihex_state;
+  HexParseError last_error;
 
-  static HexParser* instance;  // For callback
+  // Streaming state, only valid while parseFile() runs with a page sink
+  page_sink_t page_sink;
+  void* page_sink_ctx;
+  uint32_t page_size;
+  PendingPage* pending;
+  uint8_t* streamed_pages;  // bitmap of pages already handed to the sink
+  uint32_t pages_streamed;
+
+  PatchEngine* patch_engine;
+
+  bool ensureBuffer();
+  uint32_t poolPageCount() const {
+    return (buffer_size + HEX_PARSER_POOL_PAGE - 1) / HEX_PARSER_POOL_PAGE;
+  }
+  uint8_t* poolPage(uint32_t index) const;
+  uint8_t imageByte(uint32_t address) const;
+  bool storeRecord(uint32_t address, const uint8_t* data, uint32_t length);
+
+  // kk_ihex record callback, forwards to the parser in ihex->context
+  static ihex_bool_t ihex_data_callback(struct ihex_state* ihex,
+                                        ihex_record_type_t type,
+                                        ihex_bool_t checksum_error);
 
-  // Instance method for handling parsed data
+  // One decoded HEX record: data records go to addData(), the common entry
+  // point of the HEX, BIN and ELF loaders
   ihex_bool_t handleParsedData(struct ihex_state* ihex, ihex_record_type_t type,
                                ihex_bool_t checksum_error);
 
+  bool assembleRecord(uint32_t address, const uint8_t* data, uint32_t length);
+  bool commitPage(PendingPage& page);
+  bool commitReadyPages();
+  bool flushPendingPages();
+  PendingPage* findPending(uint32_t page_addr);
+  bool writePatch(uint32_t address, const uint8_t* data, const uint8_t* keep,
+                  uint32_t length);
+  static bool patchWriter(uint32_t address, const uint8_t* data,
+                          const uint8_t* keep, uint32_t length, void* ctx);
+
  public:
   HexParser(uint32_t buffer_size = 32768);
   ~HexParser();
 
+  // Parse a whole file into the internal sparse image. Pool pages are
+  // allocated as records arrive and kept until releaseBuffer().
   bool parseFile(File& file);
 
-  uint8_t* getFlashBuffer() const { return flash_buffer; }
+  // Streaming parse: pages are assembled from the records and handed to
+  // the sink as soon as they are complete, without the full flash buffer.
+  // Fails with HexParseError::OUT_OF_ORDER if a record targets a page that
+  // was already handed to the sink; callers can fall back to parseFile().
+  bool parseFile(File& file, uint32_t page_size, page_sink_t sink, void* ctx);
+
+  // Both parses on any source of HEX text, e.g. a package entry. The
+  // source is read from where it stands.
+  bool parse(HexSource& source);
+  bool parse(HexSource& source, uint32_t page_size, page_sink_t sink, void* ctx);
+
+  // Both parses on an image in any format the loaders read: HEX, raw
+  // binary or ELF. Patching and page assembly are the same for all.
+  bool parse(ImageLoader& loader);
+  bool parse(ImageLoader& loader, uint32_t page_size, page_sink_t sink, void* ctx);
+
+  // Called by loaders while a parse runs: run HEX text through the record
+  // decoder, or add image bytes directly
+  bool readHex(HexSource& source);
+  bool addData(uint32_t address, const uint8_t* data, uint32_t length);
+  // Record why a loader gave up, unless an error was already recorded.
+  // Always returns false.
+  bool fail(HexParseError error);
+
   uint32_t getFlashSize() const { return flash_size; }
   uint32_t getBufferSize() const { return buffer_size; }
+  uint32_t getUsedPages() const { return used_pages; }
+  // RAM taken by the parsed image and its page tables
+  uint32_t getMemoryUsage() const;
+  bool isPageUsed(uint32_t address) const;
+  // First address of the first used pool page, flash size if there is none
+  uint32_t getImageStart() const;
+  // Copy part of the parsed image, bytes not in the file read as 0xFF
+  void readImage(uint32_t address, uint8_t* out, uint32_t length) const;
+  // Hand every page of page_size bytes that holds parsed data to the sink,
+  // in address order
+  bool forEachPage(uint32_t page_size, page_sink_t sink, void* ctx) const;
+  HexParseError getLastError() const { return last_error; }
+  uint32_t getPagesStreamed() const { return pages_streamed; }
+
+  // Match and apply a patch set while records are parsed, in both parse
+  // modes. Streamed pages are held back until no match can change them.
+  // The engine keeps match state, parsers that run at the same time each
+  // need their own.
+  void setPatchEngine(PatchEngine* engine) { patch_engine = engine; }
+  PatchEngine* getPatchEngine() const { return patch_engine; }
 
   void clearBuffer();
+  void releaseBuffer();
   void printParseInfo() const;
 
-  // Static callback method for global callback function
-  static ihex_bool_t ihex_data_callback(struct ihex_state* ihex,
-                                        ihex_record_type_t type,
-                                        ihex_bool_t checksum_error);
-
-  // Buffer modifier callback: modifier receives pointer to the parser's
-  // internal flash buffer, the total buffer size and the current used flash_size
-  // and optional user context. Return true on success.
-  typedef bool (*buffer_modifier_t)(uint8_t* buf, uint32_t buf_size, uint32_t flash_size, void* ctx);
-
-  // Apply a modifier callback to the internal flash buffer.
-  bool modifyBuffer(buffer_modifier_t modifier, void* ctx);
-
-  // Write the parser's internal flash buffer as an Intel HEX file to an Arduino File.
+  // Write the parsed image as an Intel HEX file to an Arduino File.
   bool writeHexFile(File& file) const;
 };
 
@@ -0,0 +1,36 @@
+#ifndef HEX_SOURCE_H
+#define HEX_SOURCE_H
+
+#include <Arduino.h>
+#include <FS.h>
+
+// Text of a HEX image, read front to back. Lets the parser take records
+// from something other than a plain file, e.g. an entry of a zip package.
+class HexSource {
+ public:
+  virtual ~HexSource() {}
+  virtual const char* name() const = 0;
+  // Bytes of HEX text
+  virtual uint32_t size() const = 0;
+  // Start over at the first byte
+  virtual bool rewind() = 0;
+  // Bytes read, 0 at the end, -1 on a read or decode error
+  virtual int read(uint8_t* buffer, size_t length) = 0;
+};
+
+// A HEX file on a filesystem
+class FileHexSource : public HexSource {
+ private:
+  File& file;
+
+ public:
+  explicit FileHexSource(File& file) : file(file) {}
+  const char* name() const override { return file.name(); }
+  uint32_t size() const override { return file.size(); }
+  bool rewind() override { return file.seek(0); }
+  int read(uint8_t* buffer, size_t length) override {
+    return file.available() ? (int)file.read(buffer, length) : 0;
+  }
+};
+
+#endif  // HEX_SOURCE_H
@@ -0,0 +1,162 @@
+#include "ImageLoader.h"
+
+#include <MacroLogger.h>
+#include <strings.h>
+#include "HexParser.h"
+
+#define ELF_HEADER_SIZE  52
+#define ELF_PHDR_SIZE    32
+#define ELF_CLASS_32     1
+#define ELF_DATA_LSB     1
+#define ELF_MACHINE_AVR  83
+#define ELF_PT_LOAD      1
+
+static inline uint16_t le16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static inline uint32_t le32(const uint8_t* p) {
+  return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool endsWithIgnoreCase(const char* text, const char* suffix) {
+  size_t text_length = strlen(text);
+  size_t suffix_length = strlen(suffix);
+  return text_length >= suffix_length &&
+         strcasecmp(text + text_length - suffix_length, suffix) == 0;
+}
+
+bool HexLoader::load(HexParser& parser) { return parser.readHex(source); }
+
+bool BinLoader::isBinImage(const char* path) {
+  return endsWithIgnoreCase(path, BIN_IMAGE_EXTENSION);
+}
+
+// The file is the image. Blank runs are dropped like the gaps of a HEX
+// file, pages that end up empty are never written.
+bool BinLoader::load(HexParser& parser) {
+  uint8_t buffer[IMAGE_LOADER_CHUNK];
+  uint32_t address = 0;
+
+  while (true) {
+    int count = (int)file.read(buffer, sizeof(buffer));
+    if (count <= 0) {
+      if (count < 0) {
+        Logger::error("Failed to read %s\n", file.name());
+        return parser.fail(HexParseError::FILE_ERROR);
+      }
+      return true;
+    }
+
+    // Consecutive runs with data go to the parser in one piece
+    uint32_t span_start = 0;
+    for (uint32_t run_start = 0; run_start < (uint32_t)count; run_start += BIN_LOADER_BLANK_RUN) {
+      uint32_t run_length = count - run_start < BIN_LOADER_BLANK_RUN ? count - run_start
+                                                                     : BIN_LOADER_BLANK_RUN;
+      const uint8_t* run = buffer + run_start;
+      // All bytes equal to the first one, and the first one is 0xFF
+      if (run[0] != 0xFF || memcmp(run, run + 1, run_length - 1) != 0) {
+        continue;
+      }
+      if (run_start > span_start &&
+          !parser.addData(address + span_start, buffer + span_start, run_start - span_start)) {
+        return false;
+      }
+      span_start = run_start + run_length;
+    }
+    if ((uint32_t)count > span_start &&
+        !parser.addData(address + span_start, buffer + span_start, count - span_start)) {
+      return false;
+    }
+    address += count;
+  }
+}
+
+bool ElfLoader::isElfImage(const char* path) {
+  return endsWithIgnoreCase(path, ELF_IMAGE_EXTENSION);
+}
+
+// Collect the flash segments from the program header table, sorted by
+// load address so the page assembler sees them in order
+bool ElfLoader::readSegments() {
+  uint8_t header[ELF_HEADER_SIZE];
+  if (!file.seek(0) || file.read(header, sizeof(header)) != sizeof(header) ||
+      memcmp(header, "\x7F" "ELF", 4) != 0) {
+    Logger::error("%s is not an ELF file\n", file.name());
+    return false;
+  }
+  if (header[4] != ELF_CLASS_32 || header[5] != ELF_DATA_LSB ||
+      le16(header + 18) != ELF_MACHINE_AVR) {
+    Logger::error("%s is not a 32 bit AVR ELF file\n", file.name());
+    return false;
+  }
+
+  uint32_t table_offset = le32(header + 28);
+  uint16_t entry_size = le16(header + 42);
+  uint16_t entry_count = le16(header + 44);
+  if (entry_size < ELF_PHDR_SIZE) {
+    Logger::error("%s has no program headers\n", file.name());
+    return false;
+  }
+
+  segment_count = 0;
+  for (uint16_t i = 0; i < entry_count; i++) {
+    uint8_t entry[ELF_PHDR_SIZE];
+    if (!file.seek(table_offset + (uint32_t)i * entry_size) ||
+        file.read(entry, sizeof(entry)) != sizeof(entry)) {
+      Logger::error("Corrupt program header in %s\n", file.name());
+      return false;
+    }
+
+    Segment segment = {le32(entry + 12), le32(entry + 4), le32(entry + 16)};
+    if (le32(entry) != ELF_PT_LOAD || segment.length == 0 ||
+        segment.address >= ELF_FLASH_LIMIT ||
+        segment.length > ELF_FLASH_LIMIT - segment.address) {
+      continue;
+    }
+    if (segment.offset + segment.length < segment.offset ||
+        segment.offset + segment.length > file.size()) {
+      Logger::error("Segment at 0x%06X lies outside %s\n", segment.address, file.name());
+      return false;
+    }
+    if (segment_count == ELF_LOADER_MAX_SEGMENTS) {
+      Logger::error("Too many flash segments in %s\n", file.name());
+      return false;
+    }
+
+    uint8_t slot = segment_count++;
+    while (slot > 0 && segments[slot - 1].address > segment.address) {
+      segments[slot] = segments[slot - 1];
+      slot--;
+    }
+    segments[slot] = segment;
+  }
+  return true;
+}
+
+bool ElfLoader::load(HexParser& parser) {
+  if (!opened) {
+    if (!readSegments()) {
+      return parser.fail(HexParseError::FORMAT);
+    }
+    opened = true;
+  }
+
+  uint8_t buffer[IMAGE_LOADER_CHUNK];
+  for (uint8_t i = 0; i < segment_count; i++) {
+    const Segment& segment = segments[i];
+    if (!file.seek(segment.offset)) {
+      return parser.fail(HexParseError::FILE_ERROR);
+    }
+    for (uint32_t done = 0; done < segment.length;) {
+      uint32_t count = segment.length - done < sizeof(buffer) ? segment.length - done
+                                                              : sizeof(buffer);
+      if (file.read(buffer, count) != count) {
+        Logger::error("Failed to read %s\n", file.name());
+        return parser.fail(HexParseError::FILE_ERROR);
+      }
+      if (!parser.addData(segment.address + done, buffer, count)) {
+        return false;
+      }
+      done += count;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,90 @@
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include "HexSource.h"
+
+#define BIN_IMAGE_EXTENSION ".bin"
+#define ELF_IMAGE_EXTENSION ".elf"
+// Bytes read from the file at a time by the BIN and ELF loaders
+#define IMAGE_LOADER_CHUNK 512
+// Runs of this many bytes that are all 0xFF are left out of a BIN image,
+// the erased flash already holds them
+#define BIN_LOADER_BLANK_RUN 64
+// PT_LOAD segments kept from an ELF file
+#define ELF_LOADER_MAX_SEGMENTS 8
+// avr-gcc places RAM, EEPROM and fuses at these offsets, flash sits below
+#define ELF_FLASH_LIMIT 0x800000UL
+
+class HexParser;
+
+// A flash image in one file format. The parser sets up patching and page
+// assembly, then load() hands it the image data through
+// HexParser::addData(), in ascending address order where the format allows.
+class ImageLoader {
+ public:
+  virtual ~ImageLoader() {}
+  virtual const char* name() const = 0;
+  // Bytes of the file
+  virtual uint32_t size() const = 0;
+  // Start over at the first byte
+  virtual bool rewind() = 0;
+  virtual bool load(HexParser& parser) = 0;
+};
+
+// Intel HEX text from any HexSource, e.g. a file or a package entry
+class HexLoader : public ImageLoader {
+ private:
+  HexSource& source;
+
+ public:
+  explicit HexLoader(HexSource& source) : source(source) {}
+  const char* name() const override { return source.name(); }
+  uint32_t size() const override { return source.size(); }
+  bool rewind() override { return source.rewind(); }
+  bool load(HexParser& parser) override;
+};
+
+// Raw flash contents starting at address 0, as written by objcopy -O binary
+class BinLoader : public ImageLoader {
+ private:
+  File& file;
+
+ public:
+  explicit BinLoader(File& file) : file(file) {}
+  static bool isBinImage(const char* path);
+  const char* name() const override { return file.name(); }
+  uint32_t size() const override { return file.size(); }
+  bool rewind() override { return file.seek(0); }
+  bool load(HexParser& parser) override;
+};
+
+// A linked AVR ELF file. Only the file contents of PT_LOAD segments whose
+// load address lies in flash are read, so .text and the initial values of
+// .data; EEPROM, fuse and debug sections are skipped.
+class ElfLoader : public ImageLoader {
+ private:
+  struct Segment {
+    uint32_t address;  // physical (load) address
+    uint32_t offset;   // in the file
+    uint32_t length;
+  };
+
+  File& file;
+  Segment segments[ELF_LOADER_MAX_SEGMENTS];
+  uint8_t segment_count = 0;
+  bool opened = false;
+
+  bool readSegments();
+
+ public:
+  explicit ElfLoader(File& file) : file(file) {}
+  static bool isElfImage(const char* path);
+  const char* name() const override { return file.name(); }
+  uint32_t size() const override { return file.size(); }
+  bool rewind() override { return file.seek(0); }
+  bool load(HexParser& parser) override;
+};
+
+#endif  // IMAGE_LOADER_H
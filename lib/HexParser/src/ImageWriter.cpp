@@ -0,0 +1,145 @@
+#include "ImageWriter.h"
+
+#include <new>
+
+// Longest HEX line: ':', count, address, type, data, checksum and CRLF
+#define IMAGE_WRITER_MAX_LINE (1 + 8 + IMAGE_WRITER_RECORD_SIZE * 2 + 2 + 2)
+
+static const char kHexDigits[] = "0123456789ABCDEF";
+
+ImageWriter::~ImageWriter() { delete[] buffer; }
+
+ImageFormat ImageWriter::formatFor(const char* path) {
+  String name(path);
+  name.toLowerCase();
+  return name.endsWith(".bin") ? ImageFormat::BIN : ImageFormat::HEX;
+}
+
+bool ImageWriter::begin() {
+  if (!file) {
+    Logger::error("Output file is not open");
+    return false;
+  }
+  if (!buffer) {
+    buffer = new (std::nothrow) uint8_t[IMAGE_WRITER_BUFFER_SIZE];
+    if (!buffer) {
+      Logger::error("Not enough memory for the output buffer");
+      return false;
+    }
+  }
+  used = 0;
+  written = 0;
+  next_address = 0;
+  segment = 0;
+  ok = true;
+  return true;
+}
+
+bool ImageWriter::flush() {
+  if (ok && used > 0) {
+    ok = file.write(buffer, used) == used;
+    if (!ok) Logger::error("Failed to write output file");
+    written += used;
+  }
+  used = 0;
+  return ok;
+}
+
+void ImageWriter::putRecord(uint8_t type, uint16_t address, const uint8_t* data,
+                            uint8_t length) {
+  uint8_t header[4] = {length, (uint8_t)(address >> 8), (uint8_t)address, type};
+  uint8_t sum = 0;
+  char* out = reinterpret_cast<char*>(buffer + used);
+  char* start = out;
+
+  *out++ = ':';
+  for (uint8_t i = 0; i < sizeof(header); i++) {
+    sum += header[i];
+    *out++ = kHexDigits[header[i] >> 4];
+    *out++ = kHexDigits[header[i] & 0x0F];
+  }
+  for (uint8_t i = 0; i < length; i++) {
+    sum += data[i];
+    *out++ = kHexDigits[data[i] >> 4];
+    *out++ = kHexDigits[data[i] & 0x0F];
+  }
+  sum = -sum;
+  *out++ = kHexDigits[sum >> 4];
+  *out++ = kHexDigits[sum & 0x0F];
+  *out++ = '\r';
+  *out++ = '\n';
+  used += out - start;
+}
+
+bool ImageWriter::write(uint32_t address, const uint8_t* data, uint32_t length) {
+  if (!buffer || !ok) return false;
+  return format == ImageFormat::BIN ? writeBin(address, data, length)
+                                    : writeHex(address, data, length);
+}
+
+// Records start on IMAGE_WRITER_RECORD_SIZE boundaries and never cross a
+// 64K segment, which gets an extended linear address record
+bool ImageWriter::writeHex(uint32_t address, const uint8_t* data, uint32_t length) {
+  while (length > 0) {
+    uint32_t chunk = IMAGE_WRITER_RECORD_SIZE - address % IMAGE_WRITER_RECORD_SIZE;
+    if (chunk > length) chunk = length;
+
+    bool blank = skip_blank;
+    for (uint32_t i = 0; i < chunk && blank; i++) blank = data[i] == 0xFF;
+
+    if (!blank) {
+      if (used + 2 * IMAGE_WRITER_MAX_LINE > IMAGE_WRITER_BUFFER_SIZE && !flush()) {
+        return false;
+      }
+      if ((address >> 16) != segment) {
+        segment = address >> 16;
+        uint8_t upper[2] = {(uint8_t)(segment >> 8), (uint8_t)segment};
+        putRecord(0x04, 0, upper, sizeof(upper));
+      }
+      putRecord(0x00, (uint16_t)address, data, chunk);
+    }
+
+    address += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+bool ImageWriter::writeBin(uint32_t address, const uint8_t* data, uint32_t length) {
+  if (address < next_address) {
+    Logger::error("Output address 0x%05X goes backwards\n", address);
+    ok = false;
+    return false;
+  }
+  while (next_address < address || length > 0) {
+    if (used == IMAGE_WRITER_BUFFER_SIZE && !flush()) return false;
+    uint32_t room = IMAGE_WRITER_BUFFER_SIZE - used;
+    if (next_address < address) {
+      uint32_t gap = address - next_address;
+      if (gap > room) gap = room;
+      memset(buffer + used, 0xFF, gap);
+      used += gap;
+      next_address += gap;
+      continue;
+    }
+    uint32_t chunk = length < room ? length : room;
+    memcpy(buffer + used, data, chunk);
+    used += chunk;
+    next_address += chunk;
+    data += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+bool ImageWriter::finish() {
+  if (!buffer || !ok) return false;
+  if (format == ImageFormat::HEX) {
+    if (used + IMAGE_WRITER_MAX_LINE > IMAGE_WRITER_BUFFER_SIZE && !flush()) {
+      return false;
+    }
+    putRecord(0x01, 0, nullptr, 0);
+  }
+  return flush();
+}
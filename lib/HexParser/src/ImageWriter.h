@@ -0,0 +1,55 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <MacroLogger.h>
+
+// Output buffer size. A multiple of the 512 byte SD sector, so every write
+// but the last one covers whole sectors.
+#define IMAGE_WRITER_BUFFER_SIZE 4096
+// Data bytes per Intel HEX record
+#define IMAGE_WRITER_RECORD_SIZE 16
+
+enum class ImageFormat { HEX, BIN };
+
+// Buffered Intel HEX or raw binary output. Records are encoded straight
+// into the buffer with a digit table and the buffer goes to the file in
+// large writes instead of one File call per line.
+class ImageWriter {
+ private:
+  File& file;
+  ImageFormat format;
+  uint8_t* buffer = nullptr;
+  uint32_t used = 0;
+  uint32_t written = 0;       // bytes handed to the file
+  uint32_t next_address = 0;  // BIN: address of the next file byte
+  uint16_t segment = 0;       // HEX: upper address bits of the last 04 record
+  bool skip_blank = false;
+  bool ok = true;
+
+  bool flush();
+  void putRecord(uint8_t type, uint16_t address, const uint8_t* data, uint8_t length);
+  bool writeHex(uint32_t address, const uint8_t* data, uint32_t length);
+  bool writeBin(uint32_t address, const uint8_t* data, uint32_t length);
+
+ public:
+  ImageWriter(File& file, ImageFormat format) : file(file), format(format) {}
+  ~ImageWriter();
+
+  // ".bin" files are written raw, everything else as Intel HEX
+  static ImageFormat formatFor(const char* path);
+
+  bool begin();
+  // HEX only: leave out records that are all 0xFF, the erased value
+  void setSkipBlank(bool enabled) { skip_blank = enabled; }
+  // Addresses must not go backwards. Gaps are left out of a HEX file and
+  // filled with 0xFF in a BIN file.
+  bool write(uint32_t address, const uint8_t* data, uint32_t length);
+  // Write the end of file record and the rest of the buffer
+  bool finish();
+  // Bytes in the file so far
+  uint32_t getBytesWritten() const { return written; }
+};
+
+#endif  // IMAGE_WRITER_H
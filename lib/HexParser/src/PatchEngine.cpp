@@ -0,0 +1,250 @@
+#include "PatchEngine.h"
+
+#include <Crc32.h>
+#include <new>
+
+PatchEngine::~PatchEngine() { clear(); }
+
+void PatchEngine::clear() {
+  delete[] nodes;
+  nodes = nullptr;
+  node_count = 0;
+  patch_count = 0;
+  max_length = 0;
+  set_id = 0;
+  begin();
+}
+
+bool PatchEngine::addPatch(const char* name, const uint8_t* pattern,
+                           const uint8_t* replacement, const uint8_t* keep,
+                           uint8_t length) {
+  if (patch_count >= PATCH_MAX_PATTERNS || length == 0 || length > PATCH_MAX_LENGTH) {
+    Logger::error("Patch %s rejected\n", name);
+    return false;
+  }
+
+  BinaryPatch& patch = patches[patch_count];
+  memset(&patch, 0, sizeof(patch));
+  strncpy(patch.name, name, PATCH_NAME_LENGTH - 1);
+  patch.length = length;
+  memcpy(patch.pattern, pattern, length);
+  memcpy(patch.replacement, replacement, length);
+  if (keep) {
+    memcpy(patch.keep, keep, (length + 7) / 8);
+  }
+  patch_count++;
+  return build();
+}
+
+bool PatchEngine::loadDefaults() {
+  clear();
+  // Arduboy lcdBootProgram: swap the SSD1306 charge pump setting for the
+  // SSD1309 one
+  static const uint8_t kSsd1309Pattern[] = {0xD5, 0xF0, 0x8D, 0x14, 0xA1, 0xC8, 0x81,
+                                            0xCF, 0xD9, 0xF1, 0xAF, 0x20, 0x00};
+  uint8_t replacement[sizeof(kSsd1309Pattern)];
+  memcpy(replacement, kSsd1309Pattern, sizeof(replacement));
+  replacement[2] = 0xE3;
+  replacement[3] = 0xE3;
+  return addPatch("ssd1309", kSsd1309Pattern, replacement, nullptr, sizeof(kSsd1309Pattern));
+}
+
+static bool parseHexBytes(const String& text, uint8_t* out, uint8_t* keep,
+                          uint8_t& length) {
+  if (text.length() == 0 || text.length() % 2 != 0 ||
+      text.length() / 2 > PATCH_MAX_LENGTH) {
+    return false;
+  }
+  length = text.length() / 2;
+  for (uint8_t i = 0; i < length; i++) {
+    char hi = text[i * 2];
+    char lo = text[i * 2 + 1];
+    if (hi == '.' && lo == '.' && keep) {
+      keep[i / 8] |= 1 << (i % 8);
+      out[i] = 0;
+      continue;
+    }
+    if (!isxdigit(hi) || !isxdigit(lo)) return false;
+    char byte[3] = {hi, lo, 0};
+    out[i] = (uint8_t)strtoul(byte, nullptr, 16);
+  }
+  return true;
+}
+
+bool PatchEngine::load(File& file) {
+  clear();
+  if (!file) return false;
+
+  bool ok = true;
+  uint32_t line_number = 0;
+  while (file.available()) {
+    String line = file.readStringUntil('\n');
+    line_number++;
+    int comment = line.indexOf('#');
+    if (comment >= 0) line.remove(comment);
+    line.trim();
+    if (line.length() == 0) continue;
+
+    // <name> <pattern> <replacement>
+    int first = line.indexOf(' ');
+    int last = line.lastIndexOf(' ');
+    String name = first > 0 ? line.substring(0, first) : String();
+    String pattern = first > 0 ? line.substring(first + 1, last) : String();
+    String replacement = line.substring(last + 1);
+    pattern.trim();
+
+    uint8_t pattern_bytes[PATCH_MAX_LENGTH];
+    uint8_t replacement_bytes[PATCH_MAX_LENGTH];
+    uint8_t keep[PATCH_MAX_LENGTH / 8] = {};
+    uint8_t pattern_length = 0;
+    uint8_t replacement_length = 0;
+    if (first <= 0 || first == last ||
+        !parseHexBytes(pattern, pattern_bytes, nullptr, pattern_length) ||
+        !parseHexBytes(replacement, replacement_bytes, keep, replacement_length) ||
+        pattern_length != replacement_length) {
+      Logger::error("Invalid patch on line %d\n", line_number);
+      ok = false;
+      continue;
+    }
+    ok = addPatch(name.c_str(), pattern_bytes, replacement_bytes, keep,
+                  pattern_length) && ok;
+  }
+
+  Logger::info("Loaded %d patches\n", patch_count);
+  return ok;
+}
+
+uint16_t PatchEngine::findChild(uint16_t node, uint8_t byte) const {
+  for (uint16_t child = nodes[node].child; child; child = nodes[child].sibling) {
+    if (nodes[child].byte == byte) return child;
+  }
+  return 0;
+}
+
+// Rebuild the trie with its failure and output links
+bool PatchEngine::build() {
+  uint16_t capacity = 1;
+  max_length = 0;
+  for (uint8_t i = 0; i < patch_count; i++) {
+    capacity += patches[i].length;
+    if (patches[i].length > max_length) max_length = patches[i].length;
+  }
+
+  delete[] nodes;
+  nodes = new (std::nothrow) Node[capacity];
+  uint16_t* queue = new (std::nothrow) uint16_t[capacity];
+  if (!nodes || !queue) {
+    Logger::error("Not enough memory for the patch matcher");
+    delete[] nodes;
+    delete[] queue;
+    nodes = nullptr;
+    node_count = 0;
+    return false;
+  }
+
+  nodes[0] = {0, 0, 0, 0, 0, -1};
+  node_count = 1;
+  for (uint8_t i = 0; i < patch_count; i++) {
+    uint16_t node = 0;
+    for (uint8_t j = 0; j < patches[i].length; j++) {
+      uint16_t child = findChild(node, patches[i].pattern[j]);
+      if (!child) {
+        child = node_count++;
+        nodes[child] = {0, nodes[node].child, 0, 0, patches[i].pattern[j], -1};
+        nodes[node].child = child;
+      }
+      node = child;
+    }
+    if (nodes[node].patch >= 0) {
+      Logger::error("Patch %s repeats the pattern of %s\n", patches[i].name,
+                    patches[nodes[node].patch].name);
+    } else {
+      nodes[node].patch = i;
+    }
+  }
+
+  // Breadth first, so the failure target of a node is always done before it
+  uint16_t head = 0;
+  uint16_t tail = 0;
+  for (uint16_t child = nodes[0].child; child; child = nodes[child].sibling) {
+    queue[tail++] = child;
+  }
+  while (head < tail) {
+    uint16_t node = queue[head++];
+    for (uint16_t child = nodes[node].child; child; child = nodes[child].sibling) {
+      uint16_t fail = nodes[node].fail;
+      while (fail && !findChild(fail, nodes[child].byte)) fail = nodes[fail].fail;
+      fail = findChild(fail, nodes[child].byte);
+      nodes[child].fail = fail;
+      nodes[child].output = nodes[fail].patch >= 0 ? fail : nodes[fail].output;
+      queue[tail++] = child;
+    }
+  }
+  delete[] queue;
+
+  set_id = crc32Final(crc32Update(CRC32_INIT, reinterpret_cast<const uint8_t*>(patches),
+                                  patch_count * sizeof(BinaryPatch)));
+  begin();
+  return true;
+}
+
+void PatchEngine::begin() {
+  state = 0;
+  run_start = 0;
+  run_end = 0;
+  applied = 0;
+}
+
+void PatchEngine::feed(uint32_t address, const uint8_t* data, uint32_t length,
+                       patch_writer_t writer, void* ctx) {
+  uint32_t all = (1UL << patch_count) - 1;
+  if (!nodes || applied == all) {
+    run_end = address + length;
+    return;
+  }
+
+  // A gap in the addresses starts a new stream
+  if (address != run_end) {
+    state = 0;
+    run_start = address;
+  }
+
+  for (uint32_t i = 0; i < length; i++) {
+    uint16_t node = state;
+    uint16_t child;
+    while (!(child = findChild(node, data[i])) && node) node = nodes[node].fail;
+    state = child;
+
+    uint16_t match = nodes[state].patch >= 0 ? state : nodes[state].output;
+    for (; match; match = nodes[match].output) {
+      uint8_t index = nodes[match].patch;
+      if (applied & (1UL << index)) continue;
+
+      const BinaryPatch& patch = patches[index];
+      uint32_t start = address + i + 1 - patch.length;
+      if (writer(start, patch.replacement, patch.keep, patch.length, ctx)) {
+        applied |= 1UL << index;
+        Logger::info("Patch %s applied at 0x%04X\n", patch.name, start);
+      } else {
+        Logger::error("Patch %s at 0x%04X missed, page already written\n",
+                      patch.name, start);
+      }
+    }
+  }
+  run_end = address + length;
+}
+
+bool PatchEngine::holds(uint32_t address, uint32_t length) const {
+  uint32_t all = (1UL << patch_count) - 1;
+  if (!nodes || patch_count == 0 || applied == all) return false;
+  uint32_t held = max_length - 1;
+  uint32_t fence = run_end - run_start < held ? run_start : run_end - held;
+  return address < run_end && address + length > fence;
+}
+
+void PatchEngine::printResults(uint32_t patches) const {
+  for (uint8_t i = 0; i < patch_count; i++) {
+    Logger::info("Patch %s: %s\n", this->patches[i].name,
+                 (patches & (1UL << i)) ? "applied" : "not found");
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef PATCH_ENGINE_H
+#define PATCH_ENGINE_H
+
+#include <Arduino.h>
+#include <FS.h>
+#include <MacroLogger.h>
+
+#define PATCH_MAX_PATTERNS 16
+#define PATCH_MAX_LENGTH   32
+#define PATCH_NAME_LENGTH  16
+
+// A byte pattern and its replacement. Bytes whose keep bit is set are left
+// as they are, so a patch can change a few bytes inside a longer signature.
+struct BinaryPatch {
+  char name[PATCH_NAME_LENGTH];
+  uint8_t length;
+  uint8_t pattern[PATCH_MAX_LENGTH];
+  uint8_t replacement[PATCH_MAX_LENGTH];
+  uint8_t keep[PATCH_MAX_LENGTH / 8];
+};
+
+// Matches every pattern of a patch set in one pass over the data records
+// with an Aho-Corasick automaton. Records that continue at the address
+// where the previous one ended are one stream, so matches can span records.
+// Every patch is applied at its first match only.
+class PatchEngine {
+ public:
+  // Writes a replacement into the image. Returns false when the bytes are
+  // no longer in memory, e.g. a page that was already streamed out.
+  typedef bool (*patch_writer_t)(uint32_t address, const uint8_t* data,
+                                 const uint8_t* keep, uint32_t length, void* ctx);
+
+ private:
+  struct Node {
+    uint16_t child;    // first child, 0 if none
+    uint16_t sibling;  // next child of the same parent
+    uint16_t fail;     // longest proper suffix that is in the trie
+    uint16_t output;   // longest suffix that ends a pattern, 0 if none
+    uint8_t byte;
+    int8_t patch;      // pattern ending here, -1 if none
+  };
+
+  BinaryPatch patches[PATCH_MAX_PATTERNS];
+  uint8_t patch_count = 0;
+  uint8_t max_length = 0;
+  uint32_t set_id = 0;
+
+  Node* nodes = nullptr;
+  uint16_t node_count = 0;
+
+  // Match state of the current parse
+  uint16_t state = 0;
+  uint32_t run_start = 0;
+  uint32_t run_end = 0;
+  uint32_t applied = 0;
+
+  bool build();
+  uint16_t findChild(uint16_t node, uint8_t byte) const;
+
+ public:
+  PatchEngine() {}
+  ~PatchEngine();
+
+  void clear();
+  bool addPatch(const char* name, const uint8_t* pattern,
+                const uint8_t* replacement, const uint8_t* keep, uint8_t length);
+  // Built-in set: the SSD1309 display init fix
+  bool loadDefaults();
+  // Patch set file, one patch per line:
+  //   <name> <pattern hex> <replacement hex>
+  // with ".." in the replacement for bytes that stay. '#' starts a comment.
+  bool load(File& file);
+
+  uint8_t getPatchCount() const { return patch_count; }
+  const char* getPatchName(uint8_t index) const { return patches[index].name; }
+  // CRC32 over the whole patch set, changes whenever a patch changes
+  uint32_t getSetId() const { return set_id; }
+
+  // Reset the match state before a parse
+  void begin();
+  void feed(uint32_t address, const uint8_t* data, uint32_t length,
+            patch_writer_t writer, void* ctx);
+  // True while a later match could still change some of these bytes: they
+  // lie in the last max pattern length - 1 bytes of the current stream
+  bool holds(uint32_t address, uint32_t length) const;
+  // Bit n is set when patch n was applied in this parse
+  uint32_t getApplied() const { return applied; }
+  // Log which patches of a result mask were applied
+  void printResults(uint32_t patches) const;
+};
+
+#endif  // PATCH_ENGINE_H
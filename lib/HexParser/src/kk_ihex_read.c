@@ -1,21 +1,98 @@
 #include "kk_ihex_read.h"
-#include <ctype.h>
 
-// External callback function declaration
-extern ihex_bool_t ihex_data_read(struct ihex_state *ihex, ihex_record_type_t type, ihex_bool_t checksum_error);
+// Nibble value of every character, 0xFF for anything that is not a hex digit
+static const uint8_t hex_lut[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+       0,    1,    2,    3,    4,    5,    6,    7,    8,    9, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF,   10,   11,   12,   13,   14,   15, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+#define IS_HEX_DIGIT(c) (hex_lut[(uint8_t)(c)] < 16)
 
 static uint8_t hex_digit_value(char c) {
-    if (c >= '0' && c <= '9') return c - '0';
-    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
-    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
-    return 0;
+    uint8_t value = hex_lut[(uint8_t)c];
+    return value < 16 ? value : 0;
 }
 
-static uint8_t read_hex_byte(const char *hex) {
-    return (hex_digit_value(hex[0]) << 4) | hex_digit_value(hex[1]);
+// Fast path for a record that lies completely in the buffer. line points at
+// the ':' and avail counts the characters from there on. The record is
+// decoded with two table lookups per byte and checksummed in the same pass.
+// Returns the number of characters consumed, 0 if the record is incomplete
+// or not plain hex (the state machine takes over) and -1 if the callback
+// aborted the parse.
+static int ihex_read_record(struct ihex_state *ihex, const char *line, size_t avail) {
+    if (avail < 11) return 0;
+
+    const uint8_t *p = (const uint8_t *)line + 1;
+    uint8_t hi = hex_lut[p[0]];
+    uint8_t lo = hex_lut[p[1]];
+    if ((hi | lo) & 0xF0) return 0;
+
+    uint8_t length = (uint8_t)((hi << 4) | lo);
+    size_t record_chars = 11 + (size_t)length * 2;
+    if (avail < record_chars) return 0;
+
+    // Header, data and checksum in one loop; invalid digits are collected
+    // in bad and checked once at the end
+    uint8_t header[4];
+    uint8_t bad = 0;
+    uint8_t checksum = 0;
+    header[0] = length;
+    for (uint8_t i = 1; i < 4; i++) {
+        hi = hex_lut[p[i * 2]];
+        lo = hex_lut[p[i * 2 + 1]];
+        bad |= hi | lo;
+        header[i] = (uint8_t)((hi << 4) | lo);
+    }
+    p += 8;
+    for (uint8_t i = 0; i < length; i++) {
+        hi = hex_lut[p[0]];
+        lo = hex_lut[p[1]];
+        bad |= hi | lo;
+        ihex->data[i] = (uint8_t)((hi << 4) | lo);
+        checksum += ihex->data[i];
+        p += 2;
+    }
+    hi = hex_lut[p[0]];
+    lo = hex_lut[p[1]];
+    bad |= hi | lo;
+    if (bad & 0xF0) return 0;
+
+    checksum += header[0] + header[1] + header[2] + header[3] + (uint8_t)((hi << 4) | lo);
+
+    ihex->length = length;
+    ihex->address_high = header[1];
+    ihex->address_low = header[2];
+    ihex->type = header[3];
+    ihex->checksum = checksum;
+    ihex->address = (ihex->segment << 16) | (header[1] << 8) | header[2];
+
+    if (ihex->type == IHEX_EXTENDED_LINEAR_ADDRESS_RECORD && length == 2) {
+        ihex->segment = (ihex->data[0] << 8) | ihex->data[1];
+    }
+
+    if (!ihex->callback(ihex, ihex->type, checksum != 0)) {
+        return -1;
+    }
+    return (int)record_chars;
 }
 
-void ihex_begin_read(struct ihex_state *ihex) {
+void ihex_begin_read(struct ihex_state *ihex, ihex_data_read_t callback, void *context) {
+    ihex->callback = callback;
+    ihex->context = context;
     ihex->address = 0;
     ihex->segment = 0;
     ihex->state = IHEX_READ_WHOLE_LINE;
@@ -29,6 +106,13 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
         switch (ihex->state) {
             case IHEX_READ_WHOLE_LINE:
                 if (c == ':') {
+                    int consumed = ihex_read_record(ihex, data + pos, length - pos);
+                    if (consumed < 0) return false;
+                    if (consumed > 0) {
+                        pos += consumed - 1;
+                        ihex->state = IHEX_IGNORE_LF;
+                        break;
+                    }
                     ihex->state = IHEX_READ_BYTE_COUNT;
                     ihex->i = 0;
                     ihex->checksum = 0;
@@ -36,7 +120,7 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
                 break;
                 
             case IHEX_READ_BYTE_COUNT:
-                if (isxdigit(c) && ihex->i < 2) {
+                if (IS_HEX_DIGIT(c) && ihex->i < 2) {
                     if (ihex->i == 0) {
                         ihex->length = hex_digit_value(c) << 4;
                     } else {
@@ -51,7 +135,7 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
                 break;
                 
             case IHEX_READ_ADDRESS_HIGH:
-                if (isxdigit(c) && ihex->i < 2) {
+                if (IS_HEX_DIGIT(c) && ihex->i < 2) {
                     if (ihex->i == 0) {
                         ihex->address_high = hex_digit_value(c) << 4;
                     } else {
@@ -66,7 +150,7 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
                 break;
                 
             case IHEX_READ_ADDRESS_LOW:
-                if (isxdigit(c) && ihex->i < 2) {
+                if (IS_HEX_DIGIT(c) && ihex->i < 2) {
                     if (ihex->i == 0) {
                         ihex->address_low = hex_digit_value(c) << 4;
                     } else {
@@ -82,7 +166,7 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
                 break;
                 
             case IHEX_READ_TYPE:
-                if (isxdigit(c) && ihex->i < 2) {
+                if (IS_HEX_DIGIT(c) && ihex->i < 2) {
                     if (ihex->i == 0) {
                         ihex->type = hex_digit_value(c) << 4;
                     } else {
@@ -97,7 +181,7 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
                 break;
                 
             case IHEX_READ_DATA:
-                if (isxdigit(c) && ihex->i < ihex->length * 2) {
+                if (IS_HEX_DIGIT(c) && ihex->i < ihex->length * 2) {
                     uint8_t byte_idx = ihex->i / 2;
                     if (ihex->i % 2 == 0) {
                         ihex->data[byte_idx] = hex_digit_value(c) << 4;
@@ -114,7 +198,7 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
                 break;
                 
             case IHEX_READ_CHECKSUM:
-                if (isxdigit(c) && ihex->i < 2) {
+                if (IS_HEX_DIGIT(c) && ihex->i < 2) {
                     if (ihex->i == 0) {
                         ihex->checksum = (ihex->checksum + (hex_digit_value(c) << 4));
                     } else {
@@ -126,7 +210,7 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
                         }
                         
                         // Call user callback
-                        if (!ihex_data_read(ihex, ihex->type, ihex->checksum != 0)) {
+                        if (!ihex->callback(ihex, ihex->type, ihex->checksum != 0)) {
                             return false;
                         }
                         
@@ -142,6 +226,12 @@ ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t le
                 if (c == '\n' || c == '\r') {
                     ihex->state = IHEX_READ_WHOLE_LINE;
                 } else if (c == ':') {
+                    int consumed = ihex_read_record(ihex, data + pos, length - pos);
+                    if (consumed < 0) return false;
+                    if (consumed > 0) {
+                        pos += consumed - 1;
+                        break;
+                    }
                     ihex->state = IHEX_READ_BYTE_COUNT;
                     ihex->i = 0;
                     ihex->checksum = 0;
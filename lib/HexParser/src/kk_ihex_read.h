@@ -19,7 +19,15 @@ typedef uint8_t ihex_record_type_t;
 #define IHEX_EXTENDED_LINEAR_ADDRESS_RECORD 4
 #define IHEX_START_LINEAR_ADDRESS_RECORD    5
 
+struct ihex_state;
+
+// Called for every complete record, a false return stops the read
+typedef ihex_bool_t (*ihex_data_read_t)(struct ihex_state *ihex, ihex_record_type_t type,
+                                        ihex_bool_t checksum_error);
+
 struct ihex_state {
+    ihex_data_read_t callback;
+    void *context;  // user pointer for the callback
     uint32_t address;
     uint32_t segment;
     uint8_t data[255];
@@ -44,13 +52,10 @@ struct ihex_state {
 
 #define IHEX_LINEAR_ADDRESS(ihex) ((ihex)->address)
 
-void ihex_begin_read(struct ihex_state *ihex);
+void ihex_begin_read(struct ihex_state *ihex, ihex_data_read_t callback, void *context);
 ihex_bool_t ihex_read_bytes(struct ihex_state *ihex, const char *data, size_t length);
 void ihex_end_read(struct ihex_state *ihex);
 
-// Callback function to be implemented by user
-ihex_bool_t ihex_data_read(struct ihex_state *ihex, ihex_record_type_t type, ihex_bool_t checksum_error);
-
 #ifdef __cplusplus
 }
 #endif
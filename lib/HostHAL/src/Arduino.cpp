@@ -0,0 +1,198 @@
+#include "Arduino.h"
+
+#include <poll.h>
+#include <stdarg.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <thread>
+
+#include "HostHAL.h"
+
+HardwareSerial Serial;
+
+// ==========================================
+// STRING
+// ==========================================
+
+void String::trim() {
+  size_t start = 0;
+  while (start < s.size() && isspace((unsigned char)s[start])) start++;
+  size_t end = s.size();
+  while (end > start && isspace((unsigned char)s[end - 1])) end--;
+  s = s.substr(start, end - start);
+}
+
+void String::toLowerCase() {
+  for (char& c : s) c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+  for (char& c : s) c = toupper((unsigned char)c);
+}
+
+// ==========================================
+// PRINT / STREAM
+// ==========================================
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (size--) written += write(*buffer++);
+  return written;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buffer[512];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length < 0) return 0;
+  return write((const uint8_t*)buffer, std::min((size_t)length, sizeof(buffer) - 1));
+}
+
+size_t Stream::readBytes(char* buffer, size_t length) {
+  size_t count = 0;
+  while (count < length) {
+    int c = read();
+    if (c < 0) break;
+    buffer[count++] = (char)c;
+  }
+  return count;
+}
+
+String Stream::readStringUntil(char terminator) {
+  std::string result;
+  int c;
+  while ((c = read()) >= 0 && c != terminator) result += (char)c;
+  return String(result);
+}
+
+String Stream::readString() {
+  std::string result;
+  int c;
+  while ((c = read()) >= 0) result += (char)c;
+  return String(result);
+}
+
+// ==========================================
+// SERIAL
+// ==========================================
+
+static int serial_peeked = -1;
+
+int HardwareSerial::available() {
+  if (serial_peeked >= 0) return 1;
+  struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+  return poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN) ? 1 : 0;
+}
+
+int HardwareSerial::read() {
+  if (serial_peeked >= 0) {
+    int c = serial_peeked;
+    serial_peeked = -1;
+    return c;
+  }
+  if (!available()) return -1;
+  uint8_t c;
+  return ::read(STDIN_FILENO, &c, 1) == 1 ? c : -1;
+}
+
+int HardwareSerial::peek() {
+  if (serial_peeked < 0) serial_peeked = read();
+  return serial_peeked;
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  size_t written = fwrite(buffer, 1, size, stdout);
+  fflush(stdout);
+  return written;
+}
+
+// ==========================================
+// TIME
+// ==========================================
+
+static const auto kStart = std::chrono::steady_clock::now();
+static std::atomic<uint64_t> simulated_us{0};
+
+static bool realtime() {
+  static const bool enabled = getenv("HOST_REALTIME") != nullptr;
+  return enabled;
+}
+
+uint64_t hostMicros() {
+  auto elapsed = std::chrono::steady_clock::now() - kStart;
+  return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() +
+         simulated_us.load();
+}
+
+void hostAdvance(uint64_t us) {
+  if (realtime()) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+  } else {
+    simulated_us += us;
+  }
+}
+
+unsigned long millis() { return (unsigned long)(hostMicros() / 1000); }
+unsigned long micros() { return (unsigned long)(uint32_t)hostMicros(); }
+void delay(unsigned long ms) { hostAdvance((uint64_t)ms * 1000); }
+void delayMicroseconds(unsigned int us) { hostAdvance(us); }
+void yield() { std::this_thread::yield(); }
+
+// ==========================================
+// GPIO
+// ==========================================
+
+static uint8_t pin_modes[HOST_PIN_COUNT];
+static uint8_t pin_levels[HOST_PIN_COUNT];
+static uint8_t pin_inputs[HOST_PIN_COUNT];
+static bool pins_ready = false;
+
+static void initPins() {
+  if (pins_ready) return;
+  memset(pin_inputs, HIGH, sizeof(pin_inputs));  // idle buttons read high
+  pins_ready = true;
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  initPins();
+  if (pin < HOST_PIN_COUNT) pin_modes[pin] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  initPins();
+  if (pin < HOST_PIN_COUNT) pin_levels[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  initPins();
+  if (pin >= HOST_PIN_COUNT) return LOW;
+  return pin_modes[pin] == OUTPUT ? pin_levels[pin] : pin_inputs[pin];
+}
+
+void hostSetPin(uint8_t pin, uint8_t level) {
+  initPins();
+  if (pin < HOST_PIN_COUNT) pin_inputs[pin] = level ? HIGH : LOW;
+}
+
+uint8_t hostGetPin(uint8_t pin) {
+  initPins();
+  return pin < HOST_PIN_COUNT ? pin_levels[pin] : LOW;
+}
+
+// ==========================================
+// ENTRY POINT
+// ==========================================
+
+int main() {
+  setup();
+  for (;;) {
+    loop();
+  }
+}
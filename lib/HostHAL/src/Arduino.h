@@ -0,0 +1,171 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+// Host build of the subset of the Arduino core the firmware uses. Time is
+// simulated: delay() and delayMicroseconds() advance the clock instead of
+// sleeping, so waits on a simulated target cost no wall time. Set
+// HOST_REALTIME in the environment to sleep for real instead.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+// ESP32-S2 default SPI pins
+#define SCK 7
+#define MOSI 11
+#define MISO 9
+#define SS 12
+
+#define B10000000 128
+#define B01000000 64
+#define B00100000 32
+#define B00010000 16
+#define B00001000 8
+#define B00000100 4
+#define B00000010 2
+#define B00000001 1
+
+#define PROGMEM
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+
+using std::max;
+using std::min;
+
+class String {
+ private:
+  std::string s;
+
+ public:
+  String() {}
+  String(const char* str) : s(str ? str : "") {}
+  String(const std::string& str) : s(str) {}
+  explicit String(char c) : s(1, c) {}
+  String(int value) : s(std::to_string(value)) {}
+  String(unsigned int value) : s(std::to_string(value)) {}
+  String(long value) : s(std::to_string(value)) {}
+  String(unsigned long value) : s(std::to_string(value)) {}
+
+  unsigned int length() const { return s.size(); }
+  const char* c_str() const { return s.c_str(); }
+  bool isEmpty() const { return s.empty(); }
+
+  bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.size(), prefix.s) == 0; }
+  bool endsWith(const String& suffix) const {
+    return s.size() >= suffix.s.size() &&
+           s.compare(s.size() - suffix.s.size(), suffix.s.size(), suffix.s) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const { return find(s.find(c, from)); }
+  int indexOf(const String& str, unsigned int from = 0) const { return find(s.find(str.s, from)); }
+  int lastIndexOf(char c) const { return find(s.rfind(c)); }
+  String substring(unsigned int from) const { return from < s.size() ? String(s.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    return from < s.size() && to > from ? String(s.substr(from, to - from)) : String();
+  }
+  char charAt(unsigned int index) const { return index < s.size() ? s[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  long toInt() const { return strtol(s.c_str(), nullptr, 10); }
+
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+  void remove(unsigned int index) { if (index < s.size()) s.erase(index); }
+  void remove(unsigned int index, unsigned int count) { if (index < s.size()) s.erase(index, count); }
+  bool reserve(unsigned int size) { s.reserve(size); return true; }
+  bool concat(const String& str) { s += str.s; return true; }
+
+  String& operator+=(const String& str) { s += str.s; return *this; }
+  String& operator+=(const char* str) { s += str; return *this; }
+  String& operator+=(char c) { s += c; return *this; }
+  friend String operator+(const String& a, const String& b) { return String(a.s + b.s); }
+  friend String operator+(const String& a, const char* b) { return String(a.s + b); }
+  friend String operator+(const char* a, const String& b) { return String(a + b.s); }
+  bool operator==(const String& other) const { return s == other.s; }
+  bool operator==(const char* other) const { return s == other; }
+  bool operator!=(const String& other) const { return s != other.s; }
+  bool operator<(const String& other) const { return s < other.s; }
+  bool equals(const String& other) const { return s == other.s; }
+
+ private:
+  static int find(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str) { return write((const uint8_t*)str, strlen(str)); }
+
+  size_t print(const String& str) { return write((const uint8_t*)str.c_str(), str.length()); }
+  size_t print(const char* str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(long value) { return printf("%ld", value); }
+  size_t print(int value) { return print((long)value); }
+  size_t print(unsigned long value) { return printf("%lu", value); }
+  size_t print(unsigned int value) { return print((unsigned long)value); }
+  size_t print(double value) { return printf("%.2f", value); }
+  template <typename T>
+  size_t println(const T& value) { return print(value) + println(); }
+  size_t println() { return write("\r\n"); }
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  size_t readBytes(char* buffer, size_t length);
+  size_t readBytes(uint8_t* buffer, size_t length) { return readBytes((char*)buffer, length); }
+  String readStringUntil(char terminator);
+  String readString();
+};
+
+// Serial on stdout, input is read from stdin without blocking
+class HardwareSerial : public Stream {
+ public:
+  void begin(unsigned long baud) {}
+  void end() {}
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+// Arduino entry points, called from the host main()
+void setup();
+void loop();
+
+#endif  // HOST_ARDUINO_H
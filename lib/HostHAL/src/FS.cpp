@@ -0,0 +1,186 @@
+#include "FS.h"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "HostHAL.h"
+
+#define HOST_SD_SECTOR 512
+
+static std::atomic<uint32_t> sd_sector_us{0};
+
+void hostSetSdSectorTime(uint32_t us) { sd_sector_us = us; }
+
+namespace fs {
+
+struct FileImpl {
+  std::string host_path;
+  std::string path;
+  std::string name;
+  FILE* fp = nullptr;
+  bool directory = false;
+  std::vector<std::string> entries;  // sorted directory listing
+  size_t next = 0;
+  long sector = -1;  // last sector read, reads within it cost nothing
+  std::shared_ptr<FileLimit> limit;
+
+  ~FileImpl() {
+    if (fp) {
+      fclose(fp);
+      limit->open--;
+    }
+  }
+};
+
+static std::string baseName(const std::string& path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+static std::shared_ptr<FileImpl> openImpl(const std::string& host_path,
+                                          const std::string& path, const char* mode,
+                                          const std::shared_ptr<FileLimit>& limit) {
+  auto impl = std::make_shared<FileImpl>();
+  impl->limit = limit;
+  impl->host_path = host_path;
+  impl->path = path.empty() ? "/" : path;
+  impl->name = baseName(path);
+
+  struct stat st;
+  bool exists = stat(host_path.c_str(), &st) == 0;
+  if (exists && S_ISDIR(st.st_mode)) {
+    impl->directory = true;
+    if (DIR* dir = opendir(host_path.c_str())) {
+      while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') impl->entries.push_back(entry->d_name);
+      }
+      closedir(dir);
+    }
+    std::sort(impl->entries.begin(), impl->entries.end());
+    return impl;
+  }
+
+  if (limit->max > 0 && limit->open >= limit->max) {
+    fprintf(stderr, "[E] open(%s): too many open files\n", path.c_str());
+    return nullptr;
+  }
+  if (mode[0] == 'r') {
+    if (!exists) return nullptr;
+    impl->fp = fopen(host_path.c_str(), "rb");
+  } else if (mode[0] == 'w') {
+    impl->fp = fopen(host_path.c_str(), "wb+");
+  } else {
+    impl->fp = fopen(host_path.c_str(), "ab+");
+  }
+  if (!impl->fp) return nullptr;
+  limit->open++;
+  return impl;
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  return impl && impl->fp ? fwrite(buffer, 1, size, impl->fp) : 0;
+}
+
+int File::available() {
+  if (!impl || !impl->fp) return 0;
+  return (int)(size() - position());
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int File::peek() {
+  if (!impl || !impl->fp) return -1;
+  int c = fgetc(impl->fp);
+  if (c >= 0) ungetc(c, impl->fp);
+  return c;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  if (!impl || !impl->fp) return 0;
+  long start = ftell(impl->fp);
+  size_t length = fread(buffer, 1, size, impl->fp);
+  uint32_t us = sd_sector_us;
+  if (us && length > 0) {
+    long first = start / HOST_SD_SECTOR;
+    long last = (start + (long)length - 1) / HOST_SD_SECTOR;
+    uint32_t sectors = (uint32_t)(last - first + 1) - (first == impl->sector ? 1 : 0);
+    impl->sector = last;
+    hostAdvance((uint64_t)sectors * us);
+  }
+  return length;
+}
+
+void File::flush() {
+  if (impl && impl->fp) fflush(impl->fp);
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  return impl && impl->fp && fseek(impl->fp, pos, mode) == 0;
+}
+
+size_t File::position() const { return impl && impl->fp ? ftell(impl->fp) : 0; }
+
+size_t File::size() const {
+  if (!impl) return 0;
+  if (impl->fp) fflush(impl->fp);
+  struct stat st;
+  return stat(impl->host_path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+void File::close() { impl.reset(); }
+
+time_t File::getLastWrite() {
+  struct stat st;
+  return impl && stat(impl->host_path.c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+const char* File::name() const { return impl ? impl->name.c_str() : ""; }
+
+const char* File::path() const { return impl ? impl->path.c_str() : ""; }
+
+bool File::isDirectory() const { return impl && impl->directory; }
+
+File File::openNextFile(const char* mode) {
+  if (!impl || !impl->directory || impl->next >= impl->entries.size()) return File();
+  const std::string& entry = impl->entries[impl->next++];
+  std::string path = (impl->path == "/" ? "" : impl->path) + "/" + entry;
+  return File(openImpl(impl->host_path + "/" + entry, path, mode, impl->limit));
+}
+
+void File::rewindDirectory() {
+  if (impl) impl->next = 0;
+}
+
+File::operator bool() const { return impl && (impl->directory || impl->fp); }
+
+std::string FS::hostPath(const char* path) const {
+  return root + (path && path[0] == '/' ? "" : "/") + (path ? path : "");
+}
+
+File FS::open(const char* path, const char* mode, bool create) {
+  return File(openImpl(hostPath(path), path, mode, limit));
+}
+
+bool FS::exists(const char* path) {
+  struct stat st;
+  return stat(hostPath(path).c_str(), &st) == 0;
+}
+
+bool FS::remove(const char* path) { return ::unlink(hostPath(path).c_str()) == 0; }
+
+bool FS::rename(const char* from, const char* to) {
+  return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool FS::mkdir(const char* path) { return ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+
+bool FS::rmdir(const char* path) { return ::rmdir(hostPath(path).c_str()) == 0; }
+
+}  // namespace fs
@@ -0,0 +1,95 @@
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <time.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Arduino.h"
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+struct FileImpl;
+
+// Open files of a file system, limited like the file table of the ESP32
+// FAT driver. Directories do not count.
+struct FileLimit {
+  std::atomic<int> open{0};
+  int max = 0;  // 0 for no limit
+};
+
+// File or directory below the root of a host directory backed FS
+class File : public Stream {
+ private:
+  std::shared_ptr<FileImpl> impl;
+
+ public:
+  File() {}
+  explicit File(std::shared_ptr<FileImpl> impl) : impl(std::move(impl)) {}
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  size_t read(uint8_t* buffer, size_t size);
+  size_t readBytes(char* buffer, size_t length) { return read((uint8_t*)buffer, length); }
+  void flush();
+  bool seek(uint32_t pos, SeekMode mode = SeekSet);
+  size_t position() const;
+  size_t size() const;
+  void close();
+  time_t getLastWrite();
+  const char* name() const;
+  const char* path() const;
+  bool isDirectory() const;
+  File openNextFile(const char* mode = FILE_READ);
+  void rewindDirectory();
+  explicit operator bool() const;
+};
+
+class FS {
+ private:
+  std::string root;
+
+ protected:
+  std::shared_ptr<FileLimit> limit = std::make_shared<FileLimit>();
+  std::string hostPath(const char* path) const;
+
+ public:
+  explicit FS(const std::string& root = ".") : root(root) {}
+  void setRoot(const std::string& path) { root = path; }
+  const std::string& getRoot() const { return root; }
+
+  File open(const char* path, const char* mode = FILE_READ, bool create = false);
+  File open(const String& path, const char* mode = FILE_READ, bool create = false) {
+    return open(path.c_str(), mode, create);
+  }
+  bool exists(const char* path);
+  bool exists(const String& path) { return exists(path.c_str()); }
+  bool remove(const char* path);
+  bool remove(const String& path) { return remove(path.c_str()); }
+  bool rename(const char* from, const char* to);
+  bool rename(const String& from, const String& to) { return rename(from.c_str(), to.c_str()); }
+  bool mkdir(const char* path);
+  bool mkdir(const String& path) { return mkdir(path.c_str()); }
+  bool rmdir(const char* path);
+  bool rmdir(const String& path) { return rmdir(path.c_str()); }
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+
+#endif  // HOST_FS_H
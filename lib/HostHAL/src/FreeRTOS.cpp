@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Arduino.h"
+
+// ==========================================
+// TASKS
+// ==========================================
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created) {
+  std::thread thread(task, parameters);
+  if (created) *created = (TaskHandle_t)(uintptr_t)std::hash<std::thread::id>()(thread.get_id());
+  thread.detach();
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name,
+                                   uint32_t stack_depth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* created,
+                                   BaseType_t core) {
+  return xTaskCreate(task, name, stack_depth, parameters, priority, created);
+}
+
+// Host threads end by returning from the task function
+void vTaskDelete(TaskHandle_t task) {}
+
+void vTaskDelay(TickType_t ticks) { delay(ticks * portTICK_PERIOD_MS); }
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) { return 1; }
+
+// ==========================================
+// QUEUES
+// ==========================================
+
+struct HostQueue {
+  size_t length;
+  size_t item_size;
+  std::deque<std::vector<uint8_t>> items;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+template <typename Predicate>
+static bool waitFor(HostQueue& queue, std::unique_lock<std::mutex>& lock,
+                    TickType_t ticks, Predicate ready) {
+  if (ticks == portMAX_DELAY) {
+    queue.changed.wait(lock, ready);
+    return true;
+  }
+  return queue.changed.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+  HostQueue* queue = new HostQueue();
+  queue->length = length;
+  queue->item_size = item_size;
+  return queue;
+}
+
+void vQueueDelete(QueueHandle_t handle) { delete static_cast<HostQueue*>(handle); }
+
+BaseType_t xQueueSend(QueueHandle_t handle, const void* item, TickType_t ticks_to_wait) {
+  HostQueue& queue = *static_cast<HostQueue*>(handle);
+  std::unique_lock<std::mutex> lock(queue.mutex);
+  if (!waitFor(queue, lock, ticks_to_wait, [&] { return queue.items.size() < queue.length; })) {
+    return errQUEUE_FULL;
+  }
+  const uint8_t* bytes = static_cast<const uint8_t*>(item);
+  queue.items.emplace_back(bytes, bytes + queue.item_size);
+  queue.changed.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t handle, void* buffer, TickType_t ticks_to_wait) {
+  HostQueue& queue = *static_cast<HostQueue*>(handle);
+  std::unique_lock<std::mutex> lock(queue.mutex);
+  if (!waitFor(queue, lock, ticks_to_wait, [&] { return !queue.items.empty(); })) {
+    return pdFALSE;
+  }
+  memcpy(buffer, queue.items.front().data(), queue.item_size);
+  queue.items.pop_front();
+  queue.changed.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle) {
+  HostQueue& queue = *static_cast<HostQueue*>(handle);
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  return queue.items.size();
+}
+
+// ==========================================
+// MUTEXES
+// ==========================================
+
+SemaphoreHandle_t xSemaphoreCreateMutex() { return new std::timed_mutex(); }
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  delete static_cast<std::timed_mutex*>(semaphore);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks_to_wait) {
+  std::timed_mutex& mutex = *static_cast<std::timed_mutex*>(semaphore);
+  if (ticks_to_wait == portMAX_DELAY) {
+    mutex.lock();
+    return pdTRUE;
+  }
+  return mutex.try_lock_for(std::chrono::milliseconds(ticks_to_wait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  static_cast<std::timed_mutex*>(semaphore)->unlock();
+  return pdTRUE;
+}
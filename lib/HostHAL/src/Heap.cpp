@@ -0,0 +1,30 @@
+#include <malloc.h>
+#include <stdlib.h>
+
+#include "esp_heap_caps.h"
+
+void* heap_caps_malloc(size_t size, uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) {
+    return nullptr;
+  }
+  return malloc(size);
+}
+
+void heap_caps_free(void* ptr) { free(ptr); }
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) return 0;
+  return mallinfo2().arena;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) return 0;
+  return mallinfo2().fordblks;
+}
+
+// glibc does not report its largest free chunk, the releasable top of the
+// arena is the nearest figure
+size_t heap_caps_get_largest_free_block(uint32_t caps) {
+  if (caps & MALLOC_CAP_SPIRAM) return 0;
+  return mallinfo2().keepcost;
+}
@@ -0,0 +1,25 @@
+#ifndef HOST_HAL_H
+#define HOST_HAL_H
+
+#include <stdint.h>
+
+// Controls of the host environment that have no Arduino counterpart, used
+// by benchmarks to drive inputs and read the simulated clock
+
+#define HOST_PIN_COUNT 48
+
+// Level read back from an input pin, e.g. to press a button (LOW)
+void hostSetPin(uint8_t pin, uint8_t level);
+// Level last written to an output pin
+uint8_t hostGetPin(uint8_t pin);
+
+// Simulated time in microseconds, without the 32-bit wrap of micros()
+uint64_t hostMicros();
+// Let simulated time pass (sleeps instead with HOST_REALTIME set)
+void hostAdvance(uint64_t us);
+
+// Simulated time a file read spends on every 512-byte sector it moves to,
+// like an SD card behind FatFs; 0 (the default) makes reads free
+void hostSetSdSectorTime(uint32_t us);
+
+#endif  // HOST_HAL_H
@@ -0,0 +1,40 @@
+#ifndef HOST_MACRO_LOGGER_H
+#define HOST_MACRO_LOGGER_H
+
+#include <stdio.h>
+#include <string.h>
+
+// printf style logger with the interface of MacroLogger, writing to stdout
+namespace Logger {
+
+enum class Level { DEBUG, INFO, WARNING, ERROR, NONE };
+
+inline Level& level() {
+  static Level current = Level::INFO;
+  return current;
+}
+
+inline void set_level(Level new_level) { level() = new_level; }
+
+template <typename... Args>
+inline void log(Level at, const char* tag, const char* format, Args... args) {
+  if (at < level()) return;
+  printf("[%s] ", tag);
+  printf(format, args...);
+  size_t length = strlen(format);
+  if (length == 0 || format[length - 1] != '\n') putchar('\n');
+  fflush(stdout);
+}
+
+template <typename... Args>
+inline void debug(const char* format = "", Args... args) { log(Level::DEBUG, "DEBUG", format, args...); }
+template <typename... Args>
+inline void info(const char* format = "", Args... args) { log(Level::INFO, "INFO", format, args...); }
+template <typename... Args>
+inline void warning(const char* format = "", Args... args) { log(Level::WARNING, "WARN", format, args...); }
+template <typename... Args>
+inline void error(const char* format = "", Args... args) { log(Level::ERROR, "ERROR", format, args...); }
+
+}  // namespace Logger
+
+#endif  // HOST_MACRO_LOGGER_H
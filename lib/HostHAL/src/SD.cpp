@@ -0,0 +1,29 @@
+#include "SD.h"
+
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+SDFS SD;
+
+bool SDFS::begin(uint8_t ssPin, SPIClass& spi, uint32_t frequency, const char* mountpoint,
+                 uint8_t max_files, bool format_if_empty) {
+  const char* root = getenv("HOST_SD_ROOT");
+  setRoot(root ? root : HOST_SD_ROOT);
+  limit->max = max_files;
+
+  struct stat st;
+  mounted = stat(getRoot().c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  return mounted;
+}
+
+uint64_t SDFS::cardSize() {
+  struct statvfs vfs;
+  if (!mounted || statvfs(getRoot().c_str(), &vfs) != 0) return 0;
+  return (uint64_t)vfs.f_blocks * vfs.f_frsize;
+}
+
+uint64_t SDFS::usedBytes() {
+  struct statvfs vfs;
+  if (!mounted || statvfs(getRoot().c_str(), &vfs) != 0) return 0;
+  return (uint64_t)(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+}
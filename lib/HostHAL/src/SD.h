@@ -0,0 +1,32 @@
+#ifndef HOST_SD_H
+#define HOST_SD_H
+
+#include "FS.h"
+#include "SPI.h"
+
+// Directory on the host that stands in for the SD card. Overridden at run
+// time by the HOST_SD_ROOT environment variable.
+#ifndef HOST_SD_ROOT
+#define HOST_SD_ROOT "data"
+#endif
+
+typedef enum { CARD_NONE, CARD_MMC, CARD_SD, CARD_SDHC, CARD_UNKNOWN } sdcard_type_t;
+
+class SDFS : public fs::FS {
+ private:
+  bool mounted = false;
+
+ public:
+  bool begin(uint8_t ssPin = SS, SPIClass& spi = SPI, uint32_t frequency = 4000000,
+             const char* mountpoint = "/sd", uint8_t max_files = 5,
+             bool format_if_empty = false);
+  void end() { mounted = false; }
+  sdcard_type_t cardType() const { return mounted ? CARD_SDHC : CARD_NONE; }
+  uint64_t cardSize();
+  uint64_t totalBytes() { return cardSize(); }
+  uint64_t usedBytes();
+};
+
+extern SDFS SD;
+
+#endif  // HOST_SD_H
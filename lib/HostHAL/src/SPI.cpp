@@ -0,0 +1,25 @@
+#include "SPI.h"
+
+#include "HostHAL.h"
+
+SPIClass SPI;
+
+void SPIClass::clockBits(uint32_t bits) {
+  pending_ns += (uint32_t)(bits * 1000000000ULL / frequency);
+  if (pending_ns >= 1000) {
+    hostAdvance(pending_ns / 1000);
+    pending_ns %= 1000;
+  }
+}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  clockBits(8);
+  return 0xFF;
+}
+
+void SPIClass::transferBytes(const uint8_t* data, uint8_t* out, uint32_t size) {
+  clockBits(size * 8);
+  if (out) memset(out, 0xFF, size);
+}
+
+void SPIClass::writeBytes(const uint8_t* data, uint32_t size) { clockBits(size * 8); }
@@ -0,0 +1,55 @@
+#ifndef HOST_SPI_H
+#define HOST_SPI_H
+
+#include "Arduino.h"
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define FSPI 0
+#define HSPI 1
+
+class SPISettings {
+ public:
+  SPISettings() : clock(1000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+      : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+  uint32_t clock;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+};
+
+// SPI bus without a device attached: MISO idles high, so every transfer
+// reads 0xFF. Transfers take the time of the bits at the set frequency.
+class SPIClass {
+ private:
+  uint8_t bus;
+  uint32_t frequency;
+  uint32_t pending_ns;
+
+  void clockBits(uint32_t bits);
+
+ public:
+  explicit SPIClass(uint8_t bus = FSPI) : bus(bus), frequency(1000000), pending_ns(0) {}
+
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+  void end() {}
+  void beginTransaction(const SPISettings& settings) { setFrequency(settings.clock); }
+  void endTransaction() {}
+  void setFrequency(uint32_t hz) { frequency = hz ? hz : 1; }
+  void setDataMode(uint8_t mode) {}
+  void setBitOrder(uint8_t order) {}
+
+  uint8_t transfer(uint8_t data);
+  void transferBytes(const uint8_t* data, uint8_t* out, uint32_t size);
+  void writeBytes(const uint8_t* data, uint32_t size);
+};
+
+extern SPIClass SPI;
+
+#endif  // HOST_SPI_H
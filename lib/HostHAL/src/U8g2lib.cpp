@@ -0,0 +1,194 @@
+#include "U8g2lib.h"
+
+#include "FS.h"
+
+const uint8_t u8g2_font_4x6_tr[] = {4, 6, 5};
+const uint8_t u8g2_font_6x10_tr[] = {6, 10, 7};
+const uint8_t u8g2_font_profont15_tr[] = {7, 15, 10};
+
+U8G2::U8G2()
+    : font(u8g2_font_4x6_tr),
+      draw_color(1),
+      font_mode(0),
+      bitmap_mode(0),
+      power_save(1),
+      frames(0) {
+  clearBuffer();
+}
+
+void U8G2::clearDisplay() {
+  clearBuffer();
+  sendBuffer();
+}
+
+void U8G2::sendBuffer() {
+  frames++;
+  const char* path = getenv("HOST_OLED_PBM");
+  if (!path) return;
+
+  fs::FS host("");
+  File file = host.open(path, FILE_WRITE);
+  if (file) writeBufferPBM(file);
+}
+
+void U8G2::drawPixel(int x, int y) {
+  if (x < 0 || y < 0 || x >= kWidth || y >= kHeight) return;
+  uint8_t& tile = buffer[(y / 8) * kWidth + x];
+  uint8_t mask = 1 << (y & 7);
+  if (draw_color == 0) {
+    tile &= ~mask;
+  } else if (draw_color == 2) {
+    tile ^= mask;
+  } else {
+    tile |= mask;
+  }
+}
+
+bool U8G2::getPixel(int x, int y) const {
+  if (x < 0 || y < 0 || x >= kWidth || y >= kHeight) return false;
+  return buffer[(y / 8) * kWidth + x] & (1 << (y & 7));
+}
+
+void U8G2::drawHLine(int x, int y, int w) {
+  for (int i = 0; i < w; i++) drawPixel(x + i, y);
+}
+
+void U8G2::drawVLine(int x, int y, int h) {
+  for (int i = 0; i < h; i++) drawPixel(x, y + i);
+}
+
+void U8G2::drawLine(int x1, int y1, int x2, int y2) {
+  int dx = abs(x2 - x1);
+  int dy = -abs(y2 - y1);
+  int sx = x1 < x2 ? 1 : -1;
+  int sy = y1 < y2 ? 1 : -1;
+  int error = dx + dy;
+  for (;;) {
+    drawPixel(x1, y1);
+    if (x1 == x2 && y1 == y2) break;
+    int e2 = 2 * error;
+    if (e2 >= dy) {
+      error += dy;
+      x1 += sx;
+    }
+    if (e2 <= dx) {
+      error += dx;
+      y1 += sy;
+    }
+  }
+}
+
+void U8G2::drawBox(int x, int y, int w, int h) {
+  for (int i = 0; i < h; i++) drawHLine(x, y + i, w);
+}
+
+void U8G2::drawFrame(int x, int y, int w, int h) {
+  if (w <= 0 || h <= 0) return;
+  drawHLine(x, y, w);
+  drawHLine(x, y + h - 1, w);
+  drawVLine(x, y, h);
+  drawVLine(x + w - 1, y, h);
+}
+
+// XBM rows are padded to whole bytes, the least significant bit comes first
+void U8G2::drawXBMP(int x, int y, int w, int h, const uint8_t* bitmap) {
+  int row_bytes = (w + 7) / 8;
+  uint8_t color = draw_color;
+  for (int row = 0; row < h; row++) {
+    for (int col = 0; col < w; col++) {
+      bool set = bitmap[row * row_bytes + col / 8] & (1 << (col & 7));
+      if (set) {
+        draw_color = color;
+      } else if (bitmap_mode == 0) {
+        draw_color = color == 0 ? 1 : 0;
+      } else {
+        continue;
+      }
+      drawPixel(x + col, y + row);
+    }
+  }
+  draw_color = color;
+}
+
+void U8G2::ellipseSection(int x0, int y0, int x, int y, uint8_t option, bool filled) {
+  if (filled) {
+    if (option & U8G2_DRAW_UPPER_RIGHT) drawVLine(x0 + x, y0 - y, y + 1);
+    if (option & U8G2_DRAW_UPPER_LEFT) drawVLine(x0 - x, y0 - y, y + 1);
+    if (option & U8G2_DRAW_LOWER_RIGHT) drawVLine(x0 + x, y0, y + 1);
+    if (option & U8G2_DRAW_LOWER_LEFT) drawVLine(x0 - x, y0, y + 1);
+  } else {
+    if (option & U8G2_DRAW_UPPER_RIGHT) drawPixel(x0 + x, y0 - y);
+    if (option & U8G2_DRAW_UPPER_LEFT) drawPixel(x0 - x, y0 - y);
+    if (option & U8G2_DRAW_LOWER_RIGHT) drawPixel(x0 + x, y0 + y);
+    if (option & U8G2_DRAW_LOWER_LEFT) drawPixel(x0 - x, y0 + y);
+  }
+}
+
+// Midpoint ellipse, both regions
+void U8G2::ellipse(int x0, int y0, int rx, int ry, uint8_t option, bool filled) {
+  long rx2 = (long)rx * rx;
+  long ry2 = (long)ry * ry;
+  long x = 0;
+  long y = ry;
+  long px = 0;
+  long py = 2 * rx2 * y;
+  long p = ry2 - rx2 * ry + rx2 / 4;
+  while (px < py) {
+    ellipseSection(x0, y0, x, y, option, filled);
+    x++;
+    px += 2 * ry2;
+    if (p < 0) {
+      p += ry2 + px;
+    } else {
+      y--;
+      py -= 2 * rx2;
+      p += ry2 + px - py;
+    }
+  }
+  p = ry2 * (2 * x + 1) * (2 * x + 1) / 4 + rx2 * (y - 1) * (y - 1) - rx2 * ry2;
+  while (y >= 0) {
+    ellipseSection(x0, y0, x, y, option, filled);
+    y--;
+    py -= 2 * rx2;
+    if (p > 0) {
+      p += rx2 - py;
+    } else {
+      x++;
+      px += 2 * ry2;
+      p += rx2 - py + px;
+    }
+  }
+}
+
+void U8G2::drawEllipse(int x0, int y0, int rx, int ry, uint8_t option) {
+  ellipse(x0, y0, rx, ry, option, false);
+}
+
+void U8G2::drawFilledEllipse(int x0, int y0, int rx, int ry, uint8_t option) {
+  ellipse(x0, y0, rx, ry, option, true);
+}
+
+u8g2_uint_t U8G2::getStrWidth(const char* str) const {
+  return str ? strlen(str) * font[0] : 0;
+}
+
+// y is the baseline, as in U8g2
+u8g2_uint_t U8G2::drawStr(int x, int y, const char* str) {
+  if (!str) return 0;
+  uint8_t width = font[0];
+  uint8_t ascent = font[2];
+  for (const char* c = str; *c; c++, x += width) {
+    if (*c != ' ') drawFrame(x, y - ascent, width - 1, ascent);
+  }
+  return getStrWidth(str);
+}
+
+void U8G2::writeBufferPBM(Print& out) const {
+  out.printf("P1\n%d %d\n", kWidth, kHeight);
+  for (int y = 0; y < kHeight; y++) {
+    for (int x = 0; x < kWidth; x++) {
+      out.print(getPixel(x, y) ? '1' : '0');
+    }
+    out.print('\n');
+  }
+}
@@ -0,0 +1,104 @@
+#ifndef HOST_U8G2LIB_H
+#define HOST_U8G2LIB_H
+
+#include "Arduino.h"
+
+// Headless U8g2: a 128x64 full frame buffer with the drawing calls the UI
+// uses. The buffer has the U8g2 tile layout (8 pages of 128 column bytes).
+// Fonts only carry their metrics, text is drawn as one box per glyph.
+// sendBuffer() counts frames and, with HOST_OLED_PBM set to a path, writes
+// each frame there as a PBM image.
+
+#define U8X8_PROGMEM
+#define U8X8_PIN_NONE 255
+
+#define U8G2_DRAW_UPPER_RIGHT 0x01
+#define U8G2_DRAW_UPPER_LEFT 0x02
+#define U8G2_DRAW_LOWER_LEFT 0x04
+#define U8G2_DRAW_LOWER_RIGHT 0x08
+#define U8G2_DRAW_ALL 0x0F
+
+typedef uint16_t u8g2_uint_t;
+typedef struct u8g2_cb_struct u8g2_cb_t;
+
+#define U8G2_R0 ((const u8g2_cb_t*)0)
+#define U8G2_R2 ((const u8g2_cb_t*)2)
+
+// Font metrics: glyph width, height and ascent
+extern const uint8_t u8g2_font_4x6_tr[];
+extern const uint8_t u8g2_font_6x10_tr[];
+extern const uint8_t u8g2_font_profont15_tr[];
+
+class U8G2 {
+ public:
+  static const uint8_t kWidth = 128;
+  static const uint8_t kHeight = 64;
+
+ private:
+  uint8_t buffer[kWidth * kHeight / 8];
+  const uint8_t* font;
+  uint8_t draw_color;
+  uint8_t font_mode;
+  uint8_t bitmap_mode;
+  uint8_t power_save;
+  uint32_t frames;
+
+  void ellipseSection(int x0, int y0, int x, int y, uint8_t option, bool filled);
+  void ellipse(int x0, int y0, int rx, int ry, uint8_t option, bool filled);
+
+ public:
+  U8G2();
+
+  bool begin() { return true; }
+  void setBusClock(uint32_t clock_speed) {}
+  void setPowerSave(uint8_t is_enable) { power_save = is_enable; }
+  void setFlipMode(uint8_t mode) {}
+  void setContrast(uint8_t value) {}
+
+  void clearBuffer() { memset(buffer, 0, sizeof(buffer)); }
+  void clearDisplay();
+  void sendBuffer();
+
+  void setFont(const uint8_t* font_data) { font = font_data; }
+  void setFontMode(uint8_t is_transparent) { font_mode = is_transparent; }
+  void setBitmapMode(uint8_t is_transparent) { bitmap_mode = is_transparent; }
+  void setDrawColor(uint8_t color) { draw_color = color; }
+
+  void drawPixel(int x, int y);
+  void drawHLine(int x, int y, int w);
+  void drawVLine(int x, int y, int h);
+  void drawLine(int x1, int y1, int x2, int y2);
+  void drawBox(int x, int y, int w, int h);
+  void drawFrame(int x, int y, int w, int h);
+  void drawXBMP(int x, int y, int w, int h, const uint8_t* bitmap);
+  void drawEllipse(int x0, int y0, int rx, int ry, uint8_t option = U8G2_DRAW_ALL);
+  void drawFilledEllipse(int x0, int y0, int rx, int ry, uint8_t option = U8G2_DRAW_ALL);
+  void drawCircle(int x0, int y0, int r, uint8_t option = U8G2_DRAW_ALL) {
+    drawEllipse(x0, y0, r, r, option);
+  }
+  void drawDisc(int x0, int y0, int r, uint8_t option = U8G2_DRAW_ALL) {
+    drawFilledEllipse(x0, y0, r, r, option);
+  }
+  u8g2_uint_t drawStr(int x, int y, const char* str);
+  u8g2_uint_t getStrWidth(const char* str) const;
+
+  u8g2_uint_t getDisplayWidth() const { return kWidth; }
+  u8g2_uint_t getDisplayHeight() const { return kHeight; }
+  uint8_t* getBufferPtr() { return buffer; }
+  uint8_t getBufferTileWidth() const { return kWidth / 8; }
+  uint8_t getBufferTileHeight() const { return kHeight / 8; }
+  void writeBufferPBM(Print& out) const;
+
+  // Host only: pixel readback and the number of frames sent
+  bool getPixel(int x, int y) const;
+  uint32_t getFrameCount() const { return frames; }
+  bool isPowerSave() const { return power_save != 0; }
+};
+
+class U8G2_SSD1309_128X64_NONAME0_F_4W_HW_SPI : public U8G2 {
+ public:
+  U8G2_SSD1309_128X64_NONAME0_F_4W_HW_SPI(const u8g2_cb_t* rotation, uint8_t cs,
+                                           uint8_t dc, uint8_t reset = U8X8_PIN_NONE) {}
+};
+
+#endif  // HOST_U8G2LIB_H
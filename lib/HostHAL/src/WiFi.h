@@ -0,0 +1,17 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+#include "Arduino.h"
+
+// No network on the host, the station never connects
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 } wl_status_t;
+
+class WiFiClass {
+ public:
+  void begin(const char* ssid, const char* password) {}
+  wl_status_t status() const { return WL_DISCONNECTED; }
+};
+
+static WiFiClass WiFi;
+
+#endif  // HOST_WIFI_H
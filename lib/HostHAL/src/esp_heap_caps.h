@@ -0,0 +1,27 @@
+#ifndef HOST_ESP_HEAP_CAPS_H
+#define HOST_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ESP-IDF heap capabilities API on the host heap. There is no PSRAM:
+// allocations that ask for MALLOC_CAP_SPIRAM fail, as on a board without
+// it. The statistics come from the C library allocator.
+
+#define MALLOC_CAP_EXEC     (1 << 0)
+#define MALLOC_CAP_32BIT    (1 << 1)
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_DEFAULT  (1 << 12)
+
+void* heap_caps_malloc(size_t size, uint32_t caps);
+void heap_caps_free(void* ptr);
+// Size of the allocator's arena and the bytes free in it
+size_t heap_caps_get_total_size(uint32_t caps);
+size_t heap_caps_get_free_size(uint32_t caps);
+// Largest chunk the allocator has free without growing its arena
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif  // HOST_ESP_HEAP_CAPS_H
@@ -0,0 +1,26 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+
+// FreeRTOS types and the task and queue calls the firmware uses, backed by
+// host threads. Priorities and core affinity are accepted and ignored.
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void* TaskHandle_t;
+typedef void* QueueHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+#define errQUEUE_FULL 0
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+#endif  // HOST_FREERTOS_H
@@ -0,0 +1,17 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char* name, uint32_t stack_depth,
+                       void* parameters, UBaseType_t priority, TaskHandle_t* created);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t task, const char* name,
+                                   uint32_t stack_depth, void* parameters,
+                                   UBaseType_t priority, TaskHandle_t* created,
+                                   BaseType_t core);
+// Deleting the calling task (nullptr) must be the last thing the task does
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+
+#endif  // HOST_FREERTOS_TASK_H
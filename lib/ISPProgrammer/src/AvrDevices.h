@@ -0,0 +1,76 @@
+#ifndef AVR_DEVICES_H
+#define AVR_DEVICES_H
+
+#include <stdint.h>
+
+// Static description of an AVR target for serial programming. Timings are
+// the datasheet t_WD values rounded up to whole milliseconds; they serve as
+// fixed delays when RDY/BSY polling is not available and as poll timeouts.
+struct AvrDevice {
+  uint8_t signature[3];
+  const char* name;
+  uint16_t page_size;         // flash page size in bytes
+  uint32_t flash_size;        // bytes
+  uint16_t eeprom_size;       // bytes
+  uint8_t eeprom_page_size;   // bytes
+  bool word_addressing;       // flash instructions take word addresses
+  bool extended_address;      // flash above 128 KB, needs Load Extended Address (0x4D)
+  uint8_t flash_write_ms;     // t_WD_FLASH
+  uint8_t eeprom_write_ms;    // t_WD_EEPROM
+  uint8_t erase_ms;           // t_WD_ERASE
+  uint16_t max_boot_size;     // boot section in bytes with BOOTSZ = 00
+  bool boot_fuse_extended;    // BOOTSZ/BOOTRST live in the extended fuse
+};
+
+// clang-format off
+constexpr AvrDevice kAvrDevices[] = {
+  // signature            name            page  flash   eeprom ep  word  ext    fl ee er  boot   bfx
+  {{0x1E, 0x95, 0x87}, "ATmega32U4",   128,  32768,  1024,  4, true, false, 5, 10, 10, 4096,  false},
+  {{0x1E, 0x94, 0x88}, "ATmega16U4",   128,  16384,  512,   4, true, false, 5, 10, 10, 4096,  false},
+  {{0x1E, 0x95, 0x8A}, "ATmega32U2",   128,  32768,  1024,  4, true, false, 5, 10, 10, 4096,  false},
+  {{0x1E, 0x95, 0x0F}, "ATmega328P",   128,  32768,  1024,  4, true, false, 5, 4,  10, 4096,  false},
+  {{0x1E, 0x95, 0x14}, "ATmega328",    128,  32768,  1024,  4, true, false, 5, 4,  10, 4096,  false},
+  {{0x1E, 0x94, 0x0B}, "ATmega168P",   128,  16384,  512,   4, true, false, 5, 4,  10, 2048,  true},
+  {{0x1E, 0x94, 0x06}, "ATmega168",    128,  16384,  512,   4, true, false, 5, 4,  10, 2048,  true},
+  {{0x1E, 0x93, 0x0F}, "ATmega88P",    64,   8192,   512,   4, true, false, 5, 4,  10, 2048,  true},
+  {{0x1E, 0x96, 0x0A}, "ATmega644P",   256,  65536,  2048,  8, true, false, 5, 4,  10, 8192,  false},
+  {{0x1E, 0x97, 0x05}, "ATmega1284P",  256,  131072, 4096,  8, true, false, 5, 4,  10, 8192,  false},
+  {{0x1E, 0x97, 0x03}, "ATmega1280",   256,  131072, 4096,  8, true, false, 5, 10, 10, 8192,  false},
+  {{0x1E, 0x98, 0x01}, "ATmega2560",   256,  262144, 4096,  8, true, true,  5, 10, 10, 8192,  false},
+  {{0x1E, 0x97, 0x82}, "AT90USB1286",  256,  131072, 4096,  8, true, false, 5, 10, 10, 8192,  false},
+};
+// clang-format on
+
+constexpr uint8_t kAvrDeviceCount = sizeof(kAvrDevices) / sizeof(kAvrDevices[0]);
+
+// Fallback for signatures that are not in the table: an ATmega32U4 layout
+// with conservative timings
+constexpr AvrDevice kUnknownAvrDevice = {
+    {0x00, 0x00, 0x00}, "Unknown", 128, 32768, 1024, 4, true, false, 10, 10, 100,
+    4096, false};
+
+// Table lookup, usable at compile time
+constexpr const AvrDevice* findAvrDevice(uint8_t sig0, uint8_t sig1,
+                                         uint8_t sig2, uint8_t index = 0) {
+  return index >= kAvrDeviceCount ? nullptr
+         : (kAvrDevices[index].signature[0] == sig0 &&
+            kAvrDevices[index].signature[1] == sig1 &&
+            kAvrDevices[index].signature[2] == sig2)
+             ? &kAvrDevices[index]
+             : findAvrDevice(sig0, sig1, sig2, index + 1);
+}
+
+// First byte of the boot section for the BOOTSZ bits of the boot fuse.
+// BOOTSZ = 00 selects the largest section, every step halves it.
+constexpr uint32_t avrBootStart(const AvrDevice& device, uint8_t boot_fuse) {
+  return device.flash_size - (device.max_boot_size >> ((boot_fuse >> 1) & 0x03));
+}
+
+static_assert(findAvrDevice(0x1E, 0x95, 0x87)->page_size == 128,
+              "ATmega32U4 must be in the device table");
+static_assert(findAvrDevice(0x1E, 0x98, 0x01)->extended_address,
+              "ATmega2560 needs Load Extended Address");
+static_assert(avrBootStart(*findAvrDevice(0x1E, 0x95, 0x87), 0xD0) == 0x7000,
+              "Caterina fuses put the ATmega32U4 boot section at 0x7000");
+
+#endif  // AVR_DEVICES_H
@@ -0,0 +1,34 @@
+#include "ISPBus.h"
+
+void SPIBus::begin() {
+  pinMode(reset_pin, OUTPUT);
+
+  // Initialize default SPI (shared with OLED)
+  SPI.begin();
+  SPI.setDataMode(SPI_MODE0);
+  SPI.setBitOrder(MSBFIRST);
+}
+
+void SPIBus::end() {
+  SPI.end();
+  digitalWrite(reset_pin, HIGH);  // Release reset
+}
+
+void SPIBus::setReset(bool asserted) {
+  digitalWrite(reset_pin, asserted ? LOW : HIGH);
+}
+
+void SPIBus::setClock(uint32_t hz) { SPI.setFrequency(hz); }
+
+void SPIBus::pulseClock() {
+  digitalWrite(SCK, HIGH);
+  delayMicroseconds(10);
+  digitalWrite(SCK, LOW);
+  delayMicroseconds(10);
+}
+
+uint8_t SPIBus::transfer(uint8_t data) { return SPI.transfer(data); }
+
+void SPIBus::transferBytes(uint8_t* buffer, uint32_t length) {
+  SPI.transferBytes(buffer, buffer, length);
+}
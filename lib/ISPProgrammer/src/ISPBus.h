@@ -0,0 +1,43 @@
+#ifndef ISP_BUS_H
+#define ISP_BUS_H
+
+#include <Arduino.h>
+#include <SPI.h>
+
+// Physical link to the target: the SPI lines and the reset pin. The
+// programmer only talks to the target through this interface, so it can
+// run against a simulated target as well as against the hardware SPI bus.
+class ISPBus {
+ public:
+  virtual ~ISPBus() {}
+
+  virtual void begin() = 0;
+  virtual void end() = 0;
+  // Drive the target reset line, asserted means held in reset (low)
+  virtual void setReset(bool asserted) = 0;
+  virtual void setClock(uint32_t hz) = 0;
+  // One extra SCK pulse, shifts the target out of a lost byte frame
+  virtual void pulseClock() = 0;
+  virtual uint8_t transfer(uint8_t data) = 0;
+  // Full duplex transfer in place, the received bytes replace the buffer
+  virtual void transferBytes(uint8_t* buffer, uint32_t length) = 0;
+};
+
+// Default bus: the shared hardware SPI and a GPIO for reset
+class SPIBus : public ISPBus {
+ private:
+  uint8_t reset_pin;
+
+ public:
+  explicit SPIBus(uint8_t reset_pin) : reset_pin(reset_pin) {}
+
+  void begin() override;
+  void end() override;
+  void setReset(bool asserted) override;
+  void setClock(uint32_t hz) override;
+  void pulseClock() override;
+  uint8_t transfer(uint8_t data) override;
+  void transferBytes(uint8_t* buffer, uint32_t length) override;
+};
+
+#endif  // ISP_BUS_H
@@ -1,68 +1,82 @@
 #include "ISPProgrammer.h"
 
-ISPProgrammer::ISPProgrammer(uint8_t reset_pin) {
-  this->reset_pin = reset_pin;
+// ISP clock ladder, the first step is used to synchronise with the target
+static constexpr uint32_t kClockSteps[] = {100000, 250000, 500000, 1000000, 2000000};
+static constexpr uint8_t kClockStepCount = sizeof(kClockSteps) / sizeof(kClockSteps[0]);
+static_assert(kClockSteps[kClockStepCount - 1] <= ISP_MAX_CLOCK_HZ,
+              "ISP clock ladder is faster than the target allows");
+
+ISPProgrammer::ISPProgrammer(uint8_t reset_pin) : spi_bus(reset_pin), bus(&spi_bus) {
+  init();
+}
+
+ISPProgrammer::ISPProgrammer(ISPBus& bus) : spi_bus(0), bus(&bus) { init(); }
+
+void ISPProgrammer::init() {
   device_detected = false;
+  completion = IspCompletion::POLL_RDY_BSY;
+  poll_unsupported = false;
+  poll_answered = false;
+  resetWaitStats();
+  clock_step = 0;
+  for (uint8_t i = 0; i < ISP_CLOCK_CACHE_SIZE; i++) {
+    clock_cache[i].used = false;
+  }
 
   // Initialize current_device properly
   current_device.signature[0] = 0;
   current_device.signature[1] = 0;
   current_device.signature[2] = 0;
-  current_device.name = "";
-  current_device.page_size = 0;
-  current_device.flash_size = 0;
-  current_device.uses_word_addressing = false;
+  current_device.device = &kUnknownAvrDevice;
+  selectPageOps();
 }
 
 ISPProgrammer::~ISPProgrammer() { end(); }
 
 bool ISPProgrammer::begin() {
-  // Setup pins
-  pinMode(reset_pin, OUTPUT);
-
-  // Initialize default SPI (shared with OLED)
-  SPI.begin();
-  SPI.setFrequency(100000);  // 100kHz for programming
-  SPI.setDataMode(SPI_MODE0);
-  SPI.setBitOrder(MSBFIRST);
+  bus->begin();
+  setClockStep(0);  // start slow, raised once the device is detected
 
   // Reset target
-  digitalWrite(reset_pin, HIGH);
+  bus->setReset(false);
   delay(50);
-  digitalWrite(reset_pin, LOW);
+  bus->setReset(true);
   delay(50);
 
   return true;
 }
 
 void ISPProgrammer::end() {
-  SPI.end();
-  digitalWrite(reset_pin, HIGH);  // Release reset
+  bus->end();
   device_detected = false;
 }
 
 bool ISPProgrammer::enterProgrammingMode() {
   // Ensure target is in reset
-  digitalWrite(reset_pin, LOW);
+  bus->setReset(true);
   delay(50);
 
   // Try to sync with target - send programming enable command
   for (int attempts = 0; attempts < 32; attempts++) {
-    SPI.transfer(0xAC);
-    SPI.transfer(0x53);
-    uint8_t response = SPI.transfer(0x00);
-    SPI.transfer(0x00);
+    bus->transfer(0xAC);
+    bus->transfer(0x53);
+    uint8_t response = bus->transfer(0x00);
+    bus->transfer(0x00);
 
     if (response == 0x53) {
       Logger::info("Programming mode enabled");
-      return detectDevice();
+      poll_unsupported = false;
+      poll_answered = false;
+      resetWaitStats();
+      if (!detectDevice()) {
+        return false;
+      }
+      negotiateClock();
+      return true;
     }
 
     // Pulse SCK and try again
-    digitalWrite(SCK, HIGH);
-    delayMicroseconds(10);
-    digitalWrite(SCK, LOW);
-    delayMicroseconds(10);
+    bus->pulseClock();
   }
 
   Logger::info("Failed to enable programming mode");
@@ -70,17 +84,333 @@ bool ISPProgrammer::enterProgrammingMode() {
 }
 
 bool ISPProgrammer::exitProgrammingMode() {
-  digitalWrite(reset_pin, HIGH);  // Release reset
+  bus->setReset(false);  // Release reset
   delay(10);
   return true;
 }
 
 uint8_t ISPProgrammer::spiTransaction(uint8_t a, uint8_t b, uint8_t c,
                                       uint8_t d) {
-  SPI.transfer(a);
-  SPI.transfer(b);
-  SPI.transfer(c);
-  return SPI.transfer(d);
+  bus->transfer(a);
+  bus->transfer(b);
+  bus->transfer(c);
+  return bus->transfer(d);
+}
+
+// Send a run of 4-byte instructions in one SPI transfer. The bytes clocked
+// back in replace the buffer contents, so the fourth byte of every
+// instruction holds its result.
+void ISPProgrammer::spiBatch(uint8_t* buffer, uint32_t length) {
+  bus->transferBytes(buffer, length);
+}
+
+// Fill the target page buffer with one batched transfer of 0x40/0x48 loads.
+// The page size is a template parameter, so the loop has a fixed trip count
+// and the word address is a running counter instead of per-byte math. Page
+// aligned words never carry into the address MSB, so only the LSB is sent.
+template <uint16_t PageSize>
+void ISPProgrammer::loadPageT(uint32_t address, const uint8_t* data) {
+  static_assert(PageSize * 4 <= ISP_BATCH_BUFFER_SIZE,
+                "page does not fit the batch buffer");
+  uint8_t* out = batch_buffer;
+  uint8_t word_lsb = (address >> 1) & 0xFF;
+
+  for (uint16_t i = 0; i < PageSize; i += 2, word_lsb++, out += 8) {
+    // Load program memory page (low byte)
+    out[0] = 0x40;
+    out[1] = 0x00;
+    out[2] = word_lsb;
+    out[3] = data[i];
+
+    // Load program memory page (high byte)
+    out[4] = 0x48;
+    out[5] = 0x00;
+    out[6] = word_lsb;
+    out[7] = data[i + 1];
+  }
+
+  spiBatch(batch_buffer, PageSize * 4);
+}
+
+// Batched flash read. 0x20 reads the low and 0x28 the high byte of a word;
+// the command alternates and the word address is counted instead of being
+// derived per byte. Devices above 128 KB get a Load Extended Address
+// instruction in front of every batch, and batches never cross a 64K word
+// boundary.
+template <bool Extended>
+void ISPProgrammer::readFlashT(uint32_t address, uint8_t* out, uint32_t length) {
+  const uint32_t header = Extended ? 4 : 0;
+
+  while (length > 0) {
+    uint32_t chunk = (ISP_BATCH_BUFFER_SIZE - header) / 4;
+    if (chunk > length) chunk = length;
+    if (Extended) {
+      uint32_t to_boundary = 0x20000 - (address & 0x1FFFF);
+      if (chunk > to_boundary) chunk = to_boundary;
+    }
+
+    uint32_t word = address >> 1;
+    uint8_t* cmd = batch_buffer;
+    if (Extended) {
+      cmd[0] = 0x4D;
+      cmd[1] = 0x00;
+      cmd[2] = (word >> 16) & 0xFF;
+      cmd[3] = 0x00;
+      cmd += 4;
+    }
+
+    uint8_t op = (address & 1) ? 0x28 : 0x20;
+    for (uint32_t i = 0; i < chunk; i++, cmd += 4) {
+      cmd[0] = op;
+      cmd[1] = (word >> 8) & 0xFF;
+      cmd[2] = word & 0xFF;
+      cmd[3] = 0x00;
+      if (op == 0x28) word++;
+      op ^= 0x08;
+    }
+
+    spiBatch(batch_buffer, header + chunk * 4);
+
+    const uint8_t* result = batch_buffer + header + 3;
+    for (uint32_t i = 0; i < chunk; i++, result += 4) {
+      out[i] = *result;
+    }
+
+    address += chunk;
+    out += chunk;
+    length -= chunk;
+  }
+}
+
+// Pick the specialised page operations for the detected device
+void ISPProgrammer::selectPageOps() {
+  const AvrDevice& dev = *current_device.device;
+
+  switch (dev.page_size) {
+    case 64:
+      load_page = &ISPProgrammer::loadPageT<64>;
+      break;
+    case 256:
+      load_page = &ISPProgrammer::loadPageT<256>;
+      break;
+    case 128:
+    default:
+      load_page = &ISPProgrammer::loadPageT<128>;
+      break;
+  }
+
+  read_flash = dev.extended_address ? &ISPProgrammer::readFlashT<true>
+                                    : &ISPProgrammer::readFlashT<false>;
+}
+
+bool ISPProgrammer::readFlash(uint32_t address, uint8_t* out, uint32_t length) {
+  if (!device_detected || !out) return false;
+  if (address + length > current_device.device->flash_size) {
+    Logger::error("Read beyond flash end: 0x%05X\n", address + length);
+    return false;
+  }
+
+  (this->*read_flash)(address, out, length);
+  return true;
+}
+
+// Batched EEPROM read, one 0xA0 instruction per byte
+bool ISPProgrammer::readEeprom(uint32_t address, uint8_t* out, uint32_t length) {
+  if (!device_detected || !out) return false;
+  if (address + length > current_device.device->eeprom_size) {
+    Logger::error("Read beyond EEPROM end: 0x%04X\n", address + length);
+    return false;
+  }
+
+  while (length > 0) {
+    uint32_t chunk = ISP_BATCH_BUFFER_SIZE / 4;
+    if (chunk > length) chunk = length;
+
+    uint8_t* cmd = batch_buffer;
+    for (uint32_t i = 0; i < chunk; i++, cmd += 4) {
+      cmd[0] = 0xA0;
+      cmd[1] = ((address + i) >> 8) & 0xFF;
+      cmd[2] = (address + i) & 0xFF;
+      cmd[3] = 0x00;
+    }
+
+    spiBatch(batch_buffer, chunk * 4);
+
+    const uint8_t* result = batch_buffer + 3;
+    for (uint32_t i = 0; i < chunk; i++, result += 4) {
+      out[i] = *result;
+    }
+
+    address += chunk;
+    out += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+// Wait until the target finished the last write or erase. With polling
+// the datasheet time only sets the deadline, ISP_POLL_TIMEOUT_FACTOR times
+// it plus a floor. The target is polled once more after the deadline, so
+// a task that was away longer does not count as a timeout. A target that
+// has never reported ready this session is assumed not to support polling
+// and gets fixed delays for the rest of the session.
+// Returns the time waited in microseconds.
+uint32_t ISPProgrammer::waitForReady(uint32_t timeout_ms) {
+  uint32_t start = micros();
+
+  if (completion == IspCompletion::FIXED_DELAY || poll_unsupported) {
+    delay(timeout_ms);
+    return micros() - start;
+  }
+
+  uint32_t deadline_us =
+      (timeout_ms * ISP_POLL_TIMEOUT_FACTOR + ISP_POLL_TIMEOUT_FLOOR_MS) * 1000UL;
+  bool busy;
+  while (true) {
+    bool late = micros() - start >= deadline_us;
+    busy = spiTransaction(0xF0, 0x00, 0x00, 0x00) & 0x01;
+    if (!busy || late) {
+      break;
+    }
+    // Let other tasks (e.g. the HEX parser) run while the target is busy
+    yield();
+  }
+
+  if (!busy) {
+    poll_answered = true;
+  } else if (poll_answered) {
+    Logger::error("RDY/BSY poll timed out after %u us\n", (uint32_t)(micros() - start));
+    wait_stats.timeouts++;
+  } else {
+    Logger::error("RDY/BSY poll timed out, falling back to fixed delays");
+    poll_unsupported = true;
+    wait_stats.timeouts++;
+  }
+
+  return micros() - start;
+}
+
+void ISPProgrammer::resetWaitStats() {
+  wait_stats.pages = 0;
+  wait_stats.total_us = 0;
+  wait_stats.min_us = 0;
+  wait_stats.max_us = 0;
+  wait_stats.timeouts = 0;
+  wait_stats.erase_us = 0;
+  wait_stats.retries = 0;
+}
+
+void ISPProgrammer::printWaitStats() const {
+  if (wait_stats.pages == 0) {
+    Logger::info("No page writes waited for");
+    return;
+  }
+  uint32_t fixed_us = wait_stats.pages * current_device.device->flash_write_ms * 1000UL;
+  uint32_t saved_us = fixed_us > wait_stats.total_us ? fixed_us - wait_stats.total_us : 0;
+  Logger::info("Page write wait: %d pages, avg %d us, min %d us, max %d us\n",
+               wait_stats.pages, wait_stats.total_us / wait_stats.pages,
+               wait_stats.min_us, wait_stats.max_us);
+  Logger::info("Page write wait: %d ms total, %d ms reclaimed, %d timeouts\n",
+               wait_stats.total_us / 1000, saved_us / 1000, wait_stats.timeouts);
+  Logger::info("Chip erase wait: %d us\n", wait_stats.erase_us);
+  Logger::info("Page verify retries: %d\n", wait_stats.retries);
+}
+
+// ==========================================
+// ISP CLOCK NEGOTIATION
+// ==========================================
+
+void ISPProgrammer::setClockStep(uint8_t step) {
+  clock_step = step < kClockStepCount ? step : kClockStepCount - 1;
+  bus->setClock(kClockSteps[clock_step]);
+}
+
+uint32_t ISPProgrammer::getClock() const { return kClockSteps[clock_step]; }
+
+// Signature and fuse bytes, read back to check a clock step
+void ISPProgrammer::readProbe(uint8_t out[6]) {
+  out[0] = spiTransaction(0x30, 0x00, 0x00, 0x00);
+  out[1] = spiTransaction(0x30, 0x00, 0x01, 0x00);
+  out[2] = spiTransaction(0x30, 0x00, 0x02, 0x00);
+  out[3] = spiTransaction(0x50, 0x00, 0x00, 0x00);
+  out[4] = spiTransaction(0x58, 0x08, 0x00, 0x00);
+  out[5] = spiTransaction(0x50, 0x08, 0x00, 0x00);
+}
+
+// Raise the clock step by step while signature and fuses still read back
+// the same as at the synchronisation clock. A clock that worked for this
+// signature before is tried first.
+void ISPProgrammer::negotiateClock() {
+  uint8_t reference[6];
+  uint8_t probe[6];
+  readProbe(reference);
+
+  ClockCacheEntry* cached = findCachedClock();
+  if (cached) {
+    setClockStep(cached->clock_step);
+    readProbe(probe);
+    if (memcmp(reference, probe, sizeof(probe)) == 0) {
+      Logger::info("ISP clock: %d Hz (cached)\n", getClock());
+      return;
+    }
+    setClockStep(0);
+  }
+
+  uint8_t good_step = 0;
+  for (uint8_t step = 1; step < kClockStepCount; step++) {
+    setClockStep(step);
+    readProbe(probe);
+    if (memcmp(reference, probe, sizeof(probe)) != 0) {
+      break;
+    }
+    // Read twice to not accept a marginal clock by luck
+    readProbe(probe);
+    if (memcmp(reference, probe, sizeof(probe)) != 0) {
+      break;
+    }
+    good_step = step;
+  }
+
+  setClockStep(good_step);
+  cacheClock();
+  Logger::info("ISP clock: %d Hz\n", getClock());
+}
+
+bool ISPProgrammer::stepDownClock() {
+  if (clock_step == 0) {
+    return false;
+  }
+  setClockStep(clock_step - 1);
+  cacheClock();
+  Logger::error("Verify mismatch, ISP clock lowered to %d Hz\n", getClock());
+  return true;
+}
+
+ISPProgrammer::ClockCacheEntry* ISPProgrammer::findCachedClock() {
+  for (uint8_t i = 0; i < ISP_CLOCK_CACHE_SIZE; i++) {
+    if (clock_cache[i].used &&
+        memcmp(clock_cache[i].signature, current_device.signature, 3) == 0) {
+      return &clock_cache[i];
+    }
+  }
+  return nullptr;
+}
+
+void ISPProgrammer::cacheClock() {
+  ClockCacheEntry* entry = findCachedClock();
+  if (!entry) {
+    // Take a free slot, or overwrite the first one
+    entry = &clock_cache[0];
+    for (uint8_t i = 0; i < ISP_CLOCK_CACHE_SIZE; i++) {
+      if (!clock_cache[i].used) {
+        entry = &clock_cache[i];
+        break;
+      }
+    }
+    memcpy(entry->signature, current_device.signature, 3);
+    entry->used = true;
+  }
+  entry->clock_step = clock_step;
 }
 
 bool ISPProgrammer::detectDevice() {
@@ -93,25 +423,18 @@ bool ISPProgrammer::detectDevice() {
   memcpy(current_device.signature, sig, 3);
 
   // Identify device
-  if (sig[0] == ATMEGA32U4_SIGNATURE_0 && sig[1] == ATMEGA32U4_SIGNATURE_1 &&
-      sig[2] == ATMEGA32U4_SIGNATURE_2) {
-    current_device = getATmega32U4Info();
-    device_detected = true;
-  } else if (sig[0] == ATMEGA328P_SIGNATURE_0 &&
-             sig[1] == ATMEGA328P_SIGNATURE_1 &&
-             sig[2] == ATMEGA328P_SIGNATURE_2) {
-    current_device = getATmega328PInfo();
+  const AvrDevice* device = findAvrDevice(sig[0], sig[1], sig[2]);
+  if (device) {
+    current_device.device = device;
     device_detected = true;
   } else {
-    current_device.name = "Unknown";
-    current_device.page_size = 128;              // Default
-    current_device.flash_size = 32768;           // Default
-    current_device.uses_word_addressing = true;  // Default
+    current_device.device = &kUnknownAvrDevice;
     device_detected = false;
     Logger::error("Warning: Unknown device signature: 0x%02X 0x%02X 0x%02X\n",
                    sig[0], sig[1], sig[2]);
   }
 
+  selectPageOps();
   return device_detected;
 }
 
@@ -124,121 +447,136 @@ bool ISPProgrammer::eraseChip() {
   spiTransaction(0xAC, 0x80, 0x00, 0x00);
 
   // Wait for erase to complete
-  delay(100);
+  wait_stats.erase_us = waitForReady(current_device.device->erase_ms);
 
   return true;
 }
 
-bool ISPProgrammer::programFlash(const uint8_t* data, uint32_t size) {
+bool ISPProgrammer::writePage(uint32_t address, const uint8_t* data) {
   if (!device_detected || !data) return false;
 
-  Logger::info("Programming flash...");
+  uint32_t page_size = current_device.device->page_size;
+  if (address % page_size != 0 || address + page_size > current_device.device->flash_size) {
+    Logger::error("Invalid page address 0x%05X\n", address);
+    return false;
+  }
 
-  uint32_t page_size = current_device.page_size;
-  uint32_t pages = (size + page_size - 1) / page_size;
+  // Erased flash already reads 0xFF, skip blank pages
+  bool has_data = false;
+  for (uint32_t i = 0; i < page_size; i++) {
+    if (data[i] != 0xFF) {
+      has_data = true;
+      break;
+    }
+  }
+  if (!has_data) return true;
 
-  for (uint32_t page = 0; page < pages; page++) {
-    uint32_t addr = page * page_size;
-    const uint8_t* page_data = &data[addr];
+  Logger::info("Programming page %d (0x%04X)\n", address / page_size, address);
 
-    // Check if page contains data (not all 0xFF)
-    bool has_data = false;
-    for (uint32_t i = 0; i < page_size && (addr + i) < size; i++) {
-      if (page_data[i] != 0xFF) {
-        has_data = true;
-        break;
-      }
-    }
+  // Load page buffer
+  (this->*load_page)(address, data);
+  commitPage(address);
 
-    if (has_data) {
-      Logger::info("Programming page %d (0x%04X)\n", page, addr);
+  // Read the page back right away, a bad page is repaired in place where
+  // the flash allows it instead of failing the whole image
+  return verifyWrittenPage(address, data);
+}
 
-      // Load page buffer
-      for (uint32_t i = 0; i < page_size && (addr + i) < size; i += 2) {
-        uint8_t low_byte = page_data[i];
-        uint8_t high_byte = (addr + i + 1 < size) ? page_data[i + 1] : 0xFF;
+// Write the loaded page buffer to flash and wait for completion
+void ISPProgrammer::commitPage(uint32_t address) {
+  const AvrDevice& dev = *current_device.device;
+  uint32_t page_addr = dev.word_addressing ? address / 2 : address;
 
-        uint16_t word_addr = (addr + i) / 2;
+  if (dev.extended_address) {
+    // Load extended address byte
+    spiTransaction(0x4D, 0x00, (page_addr >> 16) & 0xFF, 0x00);
+  }
 
-        // Load program memory page (low byte)
-        spiTransaction(0x40, 0x00, word_addr & 0xFF, low_byte);
+  // Write program memory page
+  spiTransaction(0x4C, (page_addr >> 8) & 0xFF, page_addr & 0xFF, 0x00);
 
-        // Load program memory page (high byte)
-        spiTransaction(0x48, 0x00, word_addr & 0xFF, high_byte);
-      }
+  // Wait for page write to complete
+  uint32_t waited = waitForReady(dev.flash_write_ms);
+  if (wait_stats.pages == 0 || waited < wait_stats.min_us) {
+    wait_stats.min_us = waited;
+  }
+  if (waited > wait_stats.max_us) {
+    wait_stats.max_us = waited;
+  }
+  wait_stats.total_us += waited;
+  wait_stats.pages++;
+}
 
-      // Write program memory page
-      uint16_t page_addr = addr / 2;
-      if (current_device.uses_word_addressing) {
-        spiTransaction(0x4C, (page_addr >> 8) & 0xFF, page_addr & 0xFF, 0x00);
-      } else {
-        spiTransaction(0x4C, (addr >> 8) & 0xFF, addr & 0xFF, 0x00);
-      }
+// Check a freshly written page. A mismatch is first re-read at a lower
+// clock in case only the readback glitched. Without a chip erase flash bits
+// can only go from 1 to 0, so the page is rewritten when every wrong bit is
+// still 1; anything else needs a chip erase and fails the page.
+bool ISPProgrammer::verifyWrittenPage(uint32_t address, const uint8_t* data) {
+  uint32_t page_size = current_device.device->page_size;
+  uint8_t readback[256];
+
+  for (uint8_t attempt = 0;; attempt++) {
+    if (!readFlash(address, readback, page_size)) return false;
+    if (memcmp(readback, data, page_size) == 0) return true;
 
-      // Wait for page write to complete
-      delay(10);
+    if (attempt >= ISP_PAGE_RETRIES) break;
+    wait_stats.retries++;
+
+    if (stepDownClock()) {
+      if (!readFlash(address, readback, page_size)) return false;
+      if (memcmp(readback, data, page_size) == 0) return true;
     }
 
-    // Show progress every 10 pages
-    if (page % 10 == 0) {
-      showProgress(page, pages, "Programming");
+    for (uint32_t i = 0; i < page_size; i++) {
+      if (data[i] & ~readback[i]) {
+        Logger::error("Page 0x%04X at 0x%04X needs an erase to repair\n",
+                      address, address + i);
+        return false;
+      }
     }
-  }
 
-  showProgress(pages, pages, "Programming");
-  Logger::info("Flash programming complete");
+    Logger::error("Rewriting page 0x%04X after verify mismatch\n", address);
+    (this->*load_page)(address, data);
+    commitPage(address);
+  }
 
-  // Verify flash
-  return verifyFlash(data, size);
+  Logger::error("Page 0x%04X failed verify after %d retries\n", address,
+                ISP_PAGE_RETRIES);
+  return false;
 }
 
-bool ISPProgrammer::verifyFlash(const uint8_t* data, uint32_t size) {
-  if (!data) return false;
-
-  Logger::info("Verifying flash...");
-  bool verify_ok = true;
+bool ISPProgrammer::programFlash(const uint8_t* data, uint32_t size) {
+  if (!device_detected || !data) return false;
 
-  for (uint32_t addr = 0; addr < size; addr += 2) {
-    uint16_t word_addr = addr / 2;
+  Logger::info("Programming flash...");
 
-    // Read low byte
-    uint8_t low_byte =
-        spiTransaction(0x20, (word_addr >> 8) & 0xFF, word_addr & 0xFF, 0x00);
+  uint32_t page_size = current_device.device->page_size;
+  uint32_t pages = (size + page_size - 1) / page_size;
+  uint8_t page_data[256];
 
-    // Read high byte
-    uint8_t high_byte =
-        spiTransaction(0x28, (word_addr >> 8) & 0xFF, word_addr & 0xFF, 0x00);
+  for (uint32_t page = 0; page < pages; page++) {
+    uint32_t addr = page * page_size;
 
-    // Compare with expected data
-    if (data[addr] != low_byte) {
-      Logger::error(
-          "Verify error at 0x%04X: expected 0x%02X, got 0x%02X (low)\n", addr,
-          data[addr], low_byte);
-      verify_ok = false;
-      break;
-    }
+    // Pad the last partial page with erased bytes
+    uint32_t len = (addr + page_size <= size) ? page_size : size - addr;
+    memcpy(page_data, &data[addr], len);
+    memset(page_data + len, 0xFF, page_size - len);
 
-    if (addr + 1 < size && data[addr + 1] != high_byte) {
-      Logger::error(
-          "Verify error at 0x%04X: expected 0x%02X, got 0x%02X (high)\n",
-          addr + 1, data[addr + 1], high_byte);
-      verify_ok = false;
-      break;
+    if (!writePage(addr, page_data)) {
+      return false;
     }
 
-    // Show progress every 1KB
-    if (addr % 1024 == 0) {
-      showProgress(addr, size, "Verifying");
+    // Show progress every 10 pages
+    if (page % 10 == 0) {
+      showProgress(page, pages, "Programming");
     }
   }
 
-  if (verify_ok) {
-    Logger::info("Flash verification successful!");
-  } else {
-    Logger::error("Flash verification failed!");
-  }
+  showProgress(pages, pages, "Programming");
+  Logger::info("Flash programming complete");
 
-  return verify_ok;
+  // Every page was verified right after it was written
+  return true;
 }
 
 void ISPProgrammer::showProgress(uint32_t current, uint32_t total,
@@ -249,55 +587,96 @@ void ISPProgrammer::showProgress(uint32_t current, uint32_t total,
 }
 
 void ISPProgrammer::printDeviceInfo() const {
+  const AvrDevice& dev = *current_device.device;
+
   Logger::info("Device signature: 0x%02X 0x%02X 0x%02X\n",
                  current_device.signature[0], current_device.signature[1],
                  current_device.signature[2]);
-  Logger::info("Device: %s\n", current_device.name.c_str());
+  Logger::info("Device: %s\n", dev.name);
+  Logger::info("ISP clock: %d Hz\n", getClock());
 
   if (device_detected) {
-    Logger::info("Page size: %d bytes\n", current_device.page_size);
-    Logger::info("Flash size: %d bytes\n", current_device.flash_size);
-    Logger::info("Addressing: %s\n",
-                   current_device.uses_word_addressing ? "Word" : "Byte");
+    Logger::info("Page size: %d bytes\n", dev.page_size);
+    Logger::info("Flash size: %d bytes\n", dev.flash_size);
+    Logger::info("EEPROM size: %d bytes\n", dev.eeprom_size);
+    Logger::info("Addressing: %s%s\n", dev.word_addressing ? "Word" : "Byte",
+                 dev.extended_address ? ", extended" : "");
   }
 }
 
-void ISPProgrammer::printFuses() {
+bool ISPProgrammer::readFuses(FuseInfo& fuses) {
   if (!device_detected) {
     Logger::error("Device not detected or not in programming mode");
-    return;
+    return false;
   }
 
-  // Read fuses
-  uint8_t lfuse = spiTransaction(0x50, 0x00, 0x00, 0x00);
-  uint8_t hfuse = spiTransaction(0x58, 0x08, 0x00, 0x00);
-  uint8_t efuse = spiTransaction(0x50, 0x08, 0x00, 0x00);
-
-  Logger::info("Fuses - Low: 0x%02X, High: 0x%02X, Extended: 0x%02X\n", lfuse,
-                 hfuse, efuse);
-}
-
-// Static device info methods
-DeviceInfo ISPProgrammer::getATmega32U4Info() {
-  DeviceInfo info;
-  info.signature[0] = ATMEGA32U4_SIGNATURE_0;
-  info.signature[1] = ATMEGA32U4_SIGNATURE_1;
-  info.signature[2] = ATMEGA32U4_SIGNATURE_2;
-  info.name = "ATmega32U4";
-  info.page_size = ATMEGA32U4_PAGE_SIZE;
-  info.flash_size = ATMEGA32U4_FLASH_SIZE;
-  info.uses_word_addressing = true;
-  return info;
-}
-
-DeviceInfo ISPProgrammer::getATmega328PInfo() {
-  DeviceInfo info;
-  info.signature[0] = ATMEGA328P_SIGNATURE_0;
-  info.signature[1] = ATMEGA328P_SIGNATURE_1;
-  info.signature[2] = ATMEGA328P_SIGNATURE_2;
-  info.name = "ATmega328P";
-  info.page_size = 128;
-  info.flash_size = 32768;
-  info.uses_word_addressing = false;
-  return info;
+  fuses.low = spiTransaction(0x50, 0x00, 0x00, 0x00);
+  fuses.high = spiTransaction(0x58, 0x08, 0x00, 0x00);
+  fuses.extended = spiTransaction(0x50, 0x08, 0x00, 0x00);
+  fuses.lock = spiTransaction(0x58, 0x00, 0x00, 0x00);
+  fuses.calibration = spiTransaction(0x38, 0x00, 0x00, 0x00);
+  return true;
+}
+
+void ISPProgrammer::printFuses(const FuseInfo& fuses) {
+  Logger::info("Fuses - Low: 0x%02X, High: 0x%02X, Extended: 0x%02X\n",
+               fuses.low, fuses.high, fuses.extended);
+  Logger::info("Lock bits: 0x%02X, Calibration: 0x%02X\n", fuses.lock,
+               fuses.calibration);
+}
+
+bool ISPProgrammer::writeFuses(const FuseInfo& fuses) {
+  FuseInfo current;
+  if (!readFuses(current)) return false;
+
+  uint32_t timeout = current_device.device->flash_write_ms;
+  if (fuses.low != current.low) {
+    spiTransaction(0xAC, 0xA0, 0x00, fuses.low);
+    waitForReady(timeout);
+  }
+  if (fuses.high != current.high) {
+    spiTransaction(0xAC, 0xA8, 0x00, fuses.high);
+    waitForReady(timeout);
+  }
+  if (fuses.extended != current.extended) {
+    spiTransaction(0xAC, 0xA4, 0x00, fuses.extended);
+    waitForReady(timeout);
+  }
+
+  if (!readFuses(current) || current.low != fuses.low ||
+      current.high != fuses.high || current.extended != fuses.extended) {
+    Logger::error("Fuse readback mismatch");
+    return false;
+  }
+  return true;
+}
+
+bool ISPProgrammer::writeLockBits(uint8_t lock) {
+  if (!device_detected) {
+    Logger::error("Device not detected or not in programming mode");
+    return false;
+  }
+
+  spiTransaction(0xAC, 0xE0, 0x00, lock);
+  waitForReady(current_device.device->flash_write_ms);
+
+  // Only the six lock bits are implemented
+  uint8_t readback = spiTransaction(0x58, 0x00, 0x00, 0x00);
+  if ((readback & 0x3F) != (lock & 0x3F)) {
+    Logger::error("Lock bits readback 0x%02X, expected 0x%02X\n", readback, lock);
+    return false;
+  }
+  return true;
+}
+
+uint32_t ISPProgrammer::getBootStart(const FuseInfo& fuses) const {
+  const AvrDevice& device = *current_device.device;
+  return avrBootStart(device, device.boot_fuse_extended ? fuses.extended : fuses.high);
+}
+
+// BOOTRST is bit 0 of the boot fuse, programmed (0) jumps to the boot section
+bool ISPProgrammer::isBootResetEnabled(const FuseInfo& fuses) const {
+  const AvrDevice& device = *current_device.device;
+  uint8_t boot_fuse = device.boot_fuse_extended ? fuses.extended : fuses.high;
+  return (boot_fuse & 0x01) == 0;
 }
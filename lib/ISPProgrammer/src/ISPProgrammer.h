@@ -3,43 +3,109 @@
 
 #include <Arduino.h>
 #include <MacroLogger.h>
-#include <SPI.h>
+#include "AvrDevices.h"
+#include "ISPBus.h"
 
-// Device signatures
-#define ATMEGA32U4_SIGNATURE_0  0x1E
-#define ATMEGA32U4_SIGNATURE_1  0x95
-#define ATMEGA32U4_SIGNATURE_2  0x87
+// ISP clock negotiation. The serial programming interface needs SCK low and
+// high phases of more than 2 target CPU cycles (3 at 12 MHz and above), so
+// F_CPU/6 is the ceiling.
+#define ISP_TARGET_F_CPU           16000000UL
+#define ISP_MAX_CLOCK_HZ           (ISP_TARGET_F_CPU / 6)
+#define ISP_CLOCK_CACHE_SIZE       4
 
-#define ATMEGA328P_SIGNATURE_0  0x1E
-#define ATMEGA328P_SIGNATURE_1  0x95
-#define ATMEGA328P_SIGNATURE_2  0x0F
+// Size of the batch buffer for page loads and readback. Every flash byte
+// takes one 4-byte instruction, so 1024 bytes hold a full 256-byte page.
+#define ISP_BATCH_BUFFER_SIZE      1024
 
-// ATmega32U4 specifications
-#define ATMEGA32U4_PAGE_SIZE    128
-#define ATMEGA32U4_FLASH_SIZE   32768
+// A RDY/BSY poll gives up after this many times the datasheet write time
+// plus the floor, so a late wakeup of the polling task is not a timeout
+#define ISP_POLL_TIMEOUT_FACTOR    2
+#define ISP_POLL_TIMEOUT_FLOOR_MS  5
+
+// Rewrite attempts for a page that fails its readback check
+#define ISP_PAGE_RETRIES           2
+
+// How the programmer waits for a page write or chip erase to finish
+enum class IspCompletion { FIXED_DELAY, POLL_RDY_BSY };
+
+// Page write statistics since the last enterProgrammingMode()
+struct IspWaitStats {
+    uint32_t pages;        // page writes waited for
+    uint32_t total_us;     // time spent waiting for page writes
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t timeouts;     // polls still busy past their deadline
+    uint32_t erase_us;     // time spent waiting for the last chip erase
+    uint32_t retries;      // page readback mismatches that were retried
+};
+
+// Fuse, lock and calibration bytes of the target
+struct FuseInfo {
+    uint8_t low;
+    uint8_t high;
+    uint8_t extended;
+    uint8_t lock;
+    uint8_t calibration;
+};
 
 struct DeviceInfo {
-    uint8_t signature[3];
-    String name;
-    uint32_t page_size;
-    uint32_t flash_size;
-    bool uses_word_addressing;
+    uint8_t signature[3];      // as read from the target
+    const AvrDevice* device;   // descriptor, kUnknownAvrDevice if not in the table
 };
 
 class ISPProgrammer {
 private:
-    uint8_t reset_pin;
-    SPISettings spiSettings;
+    struct ClockCacheEntry {
+        uint8_t signature[3];
+        uint8_t clock_step;
+        bool used;
+    };
+
+    SPIBus spi_bus;  // used unless another bus is passed in
+    ISPBus* bus;
     DeviceInfo current_device;
     bool device_detected;
-    
+    IspCompletion completion;
+    bool poll_unsupported;  // target never answered RDY/BSY this session
+    bool poll_answered;     // target reported ready to a poll this session
+    IspWaitStats wait_stats;
+    uint8_t clock_step;  // index into the clock ladder
+    ClockCacheEntry clock_cache[ISP_CLOCK_CACHE_SIZE];
+    uint8_t batch_buffer[ISP_BATCH_BUFFER_SIZE];
+
+    // Page operations specialised for the detected device
+    typedef void (ISPProgrammer::*load_page_fn)(uint32_t address, const uint8_t* data);
+    typedef void (ISPProgrammer::*read_flash_fn)(uint32_t address, uint8_t* out,
+                                                 uint32_t length);
+    load_page_fn load_page;
+    read_flash_fn read_flash;
+
+    template <uint16_t PageSize>
+    void loadPageT(uint32_t address, const uint8_t* data);
+    template <bool Extended>
+    void readFlashT(uint32_t address, uint8_t* out, uint32_t length);
+    void selectPageOps();
+    void init();
+
     bool detectDevice();
-    bool verifyFlash(const uint8_t* data, uint32_t size);
     void showProgress(uint32_t current, uint32_t total, const char* operation);
     uint8_t spiTransaction(uint8_t a, uint8_t b, uint8_t c, uint8_t d);
+    void spiBatch(uint8_t* buffer, uint32_t length);
+    void commitPage(uint32_t address);
+    bool verifyWrittenPage(uint32_t address, const uint8_t* data);
+    uint32_t waitForReady(uint32_t timeout_ms);
+
+    void setClockStep(uint8_t step);
+    void readProbe(uint8_t out[6]);
+    void negotiateClock();
+    ClockCacheEntry* findCachedClock();
+    void cacheClock();
 
    public:
+    // Program over the hardware SPI bus, reset on the given pin
     ISPProgrammer(uint8_t reset_pin);
+    // Program over another bus, e.g. a simulated target
+    explicit ISPProgrammer(ISPBus& bus);
     ~ISPProgrammer();
     bool begin();
     void end();
@@ -48,17 +114,46 @@ private:
     bool exitProgrammingMode();
 
     bool programFlash(const uint8_t* data, uint32_t size);
+    // Load, write and verify a single flash page. The chip must already be
+    // erased; address must be page aligned and data must hold a full page.
+    bool writePage(uint32_t address, const uint8_t* data);
+    // Read flash bytes with batched read instructions
+    bool readFlash(uint32_t address, uint8_t* out, uint32_t length);
+    // Read EEPROM bytes with batched read instructions
+    bool readEeprom(uint32_t address, uint8_t* out, uint32_t length);
     bool eraseChip();
 
     DeviceInfo getDeviceInfo() const { return current_device; }
     bool isDeviceDetected() const { return device_detected; }
+    const AvrDevice& getDevice() const { return *current_device.device; }
+    uint32_t getPageSize() const { return current_device.device->page_size; }
+
+    // Completion strategy, polling is the default
+    void setCompletion(IspCompletion mode) { completion = mode; }
+    IspCompletion getCompletion() const { return completion; }
+    const IspWaitStats& getWaitStats() const { return wait_stats; }
+    void resetWaitStats();
+    void printWaitStats() const;
+
+    // Current ISP clock. The clock starts slow for synchronisation and is
+    // raised after the device was detected.
+    uint32_t getClock() const;
+    // Lower the ISP clock by one step after a verify mismatch. Returns false
+    // when already at the slowest clock.
+    bool stepDownClock();
 
     void printDeviceInfo() const;
-    void printFuses();
+    bool readFuses(FuseInfo& fuses);
+    static void printFuses(const FuseInfo& fuses);
+    // Write the low, high and extended fuses that differ from the target and
+    // read them back. Lock and calibration bytes are ignored.
+    bool writeFuses(const FuseInfo& fuses);
+    // Lock bits can only be cleared by a chip erase, write them last
+    bool writeLockBits(uint8_t lock);
 
-    // Static device info
-    static DeviceInfo getATmega32U4Info();
-    static DeviceInfo getATmega328PInfo();
+    // Boot section layout as selected by the fuses of the detected device
+    uint32_t getBootStart(const FuseInfo& fuses) const;
+    bool isBootResetEnabled(const FuseInfo& fuses) const;
 };
 
 #endif // ISP_PROGRAMMER_H
@@ -0,0 +1,40 @@
+#include "ISPSession.h"
+
+ISPSession::ISPSession(ISPProgrammer& programmer)
+    : isp(programmer), active(false) {
+  memset(&fuses, 0, sizeof(fuses));
+
+  if (!isp.begin()) {
+    Logger::error("Failed to initialize ISP programmer");
+    return;
+  }
+
+  if (!isp.enterProgrammingMode()) {
+    Logger::error("Failed to enter programming mode");
+    isp.end();
+    return;
+  }
+
+  isp.readFuses(fuses);
+  active = true;
+}
+
+ISPSession::~ISPSession() { close(); }
+
+void ISPSession::close() {
+  if (!active) {
+    return;
+  }
+  isp.exitProgrammingMode();
+  isp.end();
+  active = false;
+}
+
+void ISPSession::printDeviceInfo() const {
+  if (!active) {
+    Logger::error("No active programming session");
+    return;
+  }
+  isp.printDeviceInfo();
+  ISPProgrammer::printFuses(fuses);
+}
@@ -0,0 +1,41 @@
+#ifndef ISP_SESSION_H
+#define ISP_SESSION_H
+
+#include <Arduino.h>
+#include <MacroLogger.h>
+#include "ISPProgrammer.h"
+
+// Scoped programming session. The constructor starts the programmer, enters
+// programming mode once and caches the signature, fuses, lock bits and
+// calibration byte; the destructor leaves programming mode again. Connection
+// checks, fuse reads, erase, program and verify can all run inside one
+// session instead of each paying for its own reset cycle.
+class ISPSession {
+ private:
+  ISPProgrammer& isp;
+  bool active;
+  FuseInfo fuses;
+
+ public:
+  explicit ISPSession(ISPProgrammer& programmer);
+  ~ISPSession();
+
+  ISPSession(const ISPSession&) = delete;
+  ISPSession& operator=(const ISPSession&) = delete;
+
+  // End the session early, the destructor does nothing afterwards
+  void close();
+
+  bool isActive() const { return active; }
+  explicit operator bool() const { return active; }
+
+  ISPProgrammer& programmer() { return isp; }
+  ISPProgrammer* operator->() { return &isp; }
+
+  DeviceInfo getDeviceInfo() const { return isp.getDeviceInfo(); }
+  const FuseInfo& getFuses() const { return fuses; }
+
+  void printDeviceInfo() const;
+};
+
+#endif  // ISP_SESSION_H
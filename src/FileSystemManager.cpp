@@ -1,5 +1,8 @@
 #include "FileSystemManager.h"
 
+#include <ArduboyPackage.h>
+#include <ImageLoader.h>
+
 FileSystemManager::FileSystemManager() {}
 
 FileSystemManager::~FileSystemManager() {
@@ -16,7 +19,7 @@ bool FileSystemManager::begin() {
 
   sdSPI = new SPIClass(2);
   sdSPI->begin(SD_SCK_PIN, SD_MISO_PIN, SD_MOSI_PIN, SD_CS_PIN);
-  if (!SD.begin(SD_CS_PIN, *sdSPI)) {
+  if (!SD.begin(SD_CS_PIN, *sdSPI, SD_FREQUENCY, "/sd", SD_MAX_FILES)) {
     Logger::error("Nie udalo sie zainicjowac karty SD");
     return false;
   }
@@ -210,6 +213,16 @@ bool FileSystemManager::deleteFile(const String& path) {
   return SD.remove(path);
 }
 
+// A single rename, so after a power loss the file is under one of the two
+// names. FAT cannot rename over an existing file and removing it first would
+// leave a window with neither, so an existing target makes this fail.
+bool FileSystemManager::renameFile(const String& fromPath, const String& toPath) {
+  if (!initialized || SD.exists(toPath)) {
+    return false;
+  }
+  return SD.rename(fromPath, toPath);
+}
+
 bool FileSystemManager::copyFile(const String& sourcePath, const String& destPath) {
   if (!initialized || !fileExists(sourcePath)) {
     return false;
@@ -317,6 +330,45 @@ bool FileSystemManager::isValidHexFile(const String& path) {
   return line.startsWith(":");
 }
 
+bool FileSystemManager::isValidPackageFile(const String& path) {
+  if (!fileExists(path) || !ArduboyPackage::isPackage(path.c_str())) {
+    return false;
+  }
+
+  // Zip files start with a local file header
+  File file = openFile(path, "r");
+  if (!file) {
+    return false;
+  }
+  uint8_t signature[4] = {};
+  file.read(signature, sizeof(signature));
+  file.close();
+
+  return memcmp(signature, "PK\x03\x04", sizeof(signature)) == 0;
+}
+
+bool FileSystemManager::isValidImageFile(const String& path) {
+  if (isValidHexFile(path) || isValidPackageFile(path)) {
+    return true;
+  }
+  bool elf = ElfLoader::isElfImage(path.c_str());
+  if (!fileExists(path) || (!elf && !BinLoader::isBinImage(path.c_str()))) {
+    return false;
+  }
+
+  // Any non-empty file is a raw image, ELF files start with their magic
+  File file = openFile(path, "r");
+  if (!file) {
+    return false;
+  }
+  uint8_t magic[4] = {};
+  size_t length = file.read(magic, sizeof(magic));
+  file.close();
+
+  return elf ? length == sizeof(magic) && memcmp(magic, "\x7F" "ELF", sizeof(magic)) == 0
+             : length > 0;
+}
+
 void FileSystemManager::listHexFiles() {
   if (!initialized) {
     Logger::error("FileSystem not initialized");
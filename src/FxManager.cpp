@@ -1,4 +1,6 @@
 #include "FxManager.h"
+
+#include <esp_heap_caps.h>
 #include "UI.h"
 
 FxManager::FxManager() {
@@ -36,6 +38,25 @@ bool FxManager::begin() {
     return false;
   }
 
+  // Keep the bootloader when flashing games. A bootloader file on the SD
+  // card takes precedence over the one read back from the device.
+  arduboy->setPreserveBootloader(PRESERVE_BOOTLOADER);
+  if (PRESERVE_BOOTLOADER && fileSystem->fileExists(BOOTLOADER_HEX_PATH)) {
+    File bootFile = fileSystem->openFile(BOOTLOADER_HEX_PATH);
+    if (!arduboy->loadBootloader(bootFile)) {
+      Logger::error("Failed to load bootloader: %s\n", BOOTLOADER_HEX_PATH);
+    }
+    bootFile.close();
+  }
+  if (IMAGE_CACHE_ENABLED) {
+    arduboy->setImageCache(&SD);
+  }
+  if (fileSystem->fileExists(PATCH_CONFIG_PATH)) {
+    File patchFile = fileSystem->openFile(PATCH_CONFIG_PATH);
+    arduboy->loadPatches(patchFile);
+    patchFile.close();
+  }
+
   hid = new HID();
   if (!hid->begin()) {
     Logger::error("Failed to initialize HID!");
@@ -58,8 +79,8 @@ bool FxManager::begin() {
   gameLibrary = new GameLibrary();
   gameLibrary->begin(*fileSystem);
 
-  // this will load games from /arduboy directory on SD card
-  // it adds a couple of seconds to boot time, need to optimize later
+  // this will load games from /arduboy directory on SD card, from the
+  // library index unless the folders changed since it was written
   gameLibrary->loadGames();
 
   initialized = true;
@@ -144,7 +165,7 @@ void FxManager::setMode(FxMode mode) {
   }
 }
 
-void FxManager::flashGame(const GameInfo& game) {
+void FxManager::flashGame(const GameView& game) {
   if (!initialized) {
     Logger::error("FxManager not initialized");
     return;
@@ -152,29 +173,30 @@ void FxManager::flashGame(const GameInfo& game) {
 
   setMode(FxMode::PROGRAMMING);
 
-  if (game.filePath.length() == 0) {
+  String filePath = game.filePath();
+  if (filePath.length() == 0) {
     Logger::error("No filename provided for flashing");
     return;
   }
 
-  if (!fileSystem || !fileSystem->fileExists(game.filePath)) {
-    Logger::error("File not found: %s\n" , game.filePath.c_str());
+  if (!fileSystem || !fileSystem->fileExists(filePath)) {
+    Logger::error("File not found: %s\n" , filePath.c_str());
     return;
   }
 
-  if (!fileSystem->isValidHexFile(game.filePath)) {
-    Logger::error("Invalid HEX file: %s\n" , game.filePath.c_str());
+  if (!fileSystem->isValidImageFile(filePath)) {
+    Logger::error("Invalid game image: %s\n" , filePath.c_str());
     return;
   }
 
-  if (!arduboy || !arduboy->checkConnection()) {
-    Logger::error("Arduboy not connected");
+  if (!arduboy) {
+    Logger::error("ArduboyController not initialized");
     return;
   }
 
-  File file = fileSystem->openFile(game.filePath);
+  File file = fileSystem->openFile(filePath);
   if (!file) {
-    Logger::error("Failed to open file: %s\n" , game.filePath.c_str());
+    Logger::error("Failed to open file: %s\n" , filePath.c_str());
     return;
   }
 
@@ -187,13 +209,44 @@ void FxManager::flashGame(const GameInfo& game) {
     Logger::error("Flash operation failed");
   }
 
-  currentFlashedGame = success ? new GameInfo(game) : nullptr;
+  delete currentFlashedGame;
+  currentFlashedGame = success ? new GameInfo(game.toInfo()) : nullptr;
 
   file.close();
 
   setMode(FxMode::GAME);
 }
 
+void FxManager::dumpDevice(const String& path) {
+  if (!initialized) {
+    Logger::error("FxManager not initialized");
+    return;
+  }
+
+  if (path.length() == 0) {
+    Logger::error("No filename provided for the dump");
+    return;
+  }
+
+  if (!arduboy) {
+    Logger::error("ArduboyController not initialized");
+    return;
+  }
+
+  // A dump only reads the device, whatever ran before keeps running
+  FxMode previousMode = currentMode;
+  setMode(FxMode::PROGRAMMING);
+
+  Logger::info("Starting dump operation...");
+  if (arduboy->dump(SD, path.c_str())) {
+    Logger::info("Dump completed successfully!");
+  } else {
+    Logger::error("Dump operation failed");
+  }
+
+  setMode(previousMode);
+}
+
 void FxManager::reset() const {
   if (!initialized) {
     Logger::error("FxManager not initialized");
@@ -239,6 +292,26 @@ void FxManager::printInfo() {
   this->setMode(FxMode::MASTER);
 }
 
+void FxManager::printHeap() const {
+  Serial.printf("Heap: %u bytes free, largest block %u bytes\n",
+                (uint32_t)heap_caps_get_free_size(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL),
+                (uint32_t)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT | MALLOC_CAP_INTERNAL));
+  Serial.printf("PSRAM: %u bytes free\n", (uint32_t)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+
+  if (gameLibrary) {
+    LibraryView view(*gameLibrary);
+    if (view.valid()) {
+      const LibrarySnapshot* snapshot = view.get();
+      Serial.printf("Game library: %u categories, %u games, %u byte index %s\n",
+                    snapshot->category_count, snapshot->game_count, (uint32_t)snapshot->fileSize(),
+                    snapshot->filePath().c_str());
+      Serial.printf("Library cache: %u bytes in %s, %u page faults\n",
+                    (uint32_t)LibrarySnapshot::cacheSize(),
+                    snapshot->external ? "PSRAM" : "internal RAM", (uint32_t)snapshot->faults);
+    }
+  }
+}
+
 void FxManager::triStateSPIPins() {
   // Set SPI pins to INPUT (high-impedance) to avoid interference
   SPI.end();  // End SPI if active
@@ -1,5 +1,13 @@
 #include "GameLibrary.h"
 
+#include <ArduboyPackage.h>
+#include <ImageLoader.h>
+#include <Crc32.h>
+#include "LibraryIndex.h"
+
+// Known games a rescan looks ahead for when the listing changed
+#define LIBRARY_MATCH_WINDOW 16
+
 GameLibrary::GameLibrary() {}
 GameLibrary::~GameLibrary() {
   end();
@@ -10,36 +18,179 @@ void GameLibrary::begin(FileSystemManager& fs) {
 }
 
 void GameLibrary::end() {
-  games.clear();
+  retire(current.exchange(nullptr));
   this->fileSystemManager = nullptr;
 }
 
+LibraryView::LibraryView(const GameLibrary& library) : snapshot(library.acquire()) {}
+
+LibraryView::LibraryView(const LibraryView& other) : snapshot(other.snapshot) {
+  if (snapshot) {
+    snapshot->references.fetch_add(1);
+  }
+}
+
+LibraryView& LibraryView::operator=(const LibraryView& other) {
+  if (other.snapshot) {
+    other.snapshot->references.fetch_add(1);
+  }
+  GameLibrary::release(snapshot);
+  snapshot = other.snapshot;
+  return *this;
+}
+
+LibraryView::~LibraryView() {
+  GameLibrary::release(snapshot);
+}
+
+bool LibraryView::category(uint32_t index, LibraryCategoryRecord& record) const {
+  return snapshot && snapshot->category(index, record);
+}
+
+bool LibraryView::game(uint32_t category_index, uint32_t game_index,
+                       LibraryGameRecord& record) const {
+  LibraryCategoryRecord category;
+  return this->category(category_index, category) && game_index < category.game_count &&
+         snapshot->game(category.first_game + game_index, record);
+}
+
+CategoryView::CategoryView(const LibrarySnapshot& library, const LibraryCategoryRecord& record)
+  : games(record.game_count), present(true) {
+  // One byte stays for the path
+  pathAt = library.copyText(record.name, text, sizeof(text) - 1) + 1;
+  library.copyText(record.path, text + pathAt, sizeof(text) - pathAt);
+}
+
+GameView::GameView(const LibrarySnapshot& library, const LibraryGameRecord& record)
+  : stamp(record.stamp), present(true) {
+  const uint32_t offsets[FIELDS] = { record.path, record.title, record.date,
+                                     record.author, record.license, record.description };
+  size_t used = 0;
+  for (int i = 0; i < FIELDS; i++) {
+    at[i] = used;
+    // The fields still to come keep a byte each for their NUL
+    used += library.copyText(offsets[i], text + used, sizeof(text) - used - (FIELDS - 1 - i)) + 1;
+  }
+}
+
+GameInfo GameView::toInfo() const {
+  return GameInfo{ filePath(), title(), date(), author(), description(), license(), stamp };
+}
+
+LibrarySnapshot* GameLibrary::acquire() const {
+  readers.fetch_add(1);
+  LibrarySnapshot* snapshot = current.load();
+  if (snapshot) {
+    snapshot->references.fetch_add(1);
+  }
+  readers.fetch_sub(1);
+  return snapshot;
+}
+
+void GameLibrary::release(LibrarySnapshot* snapshot) {
+  if (snapshot && snapshot->references.fetch_sub(1) == 1) {
+    delete snapshot;
+  }
+}
+
+// Drop the published reference of a snapshot that was swapped out. A
+// reader that loaded the pointer before the swap holds its reference once
+// readers was zero.
+void GameLibrary::retire(LibrarySnapshot* snapshot) {
+  if (!snapshot) {
+    return;
+  }
+  while (readers.load() != 0) {
+    vTaskDelay(1);
+  }
+  release(snapshot);
+}
+
+// Make snapshot the current library, it is owned by the library now. The
+// index file of the one it replaces goes once its last reader is done.
+void GameLibrary::publish(LibrarySnapshot* snapshot) {
+  LibrarySnapshot* old = current.exchange(snapshot);
+  if (old) {
+    old->superseded = true;
+  }
+  retire(old);
+}
+
+// Game entry of an .arduboy package, the metadata comes from its info.json
+GameInfo GameLibrary::readPackage(const String& path, const String& fallbackTitle) const {
+  File packageFile = this->fileSystemManager->openFile(path);
+  ArduboyPackage package;
+  if (!packageFile || !package.open(packageFile) || !package.hasHex()) {
+    Logger::error("Not a game package: %s\n", path.c_str());
+    return GameInfo{ "", "Error", "", "", "", "" };
+  }
+  const PackageInfo& info = package.getInfo();
+  GameInfo game{
+    path,
+    info.title.length() > 0 ? info.title : fallbackTitle,
+    info.date,
+    info.author,
+    info.description,
+    info.license
+  };
+  packageFile.close();
+  return game;
+}
+
+// Game image formats in the order they are preferred, the fastest to load
+// first: raw binary is copied as it is, ELF needs its segments looked up,
+// HEX text has to be decoded and a package inflated as well. -1 for other
+// files.
+static int imageRank(const char* name) {
+  if (BinLoader::isBinImage(name)) return 0;
+  if (ElfLoader::isElfImage(name)) return 1;
+  if (String(name).endsWith(".hex")) return 2;
+  if (ArduboyPackage::isPackage(name)) return 3;
+  return -1;
+}
+
 // find game in the given folder
-GameInfo GameLibrary::findGameInFolder(const File &folder) const {
+GameInfo GameLibrary::findGameInFolder(const String& path) const {
 
-  // Found the game path, it should be a first .hex file inside this directory
-  File gameDir = this->fileSystemManager->openFile(folder.path());
+  // The fastest image in the folder is flashed, a package next to it still
+  // provides the title and the other details
+  String title = path.substring(path.lastIndexOf('/') + 1);
+  File gameDir = this->fileSystemManager->openFile(path);
   if (!gameDir || !gameDir.isDirectory()) {
-    Logger::error("Game directory not found: %s\n", folder.name());
+    Logger::error("Game directory not found: %s\n", title.c_str());
     return GameInfo{ "", "Error", "", "", "", ""  };
   }
+  String imagePath;
+  int imageBest = -1;
+  String packagePath;
   File gameFile = gameDir.openNextFile();
-  String title = String(folder.name());
   while (gameFile) {
-    String filename = String(gameFile.name());
-    if (filename.endsWith(".hex")) {
-      // this is the hex file, exit the loop
-      break;
+    int rank = imageRank(gameFile.name());
+    if (rank >= 0 && (imageBest < 0 || rank < imageBest)) {
+      imagePath = String(gameFile.path());
+      imageBest = rank;
+    }
+    if (ArduboyPackage::isPackage(gameFile.name()) && packagePath.length() == 0) {
+      packagePath = String(gameFile.path());
     }
-    gameFile = gameFile.openNextFile();
+    gameFile.close();
+    gameFile = gameDir.openNextFile();
   }
+  gameDir.close();
 
-  String filename = String(gameFile.path());
-
-  gameFile.close();
+  if (packagePath.length() > 0) {
+    GameInfo game = readPackage(packagePath, title);
+    if (game.filePath.length() > 0) {
+      game.filePath = imagePath;
+    }
+    // A broken package only counts when there is no other image
+    if (game.filePath.length() > 0 || imageBest == 3) {
+      return game;
+    }
+  }
 
   return GameInfo{
-    filename,
+    imagePath,
     title,
     "",
     "",
@@ -49,26 +200,169 @@ GameInfo GameLibrary::findGameInFolder(const File &folder) const {
 
 }
 
-void GameLibrary::extractCategoryMetadata(const File &folder, GameCategory &outCategory) {
+void GameLibrary::extractCategoryMetadata(const File &folder, String &name, String &path) {
   // Placeholder implementation
-  outCategory.categoryName = String(folder.name());
-  outCategory.categoryPath = String(folder.name());
+  name = String(folder.name());
+  path = String(folder.name());
 }
 
-void GameLibrary::loadLibraryFromFolder() {
-  if (!fileSystemManager || !fileSystemManager->isInitialized()) {
-    Logger::error("FileSystemManager not initialized");
-    return;
+static uint32_t fileStamp(uint32_t crc, File& file) {
+  const char* name = file.name();
+  uint32_t fields[2] = { (uint32_t)file.getLastWrite(),
+                         file.isDirectory() ? 0 : (uint32_t)file.size() };
+  crc = crc32Update(crc, reinterpret_cast<const uint8_t*>(name), strlen(name));
+  return crc32Update(crc, reinterpret_cast<const uint8_t*>(fields), sizeof(fields));
+}
+
+// Name, last write time and size of a category folder entry. FAT does not
+// update a folder's time when the files in it change, so a game folder
+// also takes in the name, time and size of every image and package in it.
+// That opens the folder, so it is only done for the games of categories
+// that are scanned.
+static uint32_t entryStamp(File& entry) {
+  uint32_t crc = fileStamp(CRC32_INIT, entry);
+  if (entry.isDirectory()) {
+    File file = entry.openNextFile();
+    while (file) {
+      if (!file.isDirectory() && imageRank(file.name()) >= 0) {
+        crc = fileStamp(crc, file);
+      }
+      file = entry.openNextFile();
+    }
+    entry.rewindDirectory();
+  }
+  return crc32Final(crc);
+}
+
+// Game folders and loose packages make up a category
+static bool isGameEntry(File& entry) {
+  return entry.isDirectory() || ArduboyPackage::isPackage(entry.name());
+}
+
+// The entry the game was listed by is closed by then, so a package is not
+// open twice
+GameInfo GameLibrary::readGame(const String& path, bool directory) const {
+  if (directory) {
+    return findGameInFolder(path);
+  }
+  String name = path.substring(path.lastIndexOf('/') + 1);
+  return readPackage(path, name.substring(0, name.lastIndexOf('.')));
+}
+
+// Stamp of a category folder listing: name, time and size of its game
+// entries in listing order. Lists the folder, opens no game folder, so a
+// file replaced inside a game folder does not change it.
+static uint32_t listingStamp(File& folder) {
+  uint32_t crc = CRC32_INIT;
+  File gameFile = folder.openNextFile();
+  while (gameFile) {
+    if (isGameEntry(gameFile)) {
+      crc = fileStamp(crc, gameFile);
+    }
+    gameFile = folder.openNextFile();
+  }
+  return crc32Final(crc);
+}
+
+// Add the category in folder to builder, stamp being its listing stamp. A
+// category with the same stamp as the known one is taken over as it is
+// unless deep is set, otherwise games with a known entry stamp are kept and
+// only the other entries are read. Returns the number of entries read.
+uint32_t GameLibrary::scanCategory(File& folder, uint32_t stamp, bool deep,
+                                   const LibrarySnapshot* known,
+                                   const LibraryCategoryRecord* knownCategory,
+                                   LibraryBuilder& builder) {
+  if (!deep && knownCategory && knownCategory->stamp == stamp) {
+    builder.addCategory(*known, *knownCategory);
+    return 0;
+  }
+
+  String name;
+  String path;
+  extractCategoryMetadata(folder, name, path);
+  builder.beginCategory(name, path);
+
+  // The listing keeps its order between scans, so the known games are
+  // matched in order: a game is looked for a few records ahead of the last
+  // match, which covers games that were removed since. Games that moved
+  // further are read again.
+  uint32_t knownCount = knownCategory ? knownCategory->game_count : 0;
+  uint32_t next = 0;
+  uint32_t read = 0;
+  folder.rewindDirectory();
+  File gameFile = folder.openNextFile();
+  while (gameFile) {
+    if (!isGameEntry(gameFile)) {
+      gameFile = folder.openNextFile();
+      continue;
+    }
+    uint32_t gameStamp = entryStamp(gameFile);
+    LibraryGameRecord record;
+    bool found = false;
+    for (uint32_t i = next; i < knownCount && i < next + LIBRARY_MATCH_WINDOW; i++) {
+      if (known->game(knownCategory->first_game + i, record) && record.stamp == gameStamp) {
+        found = true;
+        next = i + 1;
+        break;
+      }
+    }
+    if (found) {
+      builder.addGame(*known, record);
+    } else {
+      String path = String(gameFile.path());
+      bool directory = gameFile.isDirectory();
+      gameFile.close();
+      GameInfo game = readGame(path, directory);
+      read++;
+      if (game.filePath.length() > 0) {
+        game.stamp = gameStamp;
+        builder.addGame(game);
+      }
+    }
+    gameFile = folder.openNextFile();
   }
+  builder.endCategory(stamp);
+  return read;
+}
 
-  games.clear();
+// Position of the known category read from the folder name, looked for at
+// the position it is scanned at first. UINT32_MAX if there is none.
+static uint32_t findCategory(const LibraryView& view, uint32_t position, const char* name,
+                             LibraryCategoryRecord& record) {
+  uint32_t count = view.categoryCount();
+  for (uint32_t n = 0; n < count; n++) {
+    uint32_t i = (position + n) % count;
+    if (view.category(i, record) && view.get()->text(record.path) == name) {
+      return i;
+    }
+  }
+  return UINT32_MAX;
+}
 
+// Bring the library in line with the folders, reading only the game
+// folders and packages that were added or changed since the last scan.
+// Categories are compared by their listing only, so game folders are opened
+// just in categories whose listing changed. Nothing is written while the
+// folders match the known library; at the first difference the categories
+// before it are taken over and the index is built from there. A deep
+// rescan also opens the game folders of unchanged listings, to find files
+// replaced inside them, and always writes a new index. Returns true if the
+// library changed.
+bool GameLibrary::rescanLibrary(bool deep) {
   File gamesDir = fileSystemManager->openFile(GAME_LIBRARY_PATH);
   if (!gamesDir || !gamesDir.isDirectory()) {
     Logger::error("Games directory not found: %s\n", GAME_LIBRARY_PATH);
-    return;
+    return false;
   }
 
+  LibraryView view(*this);
+  const LibrarySnapshot* known = view.get();
+  uint32_t knownCount = view.categoryCount();
+  LibraryBuilder builder(*fileSystemManager, GAME_LIBRARY_INDEX);
+  bool changed = !view.valid() || deep;
+  uint32_t position = 0;
+  uint32_t read = 0;
+  LibraryCategoryRecord category;
   File entry = gamesDir.openNextFile();
   while (entry) {
     if (!entry.isDirectory()) {
@@ -77,41 +371,79 @@ void GameLibrary::loadLibraryFromFolder() {
       continue;
     }
 
-    Games category;
-
-    // find games in the category folder
-    std::vector<GameInfo> gamesInCategory = {};
-
-    // loop through files in the category folder
-    File gameFile = entry.openNextFile();
-    while (gameFile) {
-      if (!gameFile.isDirectory()) {
-        // skip non-directory files
-        gameFile = entry.openNextFile();
-        continue;
-      }
-      GameInfo game = findGameInFolder(gameFile);
-      if (game.filePath.length() > 0) {
-        gamesInCategory.push_back(game);
+    uint32_t found = findCategory(view, position, entry.name(), category);
+    uint32_t stamp = listingStamp(entry);
+    if (!changed && (found != position || category.stamp != stamp)) {
+      changed = true;
+      for (uint32_t i = 0; i < position; i++) {
+        LibraryCategoryRecord same;
+        if (view.category(i, same)) {
+          builder.addCategory(*known, same);
+        }
       }
-      gameFile = entry.openNextFile();
     }
+    if (changed) {
+      read += scanCategory(entry, stamp, deep, known, found != UINT32_MAX ? &category : nullptr,
+                           builder);
+    }
+    position++;
 
-    gameFile.close();
+    entry = gamesDir.openNextFile();
+  }
+  gamesDir.close();
 
-    extractCategoryMetadata(entry, category);
-    category.games = gamesInCategory;
+  // Categories were only removed at the end
+  if (!changed && position != knownCount) {
+    changed = true;
+    for (uint32_t i = 0; i < position; i++) {
+      if (view.category(i, category)) {
+        builder.addCategory(*known, category);
+      }
+    }
+  }
+  Logger::info("Library rescan: %u game entries read, %s\n", read,
+               changed ? "changed" : "unchanged");
+  if (!changed) {
+    return false;
+  }
+  LibrarySnapshot* scanned = builder.finish(known ? known->generation + 1 : 1);
+  if (!scanned) {
+    return false;
+  }
+  publish(scanned);
+  return true;
+}
 
-    games.push_back(category);
+// Start from the index, which stands for the folders as they were last
+// seen, then rescan so only what changed since is read. The first load
+// without an index reads everything. A rescan that changes the library
+// writes the next index generation.
+void GameLibrary::loadLibrary(bool deep) {
+  if (!fileSystemManager || !fileSystemManager->isInitialized()) {
+    Logger::error("FileSystemManager not initialized");
+    return;
+  }
 
-    entry = gamesDir.openNextFile();
+  uint32_t start = millis();
+  if (current.load() == nullptr) {
+    LibrarySnapshot* snapshot = LibraryIndex::openLatest(*fileSystemManager, GAME_LIBRARY_INDEX);
+    if (snapshot) {
+      publish(snapshot);
+      loading = false;
+    }
   }
-  gamesDir.close();
+  rescanLibrary(deep);
+  Logger::info("Game library loaded in %u ms\n", (uint32_t)(millis() - start));
 }
 
-void GameLibrary::loadGames() {
+void GameLibrary::loadGames(bool deep) {
+  if (scanning.exchange(true)) {
+    Logger::info("Game library scan already running");
+    return;
+  }
+  deepScan = deep;
   TaskHandle_t gamesLoaderTask = nullptr;
-  xTaskCreatePinnedToCore(
+  BaseType_t created = xTaskCreatePinnedToCore(
     [](void* param) {
       GameLibrary* library = static_cast<GameLibrary*>(param);
       if (!library) {
@@ -120,15 +452,16 @@ void GameLibrary::loadGames() {
         return;
       }
 
-      library->loading = true;
-      library->loaded = false;
+      // The UI keeps showing the current library during a rescan
+      library->loading = library->current.load() == nullptr;
 
       Logger::info("Loading game library from filesystem...");
-      library->loadLibraryFromFolder();
+      library->loadLibrary(library->deepScan);
       Logger::info("Game library loaded: %u categories\n", library->getCategoryCount());
 
       library->loading = false;
       library->loaded = true;
+      library->scanning = false;
 
       vTaskDelete(nullptr);
     },
@@ -139,33 +472,42 @@ void GameLibrary::loadGames() {
     &gamesLoaderTask,
     1
   );
+  // Without the task nothing would clear the flag and no later scan could run
+  if (created != pdPASS) {
+    Logger::error("Failed to start the game library scan");
+    scanning = false;
+  }
 }
 
-GameCategory GameLibrary::getCategory(uint8_t index) const {
-  if (index >= games.size()) {
-    return GameCategory{ "", "" };
+CategoryView GameLibrary::getCategory(uint32_t index) const {
+  LibraryView view(*this);
+  LibraryCategoryRecord category;
+  if (!view.category(index, category)) {
+    return CategoryView();
   }
-  return static_cast<GameCategory>(games.at(index));
+  return CategoryView(*view.get(), category);
 }
 
-uint8_t GameLibrary::getCategoryCount() const {
-  return games.size();
+uint32_t GameLibrary::getCategoryCount() const {
+  LibraryView view(*this);
+  return view.categoryCount();
 }
 
-uint8_t GameLibrary::getGamesCount(uint8_t category_index) const {
-  if (category_index < games.size()) {
-    return games.at(category_index).games.size();
-  }
-  return 0;
+uint32_t GameLibrary::getGamesCount(uint32_t category_index) const {
+  LibraryView view(*this);
+  LibraryCategoryRecord category;
+  return view.category(category_index, category) ? category.game_count : 0;
 }
 
-GameInfo GameLibrary::getGameInfo(uint8_t category_index, uint8_t game_index) const {
-  if (category_index >= games.size()) {
-    return GameInfo{ "", "Unknown category", "", "", "", "" };
+GameView GameLibrary::getGameInfo(uint32_t category_index, uint32_t game_index) const {
+  LibraryView view(*this);
+  LibraryCategoryRecord category;
+  if (!view.category(category_index, category)) {
+    return GameView("Unknown category");
   }
-  const Games& category = games.at(category_index);
-  if (game_index >= category.games.size()) {
-    return GameInfo{ "", "Unknown Game", "", "", "", "" };
+  LibraryGameRecord game;
+  if (!view.game(category_index, game_index, game)) {
+    return GameView("Unknown Game");
   }
-  return category.games.at(game_index);
-}
\ No newline at end of file
+  return GameView(*view.get(), game);
+}
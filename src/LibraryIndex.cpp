@@ -0,0 +1,142 @@
+#include "LibraryIndex.h"
+
+#include <Crc32.h>
+
+#define LIBRARY_CHECK_CHUNK 512
+
+String LibraryIndex::pathFor(const char* base, uint32_t generation) {
+  return String(base) + "." + String(generation) + LIBRARY_INDEX_EXTENSION;
+}
+
+// The header and the CRC of the body are checked once here, one sequential
+// read with a small buffer. Records are checked as they are read.
+LibrarySnapshot* LibraryIndex::open(FileSystemManager& fs, const String& path,
+                                    uint32_t generation) {
+  if (!fs.fileExists(path)) {
+    return nullptr;
+  }
+  File file = fs.openFile(path, "r");
+  if (!file) {
+    return nullptr;
+  }
+
+  LibraryIndexHeader header;
+  uint32_t size = file.size();
+  if (size < sizeof(header) || file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header)) {
+    Logger::info("Library index not used: %s\n", "too short");
+    file.close();
+    return nullptr;
+  }
+
+  uint64_t body_size = (uint64_t)header.category_count * sizeof(LibraryCategoryRecord) +
+                       (uint64_t)header.game_count * sizeof(LibraryGameRecord) +
+                       header.strings_size;
+  const char* reason = nullptr;
+  if (header.magic != LIBRARY_INDEX_MAGIC || header.version != LIBRARY_INDEX_VERSION) {
+    reason = "unknown format";
+  } else if (body_size != size - sizeof(header) || header.strings_size == 0) {
+    reason = "size mismatch";
+  } else {
+    uint8_t chunk[LIBRARY_CHECK_CHUNK];
+    uint32_t crc = CRC32_INIT;
+    uint64_t left = body_size;
+    while (left > 0) {
+      size_t length = left < sizeof(chunk) ? left : sizeof(chunk);
+      if (file.read(chunk, length) != length) {
+        break;
+      }
+      crc = crc32Update(crc, chunk, length);
+      left -= length;
+    }
+    if (left > 0 || crc32Final(crc) != header.crc) {
+      reason = "CRC mismatch";
+    }
+  }
+  file.close();
+  if (reason) {
+    Logger::info("Library index not used: %s\n", reason);
+    return nullptr;
+  }
+
+  return LibrarySnapshot::open(fs, path, generation, header.category_count, header.game_count,
+                               header.strings_size, sizeof(header));
+}
+
+// Generation of an index file name next to base, 0 for other files
+static uint32_t generationOf(const char* name, const char* base) {
+  const char* slash = strrchr(base, '/');
+  const char* stem = slash ? slash + 1 : base;
+  size_t stem_length = strlen(stem);
+  if (strncmp(name, stem, stem_length) != 0 || name[stem_length] != '.') {
+    return 0;
+  }
+  const char* digits = name + stem_length + 1;
+  char* end = nullptr;
+  unsigned long generation = strtoul(digits, &end, 10);
+  if (end == digits || strcmp(end, LIBRARY_INDEX_EXTENSION) != 0) {
+    return 0;
+  }
+  return generation;
+}
+
+// Highest index generation next to base that is below limit, 0 for none
+static uint32_t newestGeneration(FileSystemManager& fs, const String& folder, const char* base,
+                                 uint32_t limit) {
+  File dir = fs.openFile(folder);
+  if (!dir || !dir.isDirectory()) {
+    return 0;
+  }
+  uint32_t newest = 0;
+  File entry = dir.openNextFile();
+  while (entry) {
+    uint32_t generation = entry.isDirectory() ? 0 : generationOf(entry.name(), base);
+    if (generation > newest && generation < limit) {
+      newest = generation;
+    }
+    entry = dir.openNextFile();
+  }
+  dir.close();
+  return newest;
+}
+
+LibrarySnapshot* LibraryIndex::openLatest(FileSystemManager& fs, const char* base) {
+  String folder = String(base).substring(0, String(base).lastIndexOf('/'));
+  if (folder.length() == 0) {
+    folder = "/";
+  }
+
+  // Newest first, older generations are tried while the newer turn out
+  // corrupt
+  LibrarySnapshot* snapshot = nullptr;
+  uint32_t generation = newestGeneration(fs, folder, base, UINT32_MAX);
+  while (generation != 0 && !snapshot) {
+    snapshot = open(fs, pathFor(base, generation), generation);
+    if (!snapshot) {
+      generation = newestGeneration(fs, folder, base, generation);
+    }
+  }
+
+  // Everything else that belongs to the index goes: other generations and
+  // the temporary files of an interrupted write
+  File dir = fs.openFile(folder);
+  if (!dir || !dir.isDirectory()) {
+    return snapshot;
+  }
+  String stem = String(base).substring(String(base).lastIndexOf('/') + 1) + ".";
+  std::vector<String> stale;
+  File entry = dir.openNextFile();
+  while (entry) {
+    String name = String(entry.name());
+    if (!entry.isDirectory() && name.startsWith(stem) &&
+        (!snapshot || generationOf(name.c_str(), base) != snapshot->generation)) {
+      stale.push_back(String(entry.path()));
+    }
+    entry = dir.openNextFile();
+  }
+  dir.close();
+  for (const String& path : stale) {
+    Logger::info("Removing old library index %s\n", path.c_str());
+    fs.deleteFile(path);
+  }
+  return snapshot;
+}
@@ -0,0 +1,438 @@
+#include "LibrarySnapshot.h"
+
+#include <Crc32.h>
+#include <esp_heap_caps.h>
+#include <new>
+#include "LibraryIndex.h"
+
+void* libraryAlloc(size_t size, bool* external) {
+  void* data = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (external) {
+    *external = data != nullptr;
+  }
+  return data ? data : heap_caps_malloc(size, MALLOC_CAP_8BIT);
+}
+
+void libraryFree(void* data) {
+  heap_caps_free(data);
+}
+
+LibrarySnapshot* LibrarySnapshot::open(FileSystemManager& fs, const String& path,
+                                       uint32_t generation, uint32_t category_count,
+                                       uint32_t game_count, uint32_t strings_size,
+                                       uint32_t body_offset) {
+  LibrarySnapshot* snapshot = new (std::nothrow) LibrarySnapshot(fs, path);
+  if (!snapshot) {
+    return nullptr;
+  }
+  snapshot->generation = generation;
+  snapshot->category_count = category_count;
+  snapshot->game_count = game_count;
+  snapshot->strings_size = strings_size;
+  snapshot->body_offset = body_offset;
+  snapshot->cache = static_cast<uint8_t*>(libraryAlloc(cacheSize(), &snapshot->external));
+  snapshot->cache_lock = xSemaphoreCreateMutex();
+  snapshot->file_lock = xSemaphoreCreateMutex();
+  snapshot->file = fs.openFile(path, "r");
+  if (!snapshot->cache || !snapshot->cache_lock || !snapshot->file_lock || !snapshot->file) {
+    Logger::error("Failed to open library index %s\n", path.c_str());
+    delete snapshot;
+    return nullptr;
+  }
+  return snapshot;
+}
+
+// The index file of a superseded snapshot is not needed any more, nothing
+// else reads it
+LibrarySnapshot::~LibrarySnapshot() {
+  if (file) {
+    file.close();
+  }
+  if (superseded && fs->isInitialized()) {
+    fs->deleteFile(path);
+  }
+  if (cache_lock) {
+    vSemaphoreDelete(cache_lock);
+  }
+  if (file_lock) {
+    vSemaphoreDelete(file_lock);
+  }
+  libraryFree(cache);
+}
+
+// Copy from page index of the file if it is resident
+bool LibrarySnapshot::copyResident(uint32_t index, uint32_t within, uint8_t* out,
+                                   size_t length) const {
+  bool found = false;
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  for (uint32_t i = 0; i < LIBRARY_PAGE_COUNT; i++) {
+    if (pages[i].index == index) {
+      pages[i].used = ++clock;
+      memcpy(out, cache + i * LIBRARY_PAGE_SIZE + within, length);
+      found = true;
+      break;
+    }
+  }
+  xSemaphoreGive(cache_lock);
+  return found;
+}
+
+// Read page index of the file into the spare page, then put it over the
+// least recently used slot and copy from it. Faults wait for each other,
+// the cache lock is only held for the copies.
+bool LibrarySnapshot::fault(uint32_t index, uint32_t within, uint8_t* out, size_t length) const {
+  xSemaphoreTake(file_lock, portMAX_DELAY);
+  // Another fault may have brought the page in while this one waited
+  if (copyResident(index, within, out, length)) {
+    xSemaphoreGive(file_lock);
+    return true;
+  }
+
+  uint8_t* spare = cache + LIBRARY_PAGE_COUNT * LIBRARY_PAGE_SIZE;
+  uint32_t start = index * LIBRARY_PAGE_SIZE;
+  size_t size = start < fileSize() ? fileSize() - start : 0;
+  size = size < LIBRARY_PAGE_SIZE ? size : LIBRARY_PAGE_SIZE;
+  if (size == 0 || !file.seek(start) || file.read(spare, size) != size) {
+    xSemaphoreGive(file_lock);
+    Logger::error("Failed to read library index %s\n", path.c_str());
+    return false;
+  }
+  faults++;
+
+  xSemaphoreTake(cache_lock, portMAX_DELAY);
+  uint32_t oldest = 0;
+  for (uint32_t i = 1; i < LIBRARY_PAGE_COUNT; i++) {
+    if (pages[i].used < pages[oldest].used) {
+      oldest = i;
+    }
+  }
+  memcpy(cache + oldest * LIBRARY_PAGE_SIZE, spare, size);
+  pages[oldest].index = index;
+  pages[oldest].used = ++clock;
+  memcpy(out, spare + within, length);
+  xSemaphoreGive(cache_lock);
+  xSemaphoreGive(file_lock);
+  return true;
+}
+
+bool LibrarySnapshot::read(uint32_t offset, void* data, size_t length) const {
+  if ((uint64_t)offset + length > fileSize()) {
+    return false;
+  }
+  uint8_t* out = static_cast<uint8_t*>(data);
+  while (length > 0) {
+    uint32_t index = offset / LIBRARY_PAGE_SIZE;
+    uint32_t within = offset % LIBRARY_PAGE_SIZE;
+    size_t chunk = LIBRARY_PAGE_SIZE - within < length ? LIBRARY_PAGE_SIZE - within : length;
+    if (!copyResident(index, within, out, chunk) && !fault(index, within, out, chunk)) {
+      return false;
+    }
+    out += chunk;
+    offset += chunk;
+    length -= chunk;
+  }
+  return true;
+}
+
+bool LibrarySnapshot::category(uint32_t index, LibraryCategoryRecord& record) const {
+  if (index >= category_count) {
+    return false;
+  }
+  if (!read(body_offset + index * sizeof(record), &record, sizeof(record))) {
+    return false;
+  }
+  // A record pointing past the games keeps none of them
+  if (record.first_game > game_count || record.game_count > game_count - record.first_game) {
+    record.first_game = 0;
+    record.game_count = 0;
+  }
+  return true;
+}
+
+bool LibrarySnapshot::game(uint32_t index, LibraryGameRecord& record) const {
+  if (index >= game_count) {
+    return false;
+  }
+  return read(body_offset + category_count * sizeof(LibraryCategoryRecord) + index * sizeof(record),
+              &record, sizeof(record));
+}
+
+size_t LibrarySnapshot::copyText(uint32_t offset, char* out, size_t size) const {
+  uint32_t start = body_offset + category_count * sizeof(LibraryCategoryRecord) +
+                   game_count * sizeof(LibraryGameRecord);
+  uint32_t end = offset < strings_size ? strings_size : offset;
+  size_t copied = 0;
+  while (offset < end && copied + 1 < size) {
+    size_t length = end - offset < 64 ? end - offset : 64;
+    length = length < size - 1 - copied ? length : size - 1 - copied;
+    if (!read(start + offset, out + copied, length)) {
+      break;
+    }
+    const char* nul = static_cast<const char*>(memchr(out + copied, '\0', length));
+    if (nul) {
+      copied = nul - out;
+      break;
+    }
+    copied += length;
+    offset += length;
+  }
+  out[copied] = '\0';
+  return copied;
+}
+
+String LibrarySnapshot::text(uint32_t offset) const {
+  char text[LIBRARY_TEXT_MAX + 1];
+  copyText(offset, text, sizeof(text));
+  return String(text);
+}
+
+static uint32_t hashText(const char* text) {
+  uint32_t hash = 2166136261UL;  // FNV-1a
+  while (*text) {
+    hash = (hash ^ (uint8_t)*text++) * 16777619UL;
+  }
+  return hash;
+}
+
+LibraryBuilder::LibraryBuilder(FileSystemManager& fs, const char* base) : fs(fs), base(base) {}
+
+LibraryBuilder::~LibraryBuilder() {
+  close();
+}
+
+// The temporary file is created with the first category, a rescan that
+// finds nothing changed writes nothing
+bool LibraryBuilder::start() {
+  if (started) {
+    return !failed;
+  }
+  started = true;
+  records = fs.openFile(tempPath("rec"), "w");
+  interned = new (std::nothrow) InternSlot[LIBRARY_INTERN_SLOTS];
+  chunks = new (std::nothrow) Chunk[CHUNK_KINDS];
+  if (!records || !interned || !chunks) {
+    Logger::error("Failed to create library index files next to %s\n", base.c_str());
+    failed = true;
+    return false;
+  }
+  // Offset 0 holds the empty string
+  append(STRINGS, "", 1);
+  strings_size = 1;
+  return !failed;
+}
+
+void LibraryBuilder::close() {
+  if (!started) {
+    return;
+  }
+  records.close();
+  fs.deleteFile(tempPath("rec"));
+  delete[] interned;
+  interned = nullptr;
+  delete[] chunks;
+  chunks = nullptr;
+  started = false;
+}
+
+void LibraryBuilder::write(File& file, const void* data, size_t length) {
+  if (!failed && file.write(static_cast<const uint8_t*>(data), length) != length) {
+    Logger::error("Failed to write library index files next to %s\n", base.c_str());
+    failed = true;
+  }
+}
+
+void LibraryBuilder::append(ChunkKind kind, const void* data, size_t length) {
+  if (failed) {
+    return;
+  }
+  Chunk& chunk = chunks[kind];
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  while (length > 0) {
+    size_t room = LIBRARY_BUILD_CHUNK - chunk.length;
+    size_t part = length < room ? length : room;
+    memcpy(chunk.data + chunk.length, bytes, part);
+    chunk.length += part;
+    bytes += part;
+    length -= part;
+    if (chunk.length == LIBRARY_BUILD_CHUNK) {
+      flush(kind);
+    }
+  }
+}
+
+void LibraryBuilder::flush(ChunkKind kind) {
+  Chunk& chunk = chunks[kind];
+  if (chunk.length == 0) {
+    return;
+  }
+  ChunkHeader header{ kind, 0, chunk.length };
+  write(records, &header, sizeof(header));
+  write(records, chunk.data, chunk.length);
+  chunk.length = 0;
+}
+
+uint32_t LibraryBuilder::intern(const char* text) {
+  if (*text == '\0' || failed) {
+    return 0;
+  }
+  size_t length = strlen(text);
+  InternSlot* slot = nullptr;
+  if (length < LIBRARY_INTERN_TEXT) {
+    slot = &interned[hashText(text) % LIBRARY_INTERN_SLOTS];
+    if (slot->offset != 0 && strcmp(slot->text, text) == 0) {
+      return slot->offset;
+    }
+  }
+
+  uint32_t offset = strings_size;
+  append(STRINGS, text, length + 1);
+  strings_size += length + 1;
+  if (slot) {
+    slot->offset = offset;
+    memcpy(slot->text, text, length + 1);
+  }
+  return offset;
+}
+
+void LibraryBuilder::beginCategory(const String& name, const String& path) {
+  start();
+  category = LibraryCategoryRecord{
+    intern(name),
+    intern(path),
+    game_count,
+    0,
+    0
+  };
+}
+
+void LibraryBuilder::addGame(const char* path, const char* title, const char* date,
+                             const char* author, const char* description,
+                             const char* license, uint32_t stamp) {
+  LibraryGameRecord game{
+    intern(path),
+    intern(title),
+    intern(date),
+    intern(author),
+    intern(description),
+    intern(license),
+    stamp
+  };
+  append(GAMES, &game, sizeof(game));
+  game_count++;
+}
+
+void LibraryBuilder::addGame(const GameInfo& game) {
+  addGame(game.filePath.c_str(), game.title.c_str(), game.date.c_str(), game.author.c_str(),
+          game.description.c_str(), game.license.c_str(), game.stamp);
+}
+
+void LibraryBuilder::addGame(const LibrarySnapshot& from, const LibraryGameRecord& game) {
+  addGame(from.text(game.path).c_str(), from.text(game.title).c_str(),
+          from.text(game.date).c_str(), from.text(game.author).c_str(),
+          from.text(game.description).c_str(), from.text(game.license).c_str(), game.stamp);
+}
+
+void LibraryBuilder::addCategory(const LibrarySnapshot& from,
+                                 const LibraryCategoryRecord& category) {
+  beginCategory(from.text(category.name), from.text(category.path));
+  LibraryGameRecord game;
+  for (uint32_t i = 0; i < category.game_count; i++) {
+    if (from.game(category.first_game + i, game)) {
+      addGame(from, game);
+    }
+  }
+  endCategory(category.stamp);
+}
+
+void LibraryBuilder::endCategory(uint32_t stamp) {
+  category.game_count = game_count - category.first_game;
+  category.stamp = stamp;
+  categories.push_back(category);
+}
+
+// Copy the chunks of one kind from in to out, adding them to the CRC
+bool LibraryBuilder::copyChunks(File& in, File& out, ChunkKind kind, uint32_t& crc) {
+  uint8_t* buffer = chunks[GAMES].data;
+  ChunkHeader header;
+  in.seek(0);
+  while (in.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header)) {
+    if (header.length > LIBRARY_BUILD_CHUNK) {
+      return false;
+    }
+    if (header.kind != kind) {
+      if (!in.seek(in.position() + header.length)) {
+        return false;
+      }
+      continue;
+    }
+    if (in.read(buffer, header.length) != header.length) {
+      return false;
+    }
+    crc = crc32Update(crc, buffer, header.length);
+    if (out.write(buffer, header.length) != header.length) {
+      return false;
+    }
+  }
+  return true;
+}
+
+LibrarySnapshot* LibraryBuilder::finish(uint32_t generation) {
+  if (!start()) {
+    close();
+    return nullptr;
+  }
+  flush(GAMES);
+  flush(STRINGS);
+  records.close();
+  uint32_t category_count = categories.size();
+
+  LibraryIndexHeader header = {};
+  header.magic = LIBRARY_INDEX_MAGIC;
+  header.version = LIBRARY_INDEX_VERSION;
+  header.category_count = category_count;
+  header.game_count = game_count;
+  header.strings_size = strings_size;
+
+  // The header goes in last, once the CRC of the body is known. Categories
+  // come from memory, then the game records and the strings are picked out
+  // of the temporary file in two passes.
+  String temp = tempPath("idx");
+  File file = fs.openFile(temp, "w");
+  File in = fs.openFile(tempPath("rec"), "r");
+  uint32_t crc = CRC32_INIT;
+  size_t categories_size = category_count * sizeof(LibraryCategoryRecord);
+  const uint8_t* category_data = reinterpret_cast<const uint8_t*>(categories.data());
+  bool ok = !failed && file && in &&
+            file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header) &&
+            file.write(category_data, categories_size) == categories_size;
+  crc = crc32Update(crc, category_data, categories_size);
+  ok = ok && copyChunks(in, file, GAMES, crc) && copyChunks(in, file, STRINGS, crc);
+  header.crc = crc32Final(crc);
+  ok = ok && file.seek(0) &&
+       file.write(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == sizeof(header);
+  if (file) {
+    file.close();
+  }
+  if (in) {
+    in.close();
+  }
+  close();
+
+  String path = LibraryIndex::pathFor(base.c_str(), generation);
+  if (!ok || !fs.renameFile(temp, path)) {
+    Logger::error("Failed to write library index %s\n", path.c_str());
+    fs.deleteFile(temp);
+    return nullptr;
+  }
+  Logger::info("Library index written: %u categories, %u games, %u bytes\n",
+               category_count, game_count,
+               (uint32_t)(sizeof(header) + category_count * sizeof(LibraryCategoryRecord) +
+                          game_count * sizeof(LibraryGameRecord) + strings_size));
+
+  LibrarySnapshot* snapshot = LibrarySnapshot::open(fs, path, generation, category_count,
+                                                    game_count, strings_size, sizeof(header));
+  if (!snapshot) {
+    fs.deleteFile(path);
+  }
+  return snapshot;
+}
@@ -70,13 +70,13 @@ void SerialCLI::update() {
       String gameStr = args.substring(spaceIdx + 1);
       int categoryIndex = categoryStr.toInt();
       int gameIndex = gameStr.toInt();
-      GameCategory category = fxManager->gameLibrary->getCategory(categoryIndex);
-      if (category.categoryName.length() == 0) {
+      CategoryView category = fxManager->gameLibrary->getCategory(categoryIndex);
+      if (!category.valid()) {
         Serial.println("Invalid category index");
         return;
       }
-      GameInfo game = fxManager->gameLibrary->getGameInfo(categoryIndex, gameIndex);
-      if (game.filePath.length() == 0) {
+      GameView game = fxManager->gameLibrary->getGameInfo(categoryIndex, gameIndex);
+      if (!game.valid()) {
         Serial.println("Invalid game index");
         return;
       }
@@ -84,6 +84,15 @@ void SerialCLI::update() {
       return;
     }
 
+    if (command == "dump") {
+      if (args.length() == 0) {
+        Serial.println("Usage: dump <path.hex|path.bin>");
+        return;
+      }
+      fxManager->dumpDevice(args);
+      return;
+    }
+
     if (command == "ls") {
       if (args.length() == 0) {
         Serial.println("Usage: ls <path>");
@@ -94,17 +103,17 @@ void SerialCLI::update() {
     }
 
     if (command== "lg") {
-      fxManager->gameLibrary->loadGames();
+      fxManager->gameLibrary->loadGames(true);
       return;
     }
 
     if (command == "categories") {
-      int categoryCount = fxManager->gameLibrary->getCategoryCount();
+      uint32_t categoryCount = fxManager->gameLibrary->getCategoryCount();
       Serial.println("Game Categories:");
-      for (int i = 0; i < categoryCount; i++) {
-        GameCategory category = fxManager->gameLibrary->getCategory(i);
-        Serial.println(String(i) + ": " + category.categoryName + " (" +
-                       String(fxManager->gameLibrary->getGamesCount(i)) + " games)");
+      for (uint32_t i = 0; i < categoryCount; i++) {
+        CategoryView category = fxManager->gameLibrary->getCategory(i);
+        Serial.println(String(i) + ": " + category.name() + " (" +
+                       String(category.gameCount()) + " games)");
       }
       return;
     }
@@ -115,16 +124,16 @@ void SerialCLI::update() {
         return;
       }
       int categoryIndex = args.toInt();
-      GameCategory category = fxManager->gameLibrary->getCategory(categoryIndex);
-      if (category.categoryName.length() == 0) {
+      CategoryView category = fxManager->gameLibrary->getCategory(categoryIndex);
+      if (!category.valid()) {
         Serial.println("Invalid category index");
         return;
       }
-      int gameCount = fxManager->gameLibrary->getGamesCount(categoryIndex);
-      Serial.println("Games in Category: " + category.categoryName);
-      for (int i = 0; i < gameCount; i++) {
-        GameInfo game = fxManager->gameLibrary->getGameInfo(categoryIndex, i);
-        Serial.println(String(i) + ": " + game.title + " by " + game.author);
+      uint32_t gameCount = fxManager->gameLibrary->getGamesCount(categoryIndex);
+      Serial.println("Games in Category: " + String(category.name()));
+      for (uint32_t i = 0; i < gameCount; i++) {
+        GameView game = fxManager->gameLibrary->getGameInfo(categoryIndex, i);
+        Serial.println(String(i) + ": " + game.title() + " by " + game.author());
       }
       return;
     }
@@ -143,23 +152,28 @@ void SerialCLI::update() {
       String gameStr = args.substring(spaceIdx + 1);
       int categoryIndex = categoryStr.toInt();
       int gameIndex = gameStr.toInt();
-      GameCategory category = fxManager->gameLibrary->getCategory(categoryIndex);
-      if (category.categoryName.length() == 0) {
+      CategoryView category = fxManager->gameLibrary->getCategory(categoryIndex);
+      if (!category.valid()) {
         Serial.println("Invalid category index");
         return;
       }
-      GameInfo game = fxManager->gameLibrary->getGameInfo(categoryIndex, gameIndex);
-      if (game.filePath.length() == 0) {
+      GameView game = fxManager->gameLibrary->getGameInfo(categoryIndex, gameIndex);
+      if (!game.valid()) {
         Serial.println("Invalid game index");
         return;
       }
       // print game info
       Serial.println("Game Info:");
-      Serial.println("Title: " + game.title);
-      Serial.println("Author: " + game.author);
-      Serial.println("Date: " + game.date);
-      Serial.println("Description: " + game.description);
-      Serial.println("License: " + game.license);
+      Serial.println("Title: " + String(game.title()));
+      Serial.println("Author: " + String(game.author()));
+      Serial.println("Date: " + String(game.date()));
+      Serial.println("Description: " + String(game.description()));
+      Serial.println("License: " + String(game.license()));
+      return;
+    }
+
+    if (command == "heap") {
+      fxManager->printHeap();
       return;
     }
 
@@ -16,20 +16,20 @@ UI_GameSelection::~UI_GameSelection() {
   fxManager = nullptr;
 }
 
-void UI_GameSelection::drawGameSplashScreen(const GameInfo& game, int8_t x_offset, int8_t y_offset) const {
+void UI_GameSelection::drawGameSplashScreen(const GameView& game, int8_t x_offset, int8_t y_offset) const {
   fxManager->oled->u8g2.setFont(u8g2_font_profont15_tr);
-  uint8_t textWidth = fxManager->oled->u8g2.getStrWidth(game.title.c_str());
-  fxManager->oled->u8g2.drawStr(((128 - textWidth) / 2) + x_offset, 30 + y_offset, game.title.c_str());
+  uint8_t textWidth = fxManager->oled->u8g2.getStrWidth(game.title());
+  fxManager->oled->u8g2.drawStr(((128 - textWidth) / 2) + x_offset, 30 + y_offset, game.title());
 
   fxManager->oled->u8g2.setFont(u8g2_font_4x6_tr);
-  textWidth = fxManager->oled->u8g2.getStrWidth(game.author.c_str());
-  fxManager->oled->u8g2.drawStr(((128 - textWidth) / 2) + x_offset, 40 + y_offset, game.author.c_str());
+  textWidth = fxManager->oled->u8g2.getStrWidth(game.author());
+  fxManager->oled->u8g2.drawStr(((128 - textWidth) / 2) + x_offset, 40 + y_offset, game.author());
 }
 
-void UI_GameSelection::drawCategoryScreen(const GameCategory &category, int8_t x_offset, int8_t y_offset) const {
+void UI_GameSelection::drawCategoryScreen(const CategoryView &category, int8_t x_offset, int8_t y_offset) const {
   fxManager->oled->u8g2.setFont(u8g2_font_profont15_tr);
-  uint8_t textWidth = fxManager->oled->u8g2.getStrWidth(category.categoryName.c_str());
-  fxManager->oled->u8g2.drawStr(((128 - textWidth) / 2) + x_offset, 30 + y_offset, category.categoryName.c_str());
+  uint8_t textWidth = fxManager->oled->u8g2.getStrWidth(category.name());
+  fxManager->oled->u8g2.drawStr(((128 - textWidth) / 2) + x_offset, 30 + y_offset, category.name());
 
   String gameCountText = String(gamesInCategory) + " games";
   fxManager->oled->u8g2.setFont(u8g2_font_4x6_tr);
@@ -91,7 +91,7 @@ bool UI_GameSelection::handleHid() {
     return false;
   }
 
-  if (fxManager->hid->pressed(Buttons::RIGHT) && currentCategoryIndex < categoriesCount - 1) {
+  if (fxManager->hid->pressed(Buttons::RIGHT) && currentCategoryIndex + 1 < categoriesCount) {
     delay(200); // simple debounce
     currentCategoryIndex ++;
     currentGameIndex = 0;
@@ -111,7 +111,7 @@ bool UI_GameSelection::handleHid() {
     gamesInCategory = fxManager->gameLibrary->getGamesCount(currentCategoryIndex);
   }
 
-  if (fxManager->hid->pressed(Buttons::DOWN) && currentGameIndex < gamesInCategory - 1) {
+  if (fxManager->hid->pressed(Buttons::DOWN) && currentGameIndex + 1 < gamesInCategory) {
     delay(200); // simple debounce
     if (inCategoryScreen) {
       inCategoryScreen = false;